@@ -15,8 +15,16 @@
 #define GUARD_AGENT_CORE_H
 
 #include "commons.h"
+#include "compact_codec.h"
+#include "latency_histogram.h"
+#include "link_monitor.h"
+#include "mapped_recorder.h"
+#include "stats_geometry.h"
+#include "stats_mailbox.h"
+#include "tdma_schedule.h"
 // default values for ROS params (if not specified by the user)
 #define DEFAULT_AGENT_ID 0  // if not set by the user, the Ground Station will choose an unique value
+#define DEFAULT_SYNC_TIMEOUT 10.0  // expressed in seconds (waiting for the Ground Station sync service)
 #define DEFAULT_VELOCITY_VIRTUAL_THRESHOLD 4.0  // expressed in meters/second
 #define DEFAULT_SPEED_MIN 0.0  // expressed in meters/second
 #define DEFAULT_SPEED_MAX 4.0  // expressed in meters/second
@@ -27,6 +35,87 @@
 #define DEFAULT_VEHICLE_LENGTH 0.4  // expressed in meters
 #define DEFAULT_WORLD_LIMIT 1.0  // in meters, considering a "square world" (only for random pose generation)
 #define DEFAULT_MARKER_PATH_LIFETIME 30  // expressed in seconds
+#define DEFAULT_MARKER_PATH_RESOLUTION 0.02  // expressed in meters
+#define DEFAULT_MARKER_PATH_RATE 2.0  // expressed in hertz
+#define DEFAULT_MARKER_PATH_MAX_POINTS 1000
+#define DEFAULT_STALE_STATISTICS_MAX_AGE 0.0  // expressed in seconds (0 means that stale statistics are never reused)
+#define DEFAULT_EVENT_THRESHOLD 0.0  // weighted norm of the statistics change (0 means that estimates are always sent)
+#define DEFAULT_EVENT_MAX_SILENCE 1.0  // expressed in seconds
+#define DEFAULT_RANDOM_SEED -1  // negative means that the initial pose is random on each run
+// stages of the loop timed by each agent (see the timing_ histograms)
+#define TIMING_CONSENSUS 0
+#define TIMING_CONTROL 1
+#define TIMING_GUIDANCE 2
+#define TIMING_DYNAMICS 3
+#define TIMING_ALGORITHM 4  // whole algorithmCallback computation
+#define TIMING_TIMER_JITTER 5  // delay of the algorithm timer w.r.t. its expected time
+#define TIMING_TDMA_WAIT 6  // from the end of the computation to the transmission slot
+#define TIMING_PUBLISH 7
+#define NUMBER_OF_TIMING_STAGES 8
+
+// fixed-size types for the algorithm (the number of stats and velocities is bounded by FormationStatistics.msg)
+typedef Eigen::Matrix<double, DEFAULT_NUMBER_OF_STATS, 1> StatsVector;
+typedef Eigen::Matrix<double, DEFAULT_NUMBER_OF_STATS, DEFAULT_NUMBER_OF_STATS> StatsMatrix;
+typedef Eigen::Matrix<double, DEFAULT_NUMBER_OF_VELOCITIES, 1> VelocityVector;
+typedef Eigen::Matrix<double, DEFAULT_NUMBER_OF_VELOCITIES, DEFAULT_NUMBER_OF_VELOCITIES> VelocityMatrix;
+typedef Eigen::Matrix<double, DEFAULT_NUMBER_OF_STATS, DEFAULT_NUMBER_OF_VELOCITIES> JacobianMatrix;
+
+// params of a headless agent (see the AgentCore constructors), with the same names and types of the ROS params
+typedef std::map<std::string, XmlRpc::XmlRpcValue> AgentParameters;
+
+// gains and limits of the algorithm of an agent (the matrices of the control law are diagonal)
+struct AgentGains {
+  double sample_time;  // expressed in seconds
+  int guidance_steps;  // guidance and dynamics steps per sample time (see guidance_sample_time param)
+  double velocity_virtual_threshold;
+  double speed_min;
+  double speed_max;
+  double steer_min;
+  double steer_max;
+  double k_p_speed;
+  double k_p_steer;
+  double vehicle_length;
+  double gamma[DEFAULT_NUMBER_OF_STATS];  // diagonal elements
+  double lambda[DEFAULT_NUMBER_OF_STATS];  // diagonal elements
+  double b[DEFAULT_NUMBER_OF_VELOCITIES];  // diagonal elements
+};
+
+// header of the recording of the loop of an agent (see record_prefix param and ReplayCore)
+struct LoopRecordHeader {
+  int agent_id;
+  int number_of_agents;
+  double x;  // initial pose
+  double y;
+  double theta;
+  AgentGains gains;
+};
+
+// inputs and outputs of a single algorithm step of an agent (see consensus and replayStep)
+struct LoopRecord {
+  double time;  // expressed in seconds
+  double target[DEFAULT_NUMBER_OF_STATS];
+  double received_sum[DEFAULT_NUMBER_OF_STATS];  // weighted sum of the statistics received from the neighbors
+  double received_weight;  // sum of the weights of the statistics received
+  int received_count;
+  int degree;  // degree of the agent in the communication graph
+  double shared[DEFAULT_NUMBER_OF_STATS];  // own estimate as known by the neighbors (see event_threshold param)
+  double estimate[DEFAULT_NUMBER_OF_STATS];  // outputs of the step from here on
+  double twist_virtual[DEFAULT_NUMBER_OF_VELOCITIES];
+  double speed_command;
+  double steer_command;
+  double pose[3];  // (x, y, theta)
+  double pose_virtual[3];  // (x, y, theta)
+};
+
+typedef MappedRecorder<LoopRecordHeader, LoopRecord> LoopRecorder;
+
+// bounded path of a frame (real or virtual agent), republished as a single marker with a fixed id
+struct MarkerPath {
+  std::deque<geometry_msgs::Point> points;
+  std::deque<ros::Time> stamps;  // time of insertion of each point (used to drop the oldest ones)
+  ros::Time last_publish;
+  bool changed;
+};
 
 /*  This class purpose is to provide a ROS interface which lets to simulate a multi-agent completely distribute
  *  consensus and abstraction based control algorithm. Each object (i.e. each ROS node) represents an independent
@@ -39,16 +128,87 @@
  *  or rosrun commands): the agent id must be a unique number, especially when using also real vehicles connected
  *  with the simulated ones through the ROS implementation of the Packet Manager.
  *
+ *  If the agent id is not set, a standalone agent asks it to the Ground Station through the sync service (see
+ *  SyncAgent.srv and VisualizationCore) together with the number of agents and the common start of the algorithm:
+ *  all the agents of the swarm then get compact ids (from 1 to number_of_agents, thus the TDMA slots fit the actual
+ *  swarm) and start their timers in the same TDMA frame, without any agent-specific param. The agents with an
+ *  explicit id are not synchronized (their ids should not be used by the Ground Station then).
+ *
+ *  By default each agent shares its estimate with all the others on a single topic, but a communication graph with a
+ *  limited number of neighbors can be selected (see communication_topology param): each agent then publishes its
+ *  estimate in its own topic (e.g. shared_stats/agent_1) and subscribes only to those of its neighbors. The graph can
+ *  be a ring (agent ids from 1 to number_of_agents, with an even number_of_neighbors: half of them on each side), an
+ *  explicit list of neighbors for each agent (it should be undirected to preserve the average consensus) or the
+ *  k-nearest-neighbor graph assigned by the Ground Station.
+ *
+ *  The same class can also be hosted (together with many other agents) by a single SwarmCore process: in this case
+ *  the agent does not own any timer nor the shared statistics subscription, because the host drives all its agents
+ *  from a shared timer and hands over the statistics among them directly in memory.
+ *
+ *  Lastly, an agent can be created headless (no ROS master, params, topics, tf nor markers at all) from a given set
+ *  of params: the host (e.g. a SimulationCore) drives it exactly like a hosted agent, and it must also provide the
+ *  target statistics and the simulated time (see setTime): a headless agent never reads the ROS clock, thus many
+ *  simulations can run on different threads at the same time.
+ *
+ *  On lossy links, the last estimate received from a neighbor can be reused in the following consensus steps when
+ *  nothing new arrives, until it is older than stale_statistics_max_age (optionally weighted by its age, see
+ *  stale_statistics_weighting): an agent which is no more a neighbor keeps contributing at most for that age. The
+ *  number of fresh, reused and missed estimates of each neighbor is published periodically on the diagnostics topic.
+ *
+ *  The estimates can be broadcasted only on events (see event_threshold param): an agent sends its estimate only when
+ *  it differs from the last one sent by more than the threshold (weighted euclidean norm, see event_weights) or when
+ *  it has been silent for event_max_silence (heartbeat), while the receivers keep the last estimate received (in this
+ *  case stale_statistics_max_age defaults to the heartbeat period plus two sample times, and the age weighting should
+ *  be left disabled). The consensus then tracks the average of the estimates up to an error bounded by the threshold,
+ *  and the traffic drops as soon as the estimates settle. Hosted agents always hand over their estimates in memory.
+ *
+ *  With larger sample times, latent links or lost messages, some neighbor estimates are older than one sample time when
+ *  they are used (an estimate is computed one sample time ahead of its stamp, thus it is current until then): if
+ *  predict_statistics is set, each agent shares also the time derivative of its estimate (in the
+ *  FormationStatisticsPredicted variant, on the shared_stats_predicted_topic instead of the shared_stats_topic) and the
+ *  receivers extrapolate linearly the part of the age beyond one sample time (from the stamp of the sender), only once
+ *  when the estimate is used in the consensus (by at most prediction_max_horizon, two sample times by default). With
+ *  event triggered broadcast the agent uses its own last broadcasted estimate extrapolated the same way, and an event
+ *  is raised only when the estimate departs from that prediction. On time, the estimates are used as they are. The
+ *  compact format and the aggregated arrays do not carry the derivative (the prediction is disabled with
+ *  compact_statistics).
+ *
+ *  On bandwidth limited links the estimates can be shared in a compact fixed-point format (see compact_statistics
+ *  param and CompactCodec) on the shared_stats_compact_topic instead of the shared_stats_topic (all the agents and
+ *  the other nodes must use the same format): they are converted at the edges, i.e. when published and received.
+ *
+ *  The guidance and the dynamics of the real agent (the vehicle tracking loop) can run faster than the consensus and
+ *  the control of the virtual agent (see guidance_sample_time param), so that the vehicle is driven smoothly without
+ *  increasing the traffic of the shared statistics: the sample time is split in an integer number of guidance steps
+ *  and each of them integrates the vehicle with its exact length. A standalone agent runs them on their own timer,
+ *  while the hosted and headless agents run all of them in a burst at the end of each algorithm step.
+ *
+ *  Each stage of the loop (consensus, control, guidance, dynamics, TDMA wait and publish) and the jitter of the
+ *  algorithm timer are timed with the steady clock into fixed histograms (see LatencyHistogram), together with the
+ *  number of deadline misses (timer jitter plus computation longer than the sample time): they are published on the
+ *  diagnostics topic and printed on shutdown by standalone agents (see enable_timing param). Standalone agents also
+ *  measure the end-to-end latency, the inter-arrival jitter and the out-of-slot arrivals of the estimates received
+ *  from each sender (see LinkMonitor).
+ *
+ *  To reproduce a run exactly, a non negative random_seed makes the random initial pose deterministic (each agent
+ *  offsets it by its id), and with record_prefix the inputs (time, target, statistics received, degree and own shared
+ *  estimate) and the outputs (estimate, commands and poses) of each algorithm step are appended to a memory-mapped
+ *  binary file (see MappedRecorder), named after the agent frame (e.g. /tmp/run_agent_1.rec). A headless agent can
+ *  then replay them without ROS nor timing noise (see replayStep and ReplayCore).
+ *
  *  For more info on this class usage, check the README.md in the package folder.
  *
  *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
  *
  *  ROS params:
  *    + sample_time
+ *    + guidance_sample_time
+ *    + frame_tdma
  *    + slot_tdma
+ *    + number_of_agents
  *    + agent_id
- *    + number_of_stats
- *    + number_of_velocities
+ *    + sync_service
+ *    + sync_timeout
  *    + verbosity_level
  *    + velocity_virtual_threshold
  *    + speed_min
@@ -65,43 +225,298 @@
  *    + x
  *    + y
  *    + theta
+ *    + random_seed
+ *    + record_prefix
  *    + topic_queue_length
+ *    + communication_topology
+ *    + number_of_neighbors
+ *    + neighbors
  *    + shared_stats_topic
+ *    + shared_stats_array_topic
+ *    + shared_stats_compact_topic
+ *    + shared_stats_predicted_topic
+ *    + compact_statistics
+ *    + compact_resolution
  *    + target_stats_topic
+ *    + neighbors_topic
  *    + marker_topic
  *    + marker_path_lifetime
+ *    + marker_path_resolution
+ *    + marker_path_rate
+ *    + marker_path_max_points
  *    + enable_path
+ *    + tf_rate
+ *    + event_threshold
+ *    + event_weights
+ *    + event_max_silence
+ *    + stale_statistics_max_age
+ *    + stale_statistics_weighting
+ *    + predict_statistics
+ *    + prediction_max_horizon
+ *    + diagnostics_topic
+ *    + diagnostics_rate
+ *    + enable_timing
  *    + frame_map
  *    + frame_agent_prefix
  *    + frame_virtual_suffix
  */
 class AgentCore {
  public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW  // fixed-size vectorizable Eigen members
+
   /*  The constructor retrieves the agent parameters from ROS params if specified by the user (default values
    *  otherwise), initializes all the structures for the algorithm (e.g. estimated_statistics_) and the publishers
-   *  and subscribers needed, and finally waits for the initial TDMA slot (sample_time_ dependent).
+   *  and subscribers needed, and finally waits for the initial TDMA frame (frame_tdma_ dependent).
    *
    *  Other methods called:
-   *    + setTheta
-   *    + statsVectorToMsg
-   *    + waitForSlotTDMA
+   *    + initialize
    */
   AgentCore();
+
+  /*  Same as the default constructor, but the agent parameters are retrieved from the given private namespace and,
+   *  if the agent is hosted by a SwarmCore, they are also searched upwards (common settings can be shared among all
+   *  the hosted agents). A hosted agent does not create its algorithm timer nor the subscribers to the statistics of
+   *  the other hosted agents, and it does not wait for the initial TDMA slot (the host takes care of all of them).
+   *
+   *  Parameters:
+   *    + private_node_handle: node handle on the private namespace of the agent (e.g. ~agent_1 when hosted);
+   *    + hosted_agent_ids: ids of all the agents hosted by the same SwarmCore (empty for a standalone agent).
+   *  Other methods called:
+   *    + initialize
+   */
+  AgentCore(const ros::NodeHandle &private_node_handle, const std::set<int> &hosted_agent_ids);
+
+  /*  Same as the hosted agent constructor, but the agent parameters are retrieved from the given set of params (with
+   *  the same names and types of the ROS params) and no ROS communication is set up at all: the agent can be used
+   *  without a ROS master (even without ros::init) and its pose is not broadcasted.
+   *
+   *  Parameters:
+   *    + parameters: params of the agent (default values are used for the missing ones);
+   *    + hosted_agent_ids: ids of all the agents driven by the same host.
+   *  Other methods called:
+   *    + initialize
+   */
+  AgentCore(const AgentParameters &parameters, const std::set<int> &hosted_agent_ids);
   ~AgentCore();
 
+  /*  Executes a single iteration of the algorithm (consensus, control, and all the guidance and dynamics steps of the
+   *  sample time, unless they run on their own timer) without sharing the estimated statistics, which have to be
+   *  retrieved afterwards with getEstimatedStatistics.
+   *
+   *  Other methods called:
+   *    + broadcastPoses
+   *    + consensus
+   *    + control
+   *    + dynamics
+   *    + guidance
+   *    + publishDiagnostics
+   *    + updateLoopRecord
+   *    + updateTiming
+   */
+  void algorithmStep();
+
+  /*  Returns the unique id of the agent.
+   *
+   *  Return value:
+   *    + agent id.
+   */
+  int getAgentId() const;
+
+  /*  Returns the last estimated statistics of the agent in the same form they are published in the shared topic.
+   *
+   *  Return value:
+   *    + estimated statistics with header and agent id.
+   */
+  formation_control::FormationStatisticsStamped getEstimatedStatistics() const;
+
+  /*  Returns the gains and the limits used by the agent in the algorithm (e.g. to step it in a SwarmState).
+   *
+   *  Return value:
+   *    + gains and limits of the agent.
+   */
+  AgentGains getGains() const;
+
+  /*  Returns the current pose of the (real) agent, with the orientation built from its heading.
+   *
+   *  Return value:
+   *    + pose of the agent in the frame_map_ frame.
+   */
+  geometry_msgs::Pose getPose() const;
+
+  /*  Returns the current poses of the real and virtual agents as tf transforms from the frame_map_ frame, so that
+   *  the host of many agents can broadcast all of them in a single message.
+   *
+   *  Return value:
+   *    + transforms of the real and the virtual agent (stamped with the current time).
+   */
+  std::vector<tf::StampedTransform> getPoseTransforms() const;
+
+  /*  Returns the last estimated statistics of the agent together with their time derivative (all zeros if
+   *  predict_statistics_ is not set), i.e. what the agent shares with the others (see publishStatistics).
+   *
+   *  Other methods called:
+   *    + getEstimatedStatistics
+   *    + statsVectorToMsg
+   *  Return value:
+   *    + estimated statistics with header, agent id and time derivative.
+   */
+  formation_control::FormationStatisticsPredicted getSharedStatistics() const;
+
+  /*  Returns the last target statistics received by the agent.
+   *
+   *  Return value:
+   *    + target statistics.
+   */
+  formation_control::FormationStatistics getTargetStatistics() const;
+
+  /*  Returns the offset of the TDMA transmission slot of the agent from the beginning of each frame. It is public
+   *  because a SwarmCore publishes the statistics of its hosted agents in their own slots.
+   *
+   *  Return value:
+   *    + offset in seconds (see computeSlotTDMA).
+   */
+  double getTransmitOffset() const;
+
+  /*  Returns the current twist of the (real) agent.
+   *
+   *  Return value:
+   *    + twist of the agent in the frame_map_ frame.
+   */
+  geometry_msgs::Twist getTwist() const;
+
+  /*  Returns the current pose of the virtual agent, with the orientation built from its heading.
+   *
+   *  Return value:
+   *    + pose of the virtual agent in the frame_map_ frame.
+   */
+  geometry_msgs::Pose getVirtualPose() const;
+
+  /*  Returns the current twist of the virtual agent.
+   *
+   *  Return value:
+   *    + twist of the virtual agent in the frame_map_ frame.
+   */
+  geometry_msgs::Twist getVirtualTwist() const;
+
+  /*  Publishes the given shared statistics in the shared topic, converted in the compact format if enabled, or with
+   *  their time derivative only if predict_statistics_ is set.
+   *
+   *  Parameters:
+   *    + msg: estimated statistics with header, agent id and time derivative (see getSharedStatistics).
+   */
+  void publishStatistics(const formation_control::FormationStatisticsPredicted &msg);
+
+  /*  Unless the message recived from the shared topic has the same id of the receiver (i.e. a message previously
+   *  sent by itself) or it comes from an agent which is not a neighbor, it stores the data received in the slot of the
+   *  sender of a mailbox preallocated on the neighbors, which is shared among threads without locks (the receiving
+   *  threads never wait for the algorithm one, see StatsMailbox), together with its time of reception. It is public
+   *  because a SwarmCore hands over the statistics of its hosted agents directly, without passing through the shared
+   *  topic.
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of a certain agent.
+   *  Other methods called:
+   *    + processReceivedStats
+   */
+  void receivedStatsCallback(const formation_control::FormationStatisticsStamped &received);
+
+  /*  Processes the statistics received from the shared predicted topic as receivedStatsCallback does, but stores also
+   *  their time derivative in the mailbox (see predict_statistics param). It is public because a SwarmCore hands over
+   *  the statistics of its hosted agents directly, with their time derivative.
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of a certain agent and their time
+   *      derivative.
+   *  Other methods called:
+   *    + processReceivedStats
+   */
+  void receivedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &received);
+
+  /*  Executes a single algorithm step (see algorithmStep) with the inputs of the given record in place of those of
+   *  the current step (time, target statistics and all the inputs of the consensus). It is public because a replay
+   *  engine (see ReplayCore) feeds the recorded steps to a headless agent with the recorded initial pose.
+   *
+   *  Parameters:
+   *    + record: recorded step (its outputs are not used).
+   *  Other methods called:
+   *    + algorithmStep
+   *  Return value:
+   *    + inputs and outputs of the replayed step.
+   */
+  LoopRecord replayStep(const LoopRecord &record);
+
+  /*  Sets the simulated time of a headless agent (it starts from 1s, because the zero time is treated as "not valid"
+   *  by ROS), which is used in place of the ROS time. It has no effect on the other agents.
+   *
+   *  Parameters:
+   *    + time: current simulated time.
+   */
+  void setTime(const ros::Time &time);
+
+  /*  It is called every time a new target statistics has been published to a predefined topic (settable through a
+   *  ROS param) or to the agent own target topic (e.g. target_stats/agent_1, when the Ground Station sees it joining)
+   *  and updates the private variable target_statistics_ with the new given target, unless it is older than the
+   *  current one (e.g. a latched target of a previous join). It is public because the host of a headless agent
+   *  provides the target statistics directly.
+   *
+   *  Parameters:
+   *    + target: new target statistics.
+   */
+  void targetStatsCallback(const formation_control::FormationStatisticsStamped &target);
+
+  /*  Checks whether the given estimated statistics have to be broadcasted (always true if the event triggered mode is
+   *  disabled): they must differ from the last broadcasted ones (extrapolated to the stamp of the given ones, see
+   *  predict_statistics param) by more than event_threshold_ or the agent must have been silent for
+   *  event_max_silence_. If so, they become the last broadcasted statistics (the check and the update are atomic,
+   *  under transmit_statistics_mutex_). It is public because a SwarmCore publishes the statistics of its hosted
+   *  agents.
+   *
+   *  Parameters:
+   *    + msg: estimated statistics with header, agent id and time derivative (see getSharedStatistics).
+   *  Other methods called:
+   *    + extrapolateStatistics
+   *    + statsMsgToVector
+   *  Return value:
+   *    + true if the statistics have to be broadcasted.
+   */
+  bool triggerBroadcast(const formation_control::FormationStatisticsPredicted &msg);
+
  private:
-  ros::NodeHandle node_handle_;
+  ros::NodeHandle *node_handle_;
   ros::NodeHandle *private_node_handle_;
   ros::Publisher stats_publisher_;
   ros::Publisher marker_publisher_;
+  ros::Publisher diagnostics_publisher_;
   ros::Subscriber stats_subscriber_;
+  ros::Subscriber stats_array_subscriber_;
   ros::Subscriber target_stats_subscriber_;
+  ros::Subscriber agent_target_stats_subscriber_;
+  ros::Subscriber neighbors_subscriber_;
+  std::map<int, ros::Subscriber> neighbor_stats_subscribers_;
   ros::Timer algorithm_timer_;
-  tf::TransformBroadcaster tf_broadcaster_;
+  ros::Timer transmit_timer_;
+  ros::Timer guidance_timer_;
+  tf::TransformBroadcaster *tf_broadcaster_;
 
+  bool headless_;
+  AgentParameters headless_parameters_;  // only for headless agents
+  ros::Time headless_time_;  // only for headless agents (see setTime)
+  LoopRecorder *loop_recorder_;  // only if record_prefix is set
+  LoopRecord loop_record_;  // inputs and outputs of the current algorithm step
+  bool replay_;  // the inputs of the current step are given by replayStep
+  bool hosted_;
+  std::set<int> hosted_agent_ids_;
   bool enable_path_;
-  int marker_path_id_;
+  double tf_rate_;
+  ros::Time last_tf_broadcast_;
+  std::string diagnostics_topic_name_;
+  double diagnostics_rate_;
+  ros::Time last_diagnostics_;
   int marker_path_lifetime_;
+  double marker_path_resolution_;
+  double marker_path_rate_;
+  int marker_path_max_points_;
+  std::map<std::string, MarkerPath> marker_paths_;
   std::string frame_map_;
   std::string frame_agent_prefix_;
   std::string frame_virtual_suffix_;
@@ -110,30 +525,76 @@ class AgentCore {
 
   int topic_queue_length_;
   std::string shared_stats_topic_name_;
+  std::string shared_stats_array_topic_name_;
+  std::string shared_stats_compact_topic_name_;
+  std::string shared_stats_predicted_topic_name_;
+  std::string stats_topic_name_;  // the shared, the compact or the predicted one (see compact_statistics param)
+  bool compact_statistics_;
+  CompactCodec compact_codec_;
   std::string target_stats_topic_name_;
+  std::string neighbors_topic_name_;
   std::string marker_topic_name_;
   double sample_time_;
+  double guidance_sample_time_;  // an exact fraction of the sample time
+  int guidance_steps_;  // guidance and dynamics steps per sample time
+  bool guidance_loop_;  // whether the guidance and the dynamics run on their own timer (standalone agents only)
+  std::mutex state_mutex_;  // poses and twists shared by the algorithm and the guidance timers
+  double frame_tdma_;
   double slot_tdma_;
+  double transmit_offset_;  // time from the beginning of the TDMA frame to the agent transmission slot
+  int number_of_agents_;
+
+  std::string communication_topology_;  // "all", "ring", "adjacency" or "knn"
+  int number_of_neighbors_;
+  std::set<int> neighbors_;  // not used with "all" topology (every agent is a neighbor)
+  std::map<int, int> neighbor_slots_;  // slot of each neighbor in the received statistics and in the link monitor
+  std::vector<int> slot_ids_;  // neighbor assigned to each slot (-1 if free), not used with "all" topology
+  std::mutex neighbors_mutex_;
 
   int agent_id_;  // it must be set with a unique value among all agents
-  geometry_msgs::Pose pose_;
-  geometry_msgs::Pose pose_virtual_;
+  std::string sync_service_name_;
+  ros::Time sync_start_time_;  // common start of the TDMA frames given by the Ground Station (zero if not synced)
+  geometry_msgs::Pose pose_;  // only the position is kept updated (see theta_)
+  geometry_msgs::Pose pose_virtual_;  // only the position is kept updated (see theta_virtual_)
+  double theta_;  // heading of the planar model (the orientation is built only for the outside world)
+  double theta_virtual_;
   geometry_msgs::Twist twist_;
   geometry_msgs::Twist twist_virtual_;
   formation_control::FormationStatistics target_statistics_;
+  ros::Time target_stamp_;  // of the current target statistics
   formation_control::FormationStatistics estimated_statistics_;
-  std::map<int, formation_control::FormationStatistics> received_statistics_;
-  std::mutex received_statistics_mutex_;
+  StatsMailbox received_statistics_;  // last statistics received from each agent since the previous consensus
+  double stale_statistics_max_age_;
+  bool stale_statistics_weighting_;
+  bool predict_statistics_;
+  double prediction_max_horizon_;  // expressed in seconds
+  StatsVector estimated_statistics_dot_;  // time derivative of the estimate in the last consensus step
+  formation_control::FormationStatisticsPredicted transmit_statistics_;  // waiting for the agent transmission slot
+  std::mutex transmit_statistics_mutex_;
+  double event_threshold_;
+  StatsVector event_weights_;
+  double event_max_silence_;
+  formation_control::FormationStatisticsPredicted last_broadcast_statistics_;  // empty until the first broadcast
+  std::atomic<unsigned long> sent_estimates_;
+  std::atomic<unsigned long> suppressed_estimates_;
+  std::chrono::steady_clock::time_point transmit_scheduled_;  // end of the last computation (see algorithmCallback)
+
+  // timing of the loop
+  bool enable_timing_;
+  LatencyHistogram timing_[NUMBER_OF_TIMING_STAGES];
+  std::vector<std::string> timing_stage_names_;
+  std::atomic<unsigned long> deadline_misses_;
+  unsigned long last_deadline_misses_;  // at the previous diagnostics publication
+  bool enable_link_monitor_;
+  LinkMonitor link_monitor_;
 
-  int number_of_stats_;
-  int number_of_velocities_;
   // consensus
-  Eigen::RowVectorXd phi_dot_;
+  StatsVector phi_dot_;
   // control law
-  Eigen::MatrixXd gamma_;
-  Eigen::MatrixXd lambda_;
-  Eigen::MatrixXd b_;
-  Eigen::MatrixXd jacob_phi_;
+  StatsMatrix gamma_;
+  StatsMatrix lambda_;
+  VelocityMatrix b_;
+  JacobianMatrix jacob_phi_;
 
   double velocity_virtual_threshold_;
   double speed_min_;
@@ -151,113 +612,136 @@ class AgentCore {
 
   int verbosity_level_;
 
-  /*  Creates a new marker LINE_STRIP which links the two poses passed as parameters, with the aim to show the path
-   *  of the agent from the pose k-1 to the current pose k. The marker lays in a namespace which depends on the given
-   *  frame parameter, which is also used to vary the marker color (this is done to distinguish between real and
-   *  virtual agent paths). The marker as a specified lifetime to reproduce a fading effect of the oldest samples.
+  /*  Advertises the given topic of the shared statistics with the full, the compact or the predicted message type
+   *  (see compact_statistics_ and predict_statistics_).
    *
    *  Parameters:
-   *    + p_old: last pose of the agent;
-   *    + p_new: current pose of the agent;
-   *    + frame: specifies the agent id and distinguishes between real and virtual paths (e.g. agent_1_virtual).
+   *    + topic: name of the topic.
    *  Return value:
-   *    + LINE_STRIP marker with ADD property and a unique pair <namespace, id>.
+   *    + publisher of the topic.
    */
-  visualization_msgs::Marker addToMarkerPath(const geometry_msgs::Point &p_old, const geometry_msgs::Point &p_new,
-                                             const std::string &frame);
+  ros::Publisher advertiseStatistics(const std::string &topic);
 
   /*  This is the main method of the algorithm and it is automatically called by a timer event every sample_time_.
    *  Every single time it calls in order the core methods: those for the virtual agent (consensus and control) and
-   *  those for the real one (guidance and dynamics). At the end it waits for the proper TDMA slot (agent_id_
-   *  dependent) and publishes its estimated statistics in the shared topic.
+   *  those for the real one (guidance and dynamics). At the end it schedules the transmission of its estimated
+   *  statistics in the proper TDMA slot (agent_id_ dependent) without blocking the thread: a one-shot timer publishes
+   *  them in the shared topic when the slot is reached. The guidance and the dynamics are left to the guidance timer,
+   *  if enabled (see guidanceCallback).
    *
    *  Parameters:
-   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (not used, but necessary).
+   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (the expected time of the event is the
+   *      beginning of the current TDMA frame).
    *  Other methods called:
-   *    + consensus
-   *    + control
-   *    + dynamics
-   *    + guidance
-   *    + waitForSlotTDMA
+   *    + algorithmStep
+   *    + getSharedStatistics
+   *    + publishStatistics
+   *    + updateTiming
    */
   void algorithmCallback(const ros::TimerEvent &timer_event);
 
-  /*  If path visualization is enabled (settable through a ROS param) it publishes a new marker representing the
-   *  updated path for the virtual or real agent in a predefined topic (settable through another ROS param).
+  /*  If path visualization is enabled (settable through a ROS param) it adds the current pose to the bounded path
+   *  of the virtual or real agent and, if the path has changed, it republishes the whole path as a single marker in a
+   *  predefined topic (settable through another ROS param), at most at marker_path_rate_ (0 means every change).
    *
    *  Parameters:
    *    + pose_new: current pose of the agent;
    *    + pose_old: last pose of the agent;
    *    + frame: specifies the agent id and distinguishes between real and virtual paths (e.g. agent_1_virtual).
    *  Other methods called:
-   *    + addToMarkerPath
+   *    + getMarkerPath
+   *    + updateMarkerPath
    */
   void broadcastPath(const geometry_msgs::Pose &pose_new, const geometry_msgs::Pose &pose_old, const std::string &frame);
 
-  /*  Broadcasts the (current) pose of the given frame (virtual or real agent) to the TF ROS environment.
+  /*  Broadcasts the current poses of the real and virtual agents to the TF ROS environment in a single message, at
+   *  most at tf_rate_ (0 means every sample time). Nothing is broadcasted by hosted agents, since the host sends the
+   *  poses of all its agents together (see getPoseTransforms).
    *
-   *  Parameters:
-   *    + pose: current pose of the agent;
-   *    + frame: specifies the agent id and distinguishes between real and virtual paths (e.g. agent_1_virtual).
+   *  Other methods called:
+   *    + getPoseTransforms
    */
-  void broadcastPose(const geometry_msgs::Pose &pose, const std::string &frame);
+  void broadcastPoses();
+
+  /*  Computes the offset of the agent transmission slot from the beginning of the TDMA frame. The first slot of the
+   *  frame is used for the algorithm computation by all the robots simultaneously, while the agent N speaks in the
+   *  N+1th slot. If the agent ids exceed the number of slots in a frame, they are wrapped around (and a warning is
+   *  displayed, because more agents share the same slot). See TdmaSchedule.
+   *
+   *  Return value:
+   *    + transmission offset expressed in seconds.
+   */
+  double computeSlotTDMA() const;
 
   /*  Computes the current estimate of statistics based on a dynamic discrete consensus algorithm: it updates the
    *  previous estimate using the current pose and twist of the virtual agent and the estimated statistics received
    *  from all the other agents (which appear in the Laplacian matrix L). Brefly: x_k+1 = phi_dot_k*Ts + (I - Ts*L)x_k, 
    *  where phi_dot is the (analytic) time derivative of phi = [px, py, pxx, pxy, pyy]. In addition, there is a check
    *  on the sample time which must be smaller enough to guarantee the convergence (depends on the number of agents).
+   *  All the inputs which do not depend on the state of the agent are stored in loop_record_, unless they are given
+   *  by replayStep. The time derivative of the estimate is kept for the prediction (see predict_statistics param).
    *
    *  Other methods called:
-   *    + statsMsgToMatrix
+   *    + extrapolateStatistics
    *    + statsMsgToVector
    *    + statsVectorToMsg
    */
   void consensus();
 
-  /*  Displays a message with a specific log level, using the proper ROS MACRO. This method is used by all the others
-   *  to show errors, warnings and useful info about the state of the node in a homogeneous format; it provides also
-   *  five distinct verbosity levels for debug info (e.g. to investigate specific variables and the flow of the code).
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the node in a homogeneous format.
    *
    *  Parameters:
-   *    + caller_name: name of the method which calls this one;
-   *    + message: stream to be sent to the console;
-   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
    */
-  void console(const std::string &caller_name, std::stringstream &message, const int &log_level) const;
+  std::string consolePrefix(const std::string &caller_name) const;
 
   /*  Computes a simple control action for the virtual agent based on the (analytic) Jacobian matrix of phi and the
    *  estimation error w.r.t. the target statistics: control_twist = inv(B + Jphi'*lambda*Jphi)*Jphi'*gamma*stats_error,
    *  where phi = [px, py, pxx, pxy, pyy] and B(2x2), lambda(5x5) and gamma(5x5) are diagonal square matrices which
-   *  can be tuned by the user using the given ROS params. The control action is then saturated with a threshold (also
-   *  tunable with a ROS param) and the pose and twist of the virtual agent are updated properly; lastly, the pose and
-   *  the new segment of the path (from the previous pose to the current one) are broadcasted for visualization in rviz
-   *  respectively to the TF framework and to a specific marker topic (whose name can be set with another ROS param).
+   *  can be tuned by the user using the given ROS params (the 2x2 system is solved in closed form). The control action
+   *  is then saturated with a threshold (also tunable with a ROS param) and the pose and twist of the virtual agent are
+   *  updated properly; lastly, the new segment of the path (from the previous pose to the current one) is broadcasted
+   *  for visualization in rviz to a specific marker topic (whose name can be set with another ROS param).
    *
    *  Other methods called:
    *    + broadcastPath
-   *    + broadcastPose
    *    + integrator
-   *    + setTheta
+   *    + solveVelocitySystem
    *    + statsMsgToVector
    */
   void control();
 
-  /*  Computes the dynamics of a simplified simulated 4-wheel vehicle using speed and steer commands and only the
-   *  legnth between the the front and rear axes (which is adjustable through a ROS param). Pose and twist of the
-   *  simulated agent are then updated and the pose and the new segment of the path (from the previous pose to the
-   *  current one) are broadcasted for visualization in rviz respectively to the TF framework and to a specific
-   *  marker topic (whose name can be set with another ROS param).
+  /*  Computes the dynamics of a simplified simulated 4-wheel vehicle using speed and steer commands and only the legnth
+   *  between the the front and rear axes (which is adjustable through a ROS param), integrated over a single guidance
+   *  step (guidance_sample_time_). Pose and twist of the simulated agent are then updated and the new segment of the
+   *  path (from the previous pose to the current one) is broadcasted for visualization in rviz to a specific marker
+   *  topic (whose name can be set with another ROS param).
    *
    *  Other methods called:
    *    + broadcastPath
-   *    + broadcastPose
-   *    + getTheta
    *    + integrator
-   *    + setTheta
    */
   void dynamics();
 
+  /*  Extrapolates linearly the given statistics to the given time with their time derivative, from one sample time
+   *  after their stamp (when they stop being current) and by at most prediction_max_horizon_ (the statistics are
+   *  returned as they are if predict_statistics_ is not set).
+   *
+   *  Parameters:
+   *    + msg: statistics with stamp;
+   *    + stats_dot: time derivative of the statistics;
+   *    + time: time of the prediction in seconds.
+   *  Other methods called:
+   *    + statsMsgToVector
+   *  Return value:
+   *    + predicted statistics.
+   */
+  StatsVector extrapolateStatistics(const formation_control::FormationStatisticsStamped &msg,
+                                    const formation_control::FormationStatistics &stats_dot, const double &time) const;
+
   /*  Updates the vaule passed by reference with its floored value to the N-th decimals.
    *
    *  Parameters:
@@ -266,25 +750,83 @@ class AgentCore {
    */
   void floor(double &d, const int &precision) const;
 
-  /*  Returns the roll pitch and yaw angles of the given quaternion.
+  /*  Returns the name of the topic dedicated to the given agent (e.g. shared_stats/agent_1).
+   *
+   *  Parameters:
+   *    + topic: base name of the topic;
+   *    + id: agent id.
+   *  Return value:
+   *    + agent specific topic name.
+   */
+  std::string getAgentTopic(const std::string &topic, const int &id) const;
+
+  /*  Creates a marker LINE_STRIP which links all the points stored in the given path, with the aim to show the
+   *  recent path of the agent. The marker lays in a namespace which depends on the given frame parameter, which is
+   *  also used to vary the marker color (this is done to distinguish between real and virtual agent paths). The id is
+   *  fixed, thus each new marker replaces the previous one in rviz.
+   *
+   *  Parameters:
+   *    + path: bounded path of the agent;
+   *    + frame: specifies the agent id and distinguishes between real and virtual paths (e.g. agent_1_virtual).
+   *  Return value:
+   *    + LINE_STRIP marker with ADD property and a fixed pair <namespace, id>.
+   */
+  visualization_msgs::Marker getMarkerPath(const MarkerPath &path, const std::string &frame) const;
+
+  /*  Returns the highest agent id expected by this agent (see number_of_agents_ and the hosted agents).
+   *
+   *  Return value:
+   *    + the highest expected agent id.
+   */
+  int getMaxAgentId() const;
+
+  /*  Returns the slot of the given agent in the received statistics and in the link monitor, if it is a neighbor of
+   *  this agent (with "all" topology every agent is a neighbor and its slot is its own id, see updateNeighbors).
    *
    *  Parameters:
-   *    + quat: quaternion representing a pose::orientation.
+   *    + id: agent id.
    *  Return value:
-   *    + vector containing roll pitch and yaw angles in radians.
+   *    + slot of the agent (beyond the capacity of the mailbox for the slow path), -1 if it is not a neighbor.
    */
-  Eigen::Vector3d getRPY(const geometry_msgs::Quaternion &quat) const;
+  int getNeighborSlot(const int &id);
 
-  /*  Returns the z-axis orientation of the given quaternion (we assume agents motion in the 2D xy plane).
+  /*  Retrieves the given ROS param from the private namespace of the agent (default value otherwise). If the agent is
+   *  hosted by a SwarmCore, the param is searched upwards starting from the agent private namespace, so that common
+   *  settings can be provided only once for all the hosted agents. A headless agent retrieves it from its own set of
+   *  params instead.
    *
    *  Parameters:
-   *    + quat: quaternion representing a pose::orientation.
+   *    + name: name of the param (relative to the private namespace);
+   *    + value: retrieved value passed by reference;
+   *    + default_value: value used if the param is not found (or if it has a wrong type).
    *  Other methods called:
-   *    + getRPY
+   *    + getParamValue
+   */
+  template <typename T>
+  void getParam(const std::string &name, T &value, const T &default_value) const;
+
+  /*  Converts the given XmlRpc param (e.g. from the set of params of a headless agent) to the type of the given value,
+   *  following the same rules of the ROS params (an integer is also a valid floating point value).
+   *
+   *  Parameters:
+   *    + param: value of the param;
+   *    + value: converted value passed by reference.
+   *  Return value:
+   *    + false if the param has a different type (value is not modified).
+   */
+  bool getParamValue(XmlRpc::XmlRpcValue param, bool &value) const;
+  bool getParamValue(XmlRpc::XmlRpcValue param, int &value) const;
+  bool getParamValue(XmlRpc::XmlRpcValue param, double &value) const;
+  bool getParamValue(XmlRpc::XmlRpcValue param, std::string &value) const;
+  template <typename T>
+  bool getParamValue(XmlRpc::XmlRpcValue param, std::vector<T> &value) const;
+
+  /*  Returns the current time: the simulated one for a headless agent (see setTime), the ROS time otherwise.
+   *
    *  Return value:
-   *    + z-axis orientation in radians.
+   *    + current time.
    */
-  double getTheta(const geometry_msgs::Quaternion &quat) const;
+  ros::Time getTime() const;
 
   /*  Computes a simple LOS guidance for the simulated agent with the aim to pursuit the virtual one: LOS distance and
    *  LOS angle are evaluated from the knowledge of the poses of the two agents; then the speed and the steer commands
@@ -296,27 +838,145 @@ class AgentCore {
    */
   void guidance();
 
+  /*  It is automatically called by the guidance timer every guidance_sample_time_ (standalone agents with a guidance
+   *  faster than the algorithm only): it executes a single guidance and dynamics step with the last pose of the
+   *  virtual agent, and broadcasts the new poses.
+   *
+   *  Parameters:
+   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (not used, but necessary).
+   *  Other methods called:
+   *    + broadcastPoses
+   *    + dynamics
+   *    + guidance
+   *    + updateTiming
+   */
+  void guidanceCallback(const ros::TimerEvent &timer_event);
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+
+  /*  Initializes the neighbors of the agent accordingly to the selected communication topology: the ring links each
+   *  agent to the number_of_neighbors_ closest ids (wrapped in [1, number_of_agents_]), while the adjacency topology
+   *  uses the list provided through the neighbors param. The knn topology starts as a ring and it is updated by the
+   *  Ground Station in the agent neighbors topic. The slots of the received statistics are reserved on the neighbors
+   *  (on all the expected agent ids with "all" topology).
+   *
+   *  Other methods called:
+   *    + getAgentTopic
+   *    + getMaxAgentId
+   *    + getParam
+   *    + reserveNeighborSlots
+   *    + updateNeighbors
+   */
+  void initializeNeighbors();
+
+  /*  Retrieves the agent parameters (see getParam) if specified by the user (default values otherwise), initializes
+   *  all the structures for the algorithm (e.g. estimated_statistics_) and the publishers and subscribers needed
+   *  (none for headless agents), and finally, only for a standalone agent, starts its timers after the initial TDMA
+   *  frame (frame_tdma_ dependent). It is shared by all the constructors.
+   *
+   *  Other methods called:
+   *    + computeSlotTDMA
+   *    + getAgentTopic
+   *    + getParam
+   *    + initializeNeighbors
+   *    + statsVectorToMsg
+   *    + syncAgent
+   *    + waitForSlotTDMA
+   */
+  void initialize();
+
   /*  Computes the integration following the Tustin (trapezoidal) formulation: out_k = out_k-1 + KT(in_k-1 + in_k)/2,
-   *  where T is the sample_time_ and the other variables are the given parameters.
+   *  where T is the given step (sample_time_ or guidance_sample_time_) and the other variables are the given
+   *  parameters.
    *
    *  Parameters:
    *    + out_old: previous output.
    *    + in_old: previous input.
    *    + in_new: current input (new measure).
    *    + k: gain.
+   *    + step: integration step expressed in seconds.
    *  Return value:
    *    + integrated value.
    */
-  double integrator(const double &out_old, const double &in_old, const double &in_new, const double &k) const;
+  double integrator(const double &out_old, const double &in_old, const double &in_new, const double &k,
+                    const double &step) const;
 
-  /*  Unless the message recived from the shared topic has the same id of the receiver (i.e. a message previously
-   *  sent by itself), it stores the data received in a map using as hash key the sender id. Note that it is necessary
-   *  to use a mutex protection on the map because it is shared among threads.
+  /*  It is called every time the Ground Station assigns new neighbors to this agent (only with "knn" topology).
    *
    *  Parameters:
-   *    + received: a ROS custom message which carries the estimated statistics of a certain agent.
+   *    + msg: new neighbors of the agent.
+   *  Other methods called:
+   *    + updateNeighbors
    */
-  void receivedStatsCallback(const formation_control::FormationStatisticsStamped &received);
+  void neighborsCallback(const formation_control::AgentNeighbors &msg);
+
+  /*  Displays the summary of the timing histograms of all the stages of the loop and the number of deadline misses
+   *  (it is called on shutdown).
+   */
+  void printTiming() const;
+
+  /*  Unless the given message has the same id of the receiver (i.e. a message previously sent by itself) or it comes
+   *  from an agent which is not a neighbor, it stores the data received in the mailbox (see receivedStatsCallback)
+   *  as they are, with their time derivative and the stamp of the sender (they are extrapolated only when collected
+   *  by the consensus), and adds the message to the link monitor (standalone agents with timing enabled only).
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of a certain agent;
+   *    + stats_dot: time derivative of the received statistics (all zeros if not shared);
+   *    + slot_check: whether the message is expected in the TDMA slot of its sender (see LinkMonitor).
+   *  Other methods called:
+   *    + getMaxAgentId
+   *    + getNeighborSlot
+   *    + reserveNeighborSlots
+   */
+  void processReceivedStats(const formation_control::FormationStatisticsStamped &received,
+                            const formation_control::FormationStatistics &stats_dot, const bool &slot_check);
+
+  /*  Publishes the counters of the fresh, reused and missed estimates of every neighbor received (see StatsMailbox)
+   *  together with the counters of the sent and suppressed estimates (see triggerBroadcast) and the summary of the
+   *  timing histograms (see printTiming) and of the link monitor as separate diagnostic statuses on the diagnostics
+   *  topic, at most at diagnostics_rate_ (0 means never). The timing status is a warning if some deadline has been
+   *  missed since the previous publication. Nothing is published by headless agents.
+   */
+  void publishDiagnostics();
+
+  /*  Unpacks the estimated statistics of a group of agents (e.g. all the agents hosted by a SwarmCore) received in a
+   *  single message from the shared array topic and processes them one by one as if they were received separately.
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of several agents.
+   *  Other methods called:
+   *    + processReceivedStats
+   */
+  void receivedStatsArrayCallback(const formation_control::FormationStatisticsArray &received);
+
+  /*  Converts the compact statistics received from the shared topic (see CompactCodec) and processes them as if they
+   *  were received in the full format.
+   *
+   *  Parameters:
+   *    + received: compact statistics of a certain agent.
+   *  Other methods called:
+   *    + receivedStatsCallback
+   */
+  void receivedStatsCompactCallback(const formation_control::FormationStatisticsCompact &received);
+
+  /*  Reserves the given number of slots in the received statistics and in the link monitor (if enabled), each one
+   *  assigned to the agent id equal to its index until updateNeighbors assigns them to the neighbors. It is not
+   *  thread safe (see StatsMailbox::reserve).
+   *
+   *  Parameters:
+   *    + number_of_slots: number of slots (the number of neighbors or the highest expected id plus one).
+   */
+  void reserveNeighborSlots(const int &number_of_slots);
 
   /*  Computes the saturation of the given value w.r.t. the provided thresholds.
    *
@@ -329,45 +989,34 @@ class AgentCore {
    */
   double saturation(const double &value, const double &min, const double &max) const;
 
-  /*  Updates the z-axis orientation of the given quaternion with the provided value.
+  /*  Solves the 2x2 linear system A*x = b in closed form (Cramer's rule), which is the only one needed by the control
+   *  law. A null vector is returned (and an error is displayed) if the matrix is singular.
    *
    *  Parameters:
-   *    + quat: updated quaternion passed by reference;
-   *    + theta: new value of orientation w.r.t. the z-axis.
-   *  Other methods called:
-   *    + getRPY
-   */
-  void setTheta(geometry_msgs::Quaternion &quat, const double &theta) const;
-
-  /*  Convetrs a set of statistics stored in formation_control::FormationStatistics ROS messages to a Eigen::MatrixXd
-   *  data matrix.
-   *
-   *  Parameters:
-   *    + msg: each pair of the map is composed by an agent id and its estimated statistics.
-   *  Other methods called:
-   *    + statsMsgToVector
+   *    + a: system matrix (B + Jphi'*lambda*Jphi);
+   *    + b: known terms vector (Jphi'*gamma*stats_error).
    *  Return value:
-   *    + matrix filled with the given values (each row is a distinct statistic).
+   *    + solution of the system.
    */
-  Eigen::MatrixXd statsMsgToMatrix(const std::map<int, formation_control::FormationStatistics> &msg) const;
+  VelocityVector solveVelocitySystem(const VelocityMatrix &a, const VelocityVector &b) const;
 
-  /*  Convetrs statistics from formation_control::FormationStatistics ROS message to Eigen::VectorXd data vector.
+  /*  Convetrs statistics from formation_control::FormationStatistics ROS message to StatsVector data vector.
    *
    *  Parameters:
    *    + msg: structure containing the statistics (mx, my, mxx, mxy, myy).
    *  Return value:
    *    + vector filled with the given values.
    */
-  Eigen::VectorXd statsMsgToVector(const formation_control::FormationStatistics &msg) const;
+  StatsVector statsMsgToVector(const formation_control::FormationStatistics &msg) const;
 
-  /*  Convetrs statistics from Eigen::VectorXd data vector to formation_control::FormationStatistics ROS message.
+  /*  Convetrs statistics from StatsVector data vector to formation_control::FormationStatistics ROS message.
    *
    *  Parameters:
    *    + vector: data is stored in the following order (mx, my, mxx, mxy, myy).
    *  Return value:
    *    + message filled with the given values.
    */
-  formation_control::FormationStatistics statsVectorToMsg(const Eigen::VectorXd &vector) const;
+  formation_control::FormationStatistics statsVectorToMsg(const StatsVector &vector) const;
 
   /*  Convetrs statistics from std::vector<double> data vector to formation_control::FormationStatistics ROS message.
    *
@@ -380,24 +1029,116 @@ class AgentCore {
    */
   formation_control::FormationStatistics statsVectorToMsg(const std::vector<double> &vector) const;
 
-  /*  It is called every time a new target statistics has been published to a predefined topic (settable through a
-   *  ROS param) and updates the private variable target_statistics_ with the new given target.
+  /*  Subscribes to the given topic of the shared statistics with the full, the compact or the predicted message type
+   *  (see compact_statistics_ and predict_statistics_).
    *
    *  Parameters:
-   *    + target: new target statistics.
+   *    + topic: name of the topic.
+   *  Return value:
+   *    + subscriber of the topic.
    */
-  void targetStatsCallback(const formation_control::FormationStatisticsStamped &target);
-  
+  ros::Subscriber subscribeStatistics(const std::string &topic);
+
+  /*  Asks the agent id, the number of agents and the common start of the algorithm to the Ground Station through the
+   *  sync service, waiting for it at most sync_timeout. If the Ground Station does not answer, the agent keeps its
+   *  params (a warning is displayed).
+   *
+   *  Other methods called:
+   *    + getParam
+   */
+  void syncAgent();
+
+  /*  Publishes the estimated statistics previously scheduled by algorithmCallback. It is called by a one-shot timer
+   *  in the agent TDMA transmission slot.
+   *
+   *  Parameters:
+   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (not used, but necessary).
+   *  Other methods called:
+   *    + publishStatistics
+   *    + triggerBroadcast
+   */
+  void transmitCallback(const ros::TimerEvent &timer_event);
+
+  /*  Stores the outputs of the current algorithm step in loop_record_ and appends it to the recording (if enabled).
+   */
+  void updateLoopRecord();
+
+  /*  Adds the given point to the path only if it is farther than marker_path_resolution_ from the last stored one
+   *  (decimation by distance), then drops the points older than marker_path_lifetime_ (reproducing the fading effect
+   *  of the oldest samples) and those exceeding marker_path_max_points_. The last point is never dropped.
+   *
+   *  Parameters:
+   *    + point: current position of the agent;
+   *    + stamp: current time;
+   *    + path: bounded path of the agent (its changed flag is set if some point is added or dropped).
+   */
+  void updateMarkerPath(const geometry_msgs::Point &point, const ros::Time &stamp, MarkerPath &path) const;
+
+  /*  Replaces the neighbors of the agent with the given ones and updates the subscriptions to their topics: the
+   *  statistics of the agents hosted by the same SwarmCore are handed over in memory (no subscription required). The
+   *  kept neighbors keep their slot in the received statistics and in the link monitor, while the new ones take the
+   *  slots of the old ones (see StatsMailbox::assign) or the slow path if there is no free slot.
+   *
+   *  Parameters:
+   *    + neighbors: ids of the new neighbors (the agent id itself is discarded).
+   *  Other methods called:
+   *    + getAgentTopic
+   */
+  void updateNeighbors(const std::set<int> &neighbors);
+
+  /*  Adds the time elapsed from the given instant to the histogram of the given stage, if timing is enabled.
+   *
+   *  Parameters:
+   *    + stage: index of the stage (see TIMING_* defines);
+   *    + start: instant of the beginning of the stage.
+   *  Return value:
+   *    + current instant (i.e. the beginning of the following stage).
+   */
+  std::chrono::steady_clock::time_point updateTiming(const int &stage, const std::chrono::steady_clock::time_point &start);
+
   /*  Computes the proper TDMA slot based on the given deadline and sleeps the thread until it has been reached.
-   *  To achieve this it rounds to the current exact decisecond (hhmmss:x00) and adds the given deadline expressed in
-   *  seconds, which could be based on the agent id (e.g. agent N speaks in the N+1th slot). The first slot is used
-   *  for the algorithm computation by all the robots simultaneously; this ensures that all the agents use the same
-   *  shared estimations.
+   *  To achieve this it rounds to the beginning of the current TDMA frame (frame_tdma_ dependent, counted from the
+   *  common start given by the Ground Station, if any, which is also the first frame waited for) and adds the given
+   *  deadline expressed in seconds. It is used only once, to synchronize the algorithm timer with the TDMA frames.
    *
    *  Parameters:
-   *    + deadline: time expressed in seconds to be added to the current time rounded to hhmmss:x00.
+   *    + deadline: time expressed in seconds to be added to the beginning of the current TDMA frame.
    */
   void waitForSlotTDMA(const double &deadline) const;
 };
 
+template <typename T>
+void AgentCore::getParam(const std::string &name, T &value, const T &default_value) const {
+  if (headless_) {
+    auto param = headless_parameters_.find(name);
+    value = default_value;
+    if (param != headless_parameters_.end() && !getParamValue(param->second, value)) {
+      CONSOLE_STREAM(WARN, "Wrong type for param " << name << " (default value is used).");
+    }
+    return;
+  }
+
+  std::string key;
+  if (hosted_ && private_node_handle_->searchParam(name, key)) {
+    private_node_handle_->param(key, value, default_value);
+    return;
+  }
+  private_node_handle_->param(name, value, default_value);
+}
+
+template <typename T>
+bool AgentCore::getParamValue(XmlRpc::XmlRpcValue param, std::vector<T> &value) const {
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+    return false;
+  }
+  std::vector<T> values(param.size());
+  for (int i = 0; i < param.size(); i++) {
+    if (!getParamValue(param[i], values.at(i))) {
+      return false;
+    }
+  }
+  value = values;
+  return true;
+}
+
 #endif
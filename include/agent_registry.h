@@ -0,0 +1,177 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_AGENT_REGISTRY_H
+#define GUARD_AGENT_REGISTRY_H
+
+#include <algorithm>
+#include <vector>
+
+/*  This class purpose is to keep track of the agents which are currently connected (e.g. those whose statistics have
+ *  been received recently) with constant time membership and updates: there is an entry for each agent id, up to a
+ *  given max id (the memory is bounded by the max id, not by the number of messages or of rejoins), which stores the
+ *  last time the agent has been seen and its position in the dense list of the connected agents. The agents which
+ *  have not been seen for longer than a given timeout are evicted from the list (swapped with the last one), and
+ *  they join again as soon as they are seen.
+ *
+ *  It is header-only and has no ROS dependency. It is not thread safe.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class AgentRegistry {
+ public:
+  AgentRegistry();
+
+  /*  Evicts the connected agents which have not been seen for longer than the given timeout.
+   *
+   *  Parameters:
+   *    + now: current time in seconds;
+   *    + timeout: max time in seconds since an agent has been seen (0 means that agents are never evicted);
+   *    + evicted: ids of the evicted agents passed by reference (they are appended).
+   */
+  void evict(const double &now, const double &timeout, std::vector<int> &evicted);
+
+  /*  Returns the ids of the connected agents (in no particular order, which changes on eviction).
+   *
+   *  Return value:
+   *    + ids of the connected agents.
+   */
+  const std::vector<int>& getIds() const;
+
+  /*  Returns the last time the given agent has been seen.
+   *
+   *  Parameters:
+   *    + id: id of the agent.
+   *  Return value:
+   *    + time in seconds (negative if the agent has never been seen).
+   */
+  double getLastSeen(const int &id) const;
+
+  /*  Returns the number of connected agents.
+   *
+   *  Return value:
+   *    + number of connected agents.
+   */
+  int getNumberOfAgents() const;
+
+  /*  Checks whether the given agent is connected.
+   *
+   *  Parameters:
+   *    + id: id of the agent.
+   *  Return value:
+   *    + true if the agent is connected.
+   */
+  bool isConnected(const int &id) const;
+
+  /*  Preallocates the entries for the agent ids in range [0, capacity) and sets the max id of the agents accepted,
+   *  discarding all the previous agents.
+   *
+   *  Parameters:
+   *    + capacity: number of preallocated entries;
+   *    + max_id: max id of the agents (the entries beyond the capacity are allocated on demand).
+   */
+  void reserve(const int &capacity, const int &max_id);
+
+  /*  Marks the given agent as seen at the given time, connecting it if needed.
+   *
+   *  Parameters:
+   *    + id: id of the agent (the agents out of range [0, max_id] are discarded);
+   *    + now: current time in seconds.
+   *  Return value:
+   *    + true if the agent has just (re)joined.
+   */
+  bool update(const int &id, const double &now);
+
+ private:
+  struct Entry {
+    double last_seen;  // negative if never seen
+    int index;  // position in ids_ (negative if not connected)
+  };
+
+  std::vector<Entry> entries_;  // indexed by agent id
+  std::vector<int> ids_;  // connected agents
+  int max_id_;
+};
+
+inline AgentRegistry::AgentRegistry() {
+  reserve(0, 0);
+}
+
+inline void AgentRegistry::evict(const double &now, const double &timeout, std::vector<int> &evicted) {
+  if (timeout <= 0) {
+    return;
+  }
+  for (std::size_t i = 0; i < ids_.size(); ) {
+    Entry &entry = entries_.at(ids_.at(i));
+    if (now - entry.last_seen <= timeout) {
+      i++;
+      continue;
+    }
+    evicted.push_back(ids_.at(i));
+    entry.index = -1;
+    // the last connected agent takes the place of the evicted one (it is checked in the same iteration)
+    ids_.at(i) = ids_.back();
+    ids_.pop_back();
+    if (i < ids_.size()) {
+      entries_.at(ids_.at(i)).index = i;
+    }
+  }
+}
+
+inline const std::vector<int>& AgentRegistry::getIds() const {
+  return ids_;
+}
+
+inline double AgentRegistry::getLastSeen(const int &id) const {
+  if (id < 0 || id >= (int)entries_.size()) {
+    return -1;
+  }
+  return entries_.at(id).last_seen;
+}
+
+inline int AgentRegistry::getNumberOfAgents() const {
+  return ids_.size();
+}
+
+inline bool AgentRegistry::isConnected(const int &id) const {
+  return id >= 0 && id < (int)entries_.size() && entries_.at(id).index >= 0;
+}
+
+inline void AgentRegistry::reserve(const int &capacity, const int &max_id) {
+  Entry empty = {-1, -1};
+  entries_.assign(std::max(capacity, 0), empty);
+  ids_.clear();
+  ids_.reserve(std::max(capacity, 0));
+  max_id_ = max_id;
+}
+
+inline bool AgentRegistry::update(const int &id, const double &now) {
+  if (id < 0 || id > max_id_) {
+    return false;
+  }
+  if (id >= (int)entries_.size()) {
+    Entry empty = {-1, -1};
+    entries_.resize(id + 1, empty);
+  }
+
+  Entry &entry = entries_.at(id);
+  entry.last_seen = std::max(entry.last_seen, now);
+  if (entry.index >= 0) {
+    return false;
+  }
+  entry.index = ids_.size();
+  ids_.push_back(id);
+  return true;
+}
+
+#endif
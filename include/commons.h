@@ -21,13 +21,17 @@
 #include <sstream>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <map>
+#include <set>
 #include <random>
 #include <algorithm>
+#include <cctype>
 #include <mutex>
 // ROS libraries
 #include <ros/ros.h>
 #include <ros/time.h>
+#include <ros/callback_queue.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Pose.h>
 #include <angles/angles.h>
@@ -37,29 +41,45 @@
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
 #include <tf/transform_datatypes.h>
+#include <tf2_msgs/TFMessage.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <visualization_msgs/Marker.h>
 #include <interactive_markers/interactive_marker_server.h>
-// auto-generated from ./msg directory libraries
+// auto-generated from ./msg and ./srv directories libraries
 #include <formation_control/FormationStatistics.h>
 #include <formation_control/FormationStatisticsStamped.h>
+#include <formation_control/FormationStatisticsArray.h>
+#include <formation_control/FormationStatisticsCompact.h>
+#include <formation_control/FormationStatisticsPredicted.h>
+#include <formation_control/AgentNeighbors.h>
+#include <formation_control/SyncAgent.h>
 
 // license info to be displayed at the beginning
 #define LICENSE_INFO "\n*\n* Copyright (C) 2015 Alessandro Tondo\n* This program comes with ABSOLUTELY NO WARRANTY.\n* This is free software, and you are welcome to\n* redistribute it under GNU GPL v3.0 conditions.\n* (for details see <http://www.gnu.org/licenses/>).\n*\n\n"
 // default values for ROS params (if not specified by the user) for both AgentCore and GroundStationCore classes
 #define DEFAULT_SAMPLE_TIME 0.1  // expressed in seconds
-#define DEFAULT_SLOT_TDMA 0.01  // duration of each tdma slot (expressed in seconds)
 #define DEFAULT_NUMBER_OF_AGENTS 9
 #define DEFAULT_NUMBER_OF_STATS 5  // see FormationStatistics.msg (mx, my, mxx, mxy, myy)
 #define DEFAULT_NUMBER_OF_VELOCITIES 2  // virtual planar linear twist (virtual_x_dot, virutal_y_dot)
 #define DEFAULT_VERBOSITY_LEVEL 1
 #define DEFAULT_TOPIC_QUEUE_LENGTH 1
 #define DEFAULT_SHARED_STATS_TOPIC "shared_stats"
+#define DEFAULT_SHARED_STATS_ARRAY_TOPIC "shared_stats_array"
+#define DEFAULT_SHARED_STATS_COMPACT_TOPIC "shared_stats_compact"
+#define DEFAULT_SHARED_STATS_PREDICTED_TOPIC "shared_stats_predicted"
+#define DEFAULT_COMPACT_RESOLUTION 1e-4  // quantization step of the compact statistics (see CompactCodec)
 #define DEFAULT_TARGET_STATS_TOPIC "target_stats"
+#define DEFAULT_NEIGHBORS_TOPIC "agent_neighbors"
+#define DEFAULT_COMMUNICATION_TOPOLOGY "all"  // "all", "ring", "adjacency" or "knn"
+#define DEFAULT_NUMBER_OF_NEIGHBORS 2  // used only by "ring" and "knn" topologies
 #define DEFAULT_AGENT_POSES_TOPIC "agent_poses"
 #define DEFAULT_MATLAB_POSES_TOPIC "matlab_poses"
 #define DEFAULT_MARKER_TOPIC "visualization_marker"
+#define DEFAULT_TF_RATE 0.0  // expressed in hertz (0 means once every sample time)
+#define DEFAULT_DIAGNOSTICS_TOPIC "/diagnostics"
+#define DEFAULT_DIAGNOSTICS_RATE 1.0  // expressed in hertz (0 means disabled)
 #define DEFAULT_SYNC_SERVICE "sync_agent"
-#define DEFAULT_SYNC_DELAY 5.0  // expressed in seconds
+#define DEFAULT_SYNC_DELAY 5.0  // expressed in seconds (from the first agent request to the common start)
 #define DEFAULT_FRAME_MAP "map"
 #define DEFAULT_FRAME_AGENT_PREFIX "agent_"
 #define DEFAULT_FRAME_EFFECTIVE_PREFIX "effective_stats"
@@ -76,5 +96,25 @@
 #define DEBUG_VV 3
 #define DEBUG_VVV 4
 #define DEBUG_VVVV 5
+// debug messages more verbose than this level are removed at compile time (the most verbose ones in release builds)
+#ifndef CONSOLE_MAX_VERBOSITY_LEVEL
+#ifdef NDEBUG
+#define CONSOLE_MAX_VERBOSITY_LEVEL DEBUG_VVV
+#else
+#define CONSOLE_MAX_VERBOSITY_LEVEL DEBUG_VVVV
+#endif
+#endif
+// displays a message with a specific log level, using the proper ROS MACRO and the consolePrefix of the calling class;
+// the message is formatted only if its level is enabled (both by the class verbosity level, checked through the
+// isConsoleEnabled method, and by the rosconsole configuration), thus disabled messages cost just a comparison
+#define CONSOLE_STREAM(log_level, message) \
+  do { \
+    if ((log_level) <= CONSOLE_MAX_VERBOSITY_LEVEL && isConsoleEnabled(log_level)) { \
+      if ((log_level) < WARN) { ROS_ERROR_STREAM(consolePrefix(__func__) << message); } \
+      else if ((log_level) == WARN) { ROS_WARN_STREAM(consolePrefix(__func__) << message); } \
+      else if ((log_level) == INFO) { ROS_INFO_STREAM(consolePrefix(__func__) << message); } \
+      else { ROS_DEBUG_STREAM(consolePrefix(__func__) << message); } \
+    } \
+  } while (0)
 
 #endif
@@ -0,0 +1,163 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_COMPACT_CODEC_H
+#define GUARD_COMPACT_CODEC_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <ros/time.h>
+// auto-generated from ./msg directory libraries
+#include <formation_control/FormationStatisticsStamped.h>
+#include <formation_control/FormationStatisticsCompact.h>
+
+/*  This class purpose is to convert the shared statistics from and to the compact wire format (see the
+ *  FormationStatisticsCompact message), which takes 25 bytes instead of the about 75 of a FormationStatisticsStamped
+ *  (header with sequence, full stamp and frame id string, 32-bit agent id and five 64-bit moments).
+ *
+ *  Each moment is divided by the resolution and rounded to a 32-bit integer, thus the dequantization error of each
+ *  moment is at most resolution/2 and the error of the whole statistics vector is at most sqrt(5)*resolution/2 (see
+ *  getMaxError), e.g. about 1.1e-4 with the default resolution of 1e-4, which is more than two orders of magnitude
+ *  below the default convergence tolerance of the simulation (0.05). On the other hand, the moments must be smaller
+ *  than 2^31*resolution (e.g. about 2e5 m^2 with the default resolution) and the agent ids must be in range [0, 255].
+ *  The consensus sees the quantization error as a bounded disturbance on the received estimates.
+ *
+ *  The stamp is sent in milliseconds modulo 2^32 and rebuilt by the receiver as the closest time to its own clock,
+ *  which is correct while the clocks of the sender and the receiver differ by less than about 24 days.
+ *
+ *  It is header-only and has no ROS dependency other than the ROS time and the statistics messages.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class CompactCodec {
+ public:
+  static const int MAX_AGENT_ID = 255;
+  static const int NUMBER_OF_STATS = 5;  // see FormationStatistics.msg (mx, my, mxx, mxy, myy)
+
+  CompactCodec();
+
+  /*  Converts the given compact statistics in the full message, rebuilding the stamp and the frame id.
+   *
+   *  Parameters:
+   *    + compact: compact statistics received;
+   *    + now: current time of the receiver.
+   *  Return value:
+   *    + estimated statistics with header and agent id.
+   */
+  formation_control::FormationStatisticsStamped decode(const formation_control::FormationStatisticsCompact &compact,
+                                                       const ros::Time &now) const;
+
+  /*  Converts the given statistics in the compact message.
+   *
+   *  Parameters:
+   *    + msg: estimated statistics with header and agent id;
+   *    + compact: compact statistics passed by reference.
+   *  Return value:
+   *    + false if the agent id or some moment can't be encoded (the compact statistics are not valid).
+   */
+  bool encode(const formation_control::FormationStatisticsStamped &msg,
+              formation_control::FormationStatisticsCompact &compact) const;
+
+  /*  Returns the upper bound of the euclidean norm of the dequantization error of the statistics vector.
+   *
+   *  Return value:
+   *    + sqrt(5)*resolution/2.
+   */
+  double getMaxError() const;
+
+  /*  Checks whether the given agent id can be encoded in the compact statistics (every node which sends or receives
+   *  them should check the highest expected id on startup, instead of dropping the statistics later).
+   *
+   *  Parameters:
+   *    + agent_id: id of the agent.
+   *  Return value:
+   *    + true if the agent id is in range [0, MAX_AGENT_ID].
+   */
+  static bool isValidAgentId(const int &agent_id);
+
+  /*  Sets the resolution of the moments and the names used to rebuild the frame ids.
+   *
+   *  Parameters:
+   *    + resolution: quantization step of each moment (in meters or squared meters);
+   *    + frame_agent_prefix: prefix of the agent frames (followed by the agent id);
+   *    + frame_virtual_suffix: suffix of the virtual agent frames.
+   */
+  void setup(const double &resolution, const std::string &frame_agent_prefix, const std::string &frame_virtual_suffix);
+
+ private:
+  double resolution_;
+  std::string frame_agent_prefix_;
+  std::string frame_virtual_suffix_;
+};
+
+inline CompactCodec::CompactCodec() {
+  resolution_ = 1e-4;
+}
+
+inline formation_control::FormationStatisticsStamped CompactCodec::decode(
+    const formation_control::FormationStatisticsCompact &compact, const ros::Time &now) const {
+  formation_control::FormationStatisticsStamped msg;
+  msg.agent_id = compact.agent_id;
+  msg.header.frame_id = frame_agent_prefix_ + std::to_string(msg.agent_id) + frame_virtual_suffix_;
+
+  // the difference modulo 2^32 is read as signed (the sender stamp can be slightly ahead of the receiver clock)
+  int64_t now_ms = static_cast<int64_t>(std::floor(now.toSec()*1e3));
+  int32_t age_ms = static_cast<int32_t>(static_cast<uint32_t>(now_ms) - compact.stamp_ms);
+  msg.header.stamp.fromSec(std::max((now_ms - age_ms)*1e-3, 0.0));
+
+  msg.stats.m_x = compact.stats[0]*resolution_;
+  msg.stats.m_y = compact.stats[1]*resolution_;
+  msg.stats.m_xx = compact.stats[2]*resolution_;
+  msg.stats.m_xy = compact.stats[3]*resolution_;
+  msg.stats.m_yy = compact.stats[4]*resolution_;
+  return msg;
+}
+
+inline bool CompactCodec::encode(const formation_control::FormationStatisticsStamped &msg,
+                                 formation_control::FormationStatisticsCompact &compact) const {
+  if (!isValidAgentId(msg.agent_id)) {
+    return false;
+  }
+  compact.agent_id = msg.agent_id;
+  compact.stamp_ms = static_cast<uint32_t>(static_cast<int64_t>(std::floor(msg.header.stamp.toSec()*1e3)));
+
+  const double values[NUMBER_OF_STATS] = {msg.stats.m_x, msg.stats.m_y, msg.stats.m_xx, msg.stats.m_xy, msg.stats.m_yy};
+  for (int s = 0; s < NUMBER_OF_STATS; s++) {
+    double quantized = std::round(values[s]/resolution_);
+    if (!(std::abs(quantized) <= std::numeric_limits<int32_t>::max())) {
+      return false;  // also nan
+    }
+    compact.stats[s] = static_cast<int32_t>(quantized);
+  }
+  return true;
+}
+
+inline double CompactCodec::getMaxError() const {
+  return std::sqrt(5.0)*resolution_/2;
+}
+
+inline bool CompactCodec::isValidAgentId(const int &agent_id) {
+  return agent_id >= 0 && agent_id <= MAX_AGENT_ID;
+}
+
+inline void CompactCodec::setup(const double &resolution, const std::string &frame_agent_prefix,
+                                const std::string &frame_virtual_suffix) {
+  resolution_ = (resolution > 0) ? resolution : 1e-4;
+  frame_agent_prefix_ = frame_agent_prefix;
+  frame_virtual_suffix_ = frame_virtual_suffix;
+}
+
+#endif
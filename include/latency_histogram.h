@@ -0,0 +1,186 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_LATENCY_HISTOGRAM_H
+#define GUARD_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+/*  This class purpose is to collect the distribution of a duration (e.g. the computation time of a stage of the
+ *  algorithm or the jitter of a timer) with a negligible overhead, so that it can be left enabled in the real loop.
+ *  The samples are counted in a fixed number of buckets with power-of-two bounds in microseconds (from 1us to about
+ *  16s, the last bucket holds all the longer samples), thus the percentiles are approximated by the upper bound of
+ *  their bucket (i.e. at most twice the real value), while count, mean and max are exact.
+ *
+ *  Samples can be added by many threads at the same time without locks (the counters are relaxed atomics), and they
+ *  can be read while they are added (the reader could see a sample in the count and not yet in its bucket).
+ *
+ *  It is header-only and has no ROS dependency.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class LatencyHistogram {
+ public:
+  static const int NUMBER_OF_BUCKETS = 25;  // bucket b holds the samples in [2^(b-1), 2^b) microseconds
+
+  LatencyHistogram();
+
+  /*  Adds the given sample to the histogram (negative values are counted as null, e.g. a timer which fires early).
+   *
+   *  Parameters:
+   *    + seconds: duration of the sample expressed in seconds.
+   */
+  void add(const double &seconds);
+
+  /*  Adds the time elapsed from the given instant to now (see now).
+   *
+   *  Parameters:
+   *    + start: instant returned by the now method at the beginning of the measured interval.
+   *  Other methods called:
+   *    + add
+   */
+  void addSince(const std::chrono::steady_clock::time_point &start);
+
+  /*  Returns the number of samples added.
+   *
+   *  Return value:
+   *    + number of samples.
+   */
+  unsigned long getCount() const;
+
+  /*  Returns the longest sample added.
+   *
+   *  Return value:
+   *    + max duration expressed in seconds (0 if empty).
+   */
+  double getMax() const;
+
+  /*  Returns the average of the samples added.
+   *
+   *  Return value:
+   *    + mean duration expressed in seconds (0 if empty).
+   */
+  double getMean() const;
+
+  /*  Returns the upper bound of the bucket which holds the given percentile of the samples.
+   *
+   *  Parameters:
+   *    + percentile: value in range [0, 1] (e.g. 0.99).
+   *  Return value:
+   *    + approximated percentile expressed in seconds (0 if empty).
+   */
+  double getPercentile(const double &percentile) const;
+
+  /*  Returns the current instant of the steady clock, which is the reference of addSince.
+   *
+   *  Return value:
+   *    + current instant.
+   */
+  static std::chrono::steady_clock::time_point now();
+
+  /*  Discards all the samples added.
+   */
+  void reset();
+
+  /*  Returns a short summary of the histogram (count, mean, p50, p99 and max in milliseconds).
+   *
+   *  Return value:
+   *    + human readable summary.
+   */
+  std::string toString() const;
+
+ private:
+  std::atomic<unsigned long> buckets_[NUMBER_OF_BUCKETS];
+  std::atomic<unsigned long> count_;
+  std::atomic<unsigned long long> sum_us_;
+  std::atomic<unsigned long long> max_us_;
+};
+
+inline LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+inline void LatencyHistogram::add(const double &seconds) {
+  unsigned long long us = (seconds > 0) ? static_cast<unsigned long long>(seconds*1e6) : 0;
+  int bucket = 0;
+  while (bucket < NUMBER_OF_BUCKETS - 1 && (1ULL << bucket) <= us) {
+    bucket++;
+  }
+
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_us_.fetch_add(us, std::memory_order_relaxed);
+  unsigned long long max_us = max_us_.load(std::memory_order_relaxed);
+  while (us > max_us && !max_us_.compare_exchange_weak(max_us, us, std::memory_order_relaxed)) {}
+}
+
+inline void LatencyHistogram::addSince(const std::chrono::steady_clock::time_point &start) {
+  add(std::chrono::duration<double>(now() - start).count());
+}
+
+inline unsigned long LatencyHistogram::getCount() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+inline double LatencyHistogram::getMax() const {
+  return max_us_.load(std::memory_order_relaxed)*1e-6;
+}
+
+inline double LatencyHistogram::getMean() const {
+  unsigned long count = getCount();
+  return (count > 0) ? sum_us_.load(std::memory_order_relaxed)*1e-6/count : 0;
+}
+
+inline double LatencyHistogram::getPercentile(const double &percentile) const {
+  unsigned long count = getCount();
+  if (count == 0) {
+    return 0;
+  }
+
+  unsigned long threshold = std::ceil(std::min(std::max(percentile, 0.0), 1.0)*count);
+  unsigned long cumulated = 0;
+  for (int bucket = 0; bucket < NUMBER_OF_BUCKETS - 1; bucket++) {
+    cumulated += buckets_[bucket].load(std::memory_order_relaxed);
+    if (cumulated >= threshold) {
+      return std::min((1ULL << bucket)*1e-6, getMax());
+    }
+  }
+  return getMax();
+}
+
+inline std::chrono::steady_clock::time_point LatencyHistogram::now() {
+  return std::chrono::steady_clock::now();
+}
+
+inline void LatencyHistogram::reset() {
+  for (int bucket = 0; bucket < NUMBER_OF_BUCKETS; bucket++) {
+    buckets_[bucket].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_us_.store(0, std::memory_order_relaxed);
+  max_us_.store(0, std::memory_order_relaxed);
+}
+
+inline std::string LatencyHistogram::toString() const {
+  std::stringstream s;
+  s << "count " << getCount() << ", mean " << getMean()*1e3 << "ms, p50 " << getPercentile(0.5)*1e3 << "ms, p99 "
+    << getPercentile(0.99)*1e3 << "ms, max " << getMax()*1e3 << "ms";
+  return s.str();
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_LINK_MONITOR_H
+#define GUARD_LINK_MONITOR_H
+
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include "latency_histogram.h"
+#include "tdma_schedule.h"
+
+/*  This class purpose is to measure the quality of the links from each sender of the shared statistics: for every
+ *  received message it takes the time from its header stamp to its reception (end-to-end latency, meaningful only if
+ *  the clocks of the sender and the receiver are synchronized), the deviation of the time between two consecutive
+ *  arrivals from the sample time (inter-arrival jitter) and whether the message has arrived outside the TDMA slot of
+ *  its sender (the same slot computed by the AgentCore, see TdmaSchedule: the first slot of each frame is reserved for
+ *  the computation and the agent N speaks in the N+1th one, wrapped around if the agents exceed the slots).
+ *  Out-of-slot arrivals are those which could collide with the transmissions of other agents, thus they help to
+ *  choose slot_tdma.
+ *
+ *  As the StatsMailbox, there is a preallocated entry for each sender (from 0 to the given capacity), assigned to its
+ *  id (by default the entry index is the id itself, otherwise the owner assigns the entries to the current neighbors),
+ *  and the messages can be added by many threads at the same time without locks, while the senders beyond the
+ *  capacity (or without an entry) are only counted.
+ *
+ *  It is header-only and has no ROS dependency other than the DiagnosticStatus message.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class LinkMonitor {
+ public:
+  LinkMonitor();
+
+  /*  Adds a message received from the given sender.
+   *
+   *  Parameters:
+   *    + index: index of the entry assigned to the sender (see assign);
+   *    + id: id of the sender;
+   *    + sent: header stamp of the message in seconds;
+   *    + received: time of reception in seconds;
+   *    + slot_check: whether the message is expected in the TDMA slot of the sender (e.g. false for the statistics
+   *      aggregated by another node).
+   */
+  void add(const int &index, const int &id, const double &sent, const double &received, const bool &slot_check);
+
+  /*  Assigns the given entry to the given sender, discarding the measures of its previous owner. It can be called
+   *  while other threads add messages (the measures of the new sender could include a message of the previous one).
+   *
+   *  Parameters:
+   *    + index: index of the entry in range [0, capacity);
+   *    + id: id of the sender (-1 frees the entry).
+   */
+  void assign(const int &index, const int &id);
+
+  /*  Returns a diagnostic status with the latency and jitter summaries (see LatencyHistogram) and the out-of-slot
+   *  arrivals of each sender ever received.
+   *
+   *  Parameters:
+   *    + name: name of the diagnostic status;
+   *    + hardware_id: hardware id of the diagnostic status;
+   *    + agent_prefix: prefix of the keys of each sender (followed by its id).
+   *  Return value:
+   *    + diagnostic status (its level is always OK).
+   */
+  diagnostic_msgs::DiagnosticStatus getStatus(const std::string &name, const std::string &hardware_id,
+                                              const std::string &agent_prefix) const;
+
+  /*  Preallocates the entries in range [0, capacity), each one assigned to the sender id equal to its index, and
+   *  discards all the previous measures. It is not thread safe (it has to be called before any other method).
+   *
+   *  Parameters:
+   *    + capacity: number of preallocated entries;
+   *    + sample_time: expected time between two consecutive messages of the same sender in seconds;
+   *    + frame_tdma: length of the TDMA frame in seconds;
+   *    + slot_tdma: length of a TDMA slot in seconds.
+   */
+  void reserve(const int &capacity, const double &sample_time, const double &frame_tdma, const double &slot_tdma);
+
+ private:
+  struct Entry {
+    Entry() : id(-1), arrivals(0), out_of_slot(0), last_arrival(0) {}
+    std::atomic<int> id;  // sender which owns the entry (-1 if free)
+    LatencyHistogram latency;
+    LatencyHistogram jitter;
+    std::atomic<unsigned long> arrivals;
+    std::atomic<unsigned long> out_of_slot;
+    std::atomic<double> last_arrival;
+  };
+
+  std::vector<Entry> entries_;
+  std::atomic<unsigned long> unknown_arrivals_;  // from the senders without an entry
+  double sample_time_;
+  double frame_tdma_;
+  double slot_tdma_;
+  int number_of_slots_;
+};
+
+inline LinkMonitor::LinkMonitor() {
+  reserve(0, 0, 0, 0);
+}
+
+inline void LinkMonitor::add(const int &index, const int &id, const double &sent, const double &received,
+                             const bool &slot_check) {
+  if (index < 0 || index >= (int)entries_.size() || entries_[index].id != id) {
+    unknown_arrivals_++;
+    return;
+  }
+
+  Entry &entry = entries_[index];
+  entry.latency.add(received - sent);
+  double last_arrival = entry.last_arrival.exchange(received);
+  if (entry.arrivals++ > 0) {
+    entry.jitter.add(std::abs(received - last_arrival - sample_time_));
+  }
+
+  if (slot_check && number_of_slots_ >= 2 && id > 0) {
+    double slot_begin = TdmaSchedule::getSlot(id, number_of_slots_)*slot_tdma_;
+    double offset = received - std::floor(received/frame_tdma_)*frame_tdma_;
+    if (offset < slot_begin || offset >= slot_begin + slot_tdma_) {
+      entry.out_of_slot++;
+    }
+  }
+}
+
+inline void LinkMonitor::assign(const int &index, const int &id) {
+  if (index < 0 || index >= (int)entries_.size()) {
+    return;
+  }
+
+  Entry &entry = entries_[index];
+  entry.id = -1;  // the messages of the previous sender are no longer added
+  entry.latency.reset();
+  entry.jitter.reset();
+  entry.arrivals = 0;
+  entry.out_of_slot = 0;
+  entry.last_arrival = 0;
+  entry.id = id;
+}
+
+inline diagnostic_msgs::DiagnosticStatus LinkMonitor::getStatus(const std::string &name, const std::string &hardware_id,
+                                                                const std::string &agent_prefix) const {
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = name;
+  status.hardware_id = hardware_id;
+
+  unsigned long arrivals = 0;
+  unsigned long out_of_slot = 0;
+  for (auto const &entry : entries_) {
+    int id = entry.id;
+    if (id < 0 || entry.arrivals == 0) {
+      continue;
+    }
+    std::string prefix = agent_prefix + std::to_string(id);
+    diagnostic_msgs::KeyValue value;
+    value.key = prefix + "_latency";
+    value.value = entry.latency.toString();
+    status.values.push_back(value);
+    value.key = prefix + "_jitter";
+    value.value = entry.jitter.toString();
+    status.values.push_back(value);
+    value.key = prefix + "_out_of_slot";
+    value.value = std::to_string(entry.out_of_slot) + " of " + std::to_string(entry.arrivals);
+    status.values.push_back(value);
+    arrivals += entry.arrivals;
+    out_of_slot += entry.out_of_slot;
+  }
+
+  status.message = std::to_string(out_of_slot) + " of " + std::to_string(arrivals) + " messages out of the TDMA slot"
+                   + (unknown_arrivals_ > 0 ? ", " + std::to_string(unknown_arrivals_) + " from unknown agents" : "");
+  return status;
+}
+
+inline void LinkMonitor::reserve(const int &capacity, const double &sample_time, const double &frame_tdma,
+                                 const double &slot_tdma) {
+  entries_ = std::vector<Entry>(capacity);
+  for (int index = 0; index < capacity; index++) {
+    entries_[index].id = index;
+  }
+  unknown_arrivals_ = 0;
+  sample_time_ = sample_time;
+  frame_tdma_ = frame_tdma;
+  slot_tdma_ = slot_tdma;
+  number_of_slots_ = TdmaSchedule::getNumberOfSlots(frame_tdma_, slot_tdma_);
+}
+
+#endif
@@ -0,0 +1,292 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_MAPPED_RECORDER_H
+#define GUARD_MAPPED_RECORDER_H
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*  This class purpose is to record a stream of fixed size records (e.g. one for each algorithm step) in an append-only
+ *  binary file with the lowest overhead as possible, and to read them back: the file is memory-mapped, thus appending
+ *  a record is a plain copy into the mapping (no system call and no buffering), and it is grown by doubling its
+ *  capacity only once in a while. The number of records is updated in the file on each append, thus the already
+ *  appended records survive the crash of the process (the kernel flushes the mapping anyway). When closed, the file is
+ *  truncated to the appended records only.
+ *
+ *  The file starts with a small prefix (magic, sizes of the header and of the records, number of records), followed
+ *  by the given header (e.g. the settings of the recorded process) and by the records. The header and the records
+ *  must be plain structures (no pointers, copied byte by byte), thus a file can be read only by a build with the same
+ *  structures on the same architecture (the sizes in the prefix catch most of the mismatches).
+ *
+ *  It is header-only and has no ROS dependency (only POSIX). It is not thread safe.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+template <typename Header, typename Record>
+class MappedRecorder {
+ public:
+  MappedRecorder();
+  ~MappedRecorder();
+
+  /*  Appends the given record at the end of the file (created in write mode), growing it if needed.
+   *
+   *  Parameters:
+   *    + record: record to be appended.
+   *  Other methods called:
+   *    + close
+   *    + map
+   *  Return value:
+   *    + false if the file is not writable or it can't be grown.
+   */
+  bool append(const Record &record);
+
+  /*  Closes the file (in write mode it is truncated to the appended records).
+   */
+  void close();
+
+  /*  Creates (or truncates) the given file in write mode and writes the given header.
+   *
+   *  Parameters:
+   *    + path: path of the file;
+   *    + header: header of the file.
+   *  Other methods called:
+   *    + close
+   *    + map
+   *  Return value:
+   *    + false if the file can't be created.
+   */
+  bool create(const std::string &path, const Header &header);
+
+  /*  Returns the header of the open file.
+   *
+   *  Return value:
+   *    + header of the file.
+   */
+  const Header& getHeader() const;
+
+  /*  Returns the number of records of the open file.
+   *
+   *  Return value:
+   *    + number of records.
+   */
+  std::size_t getNumberOfRecords() const;
+
+  /*  Returns the given record of the open file.
+   *
+   *  Parameters:
+   *    + index: index of the record (lower than getNumberOfRecords).
+   *  Return value:
+   *    + the record (it is valid until the file is grown or closed).
+   */
+  const Record& getRecord(const std::size_t &index) const;
+
+  /*  Checks whether a file is open.
+   *
+   *  Return value:
+   *    + true if a file is open.
+   */
+  bool isOpen() const;
+
+  /*  Opens the given file in read-only mode, checking the magic and the sizes of the header and of the records.
+   *
+   *  Parameters:
+   *    + path: path of the file.
+   *  Other methods called:
+   *    + close
+   *    + map
+   *  Return value:
+   *    + false if the file can't be opened or it is not compatible.
+   */
+  bool load(const std::string &path);
+
+ private:
+  struct Prefix {
+    char magic[8];
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t number_of_records;
+  };
+
+  static const std::size_t INITIAL_CAPACITY = 4096;  // records
+
+  int file_;
+  char *data_;
+  std::size_t mapped_size_;
+  std::size_t number_of_records_;  // same as the prefix of the file (also when the mapping has been lost)
+  bool writable_;
+
+  /*  Maps the given size of the open file (the previous mapping is released).
+   *
+   *  Parameters:
+   *    + size: size of the mapping in bytes.
+   *  Return value:
+   *    + false if the file can't be mapped.
+   */
+  bool map(const std::size_t &size);
+
+  /*  Returns the offset of the given record in the file.
+   *
+   *  Parameters:
+   *    + index: index of the record.
+   *  Return value:
+   *    + offset in bytes.
+   */
+  static std::size_t offset(const std::size_t &index);
+};
+
+template <typename Header, typename Record>
+MappedRecorder<Header, Record>::MappedRecorder() {
+  file_ = -1;
+  data_ = nullptr;
+  mapped_size_ = 0;
+  number_of_records_ = 0;
+  writable_ = false;
+}
+
+template <typename Header, typename Record>
+MappedRecorder<Header, Record>::~MappedRecorder() {
+  close();
+}
+
+template <typename Header, typename Record>
+bool MappedRecorder<Header, Record>::append(const Record &record) {
+  if (!writable_) {
+    return false;
+  }
+  std::size_t index = number_of_records_;
+  if (offset(index + 1) > mapped_size_) {
+    std::size_t size = offset(2*index);
+    if (::ftruncate(file_, size) != 0 || !map(size)) {
+      close();  // the appended records are kept
+      return false;
+    }
+  }
+  std::memcpy(data_ + offset(index), &record, sizeof(Record));
+  number_of_records_ = index + 1;
+  reinterpret_cast<Prefix*>(data_)->number_of_records = number_of_records_;
+  return true;
+}
+
+template <typename Header, typename Record>
+void MappedRecorder<Header, Record>::close() {
+  if (data_) {
+    ::munmap(data_, mapped_size_);
+  }
+  if (file_ >= 0) {
+    if (writable_ && ::ftruncate(file_, offset(number_of_records_)) != 0) {
+      writable_ = false;  // the trailing unused capacity is ignored when loaded
+    }
+    ::close(file_);
+  }
+  file_ = -1;
+  data_ = nullptr;
+  mapped_size_ = 0;
+  number_of_records_ = 0;
+  writable_ = false;
+}
+
+template <typename Header, typename Record>
+bool MappedRecorder<Header, Record>::create(const std::string &path, const Header &header) {
+  close();
+  file_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  std::size_t size = offset(INITIAL_CAPACITY);
+  if (file_ < 0 || ::ftruncate(file_, size) != 0) {
+    close();
+    return false;
+  }
+  writable_ = true;
+  if (!map(size)) {
+    close();
+    return false;
+  }
+
+  Prefix prefix;
+  std::memcpy(prefix.magic, "FCREC01", 8);
+  prefix.header_size = sizeof(Header);
+  prefix.record_size = sizeof(Record);
+  prefix.number_of_records = 0;
+  std::memcpy(data_, &prefix, sizeof(Prefix));
+  std::memcpy(data_ + sizeof(Prefix), &header, sizeof(Header));
+  return true;
+}
+
+template <typename Header, typename Record>
+const Header& MappedRecorder<Header, Record>::getHeader() const {
+  return *reinterpret_cast<const Header*>(data_ + sizeof(Prefix));
+}
+
+template <typename Header, typename Record>
+std::size_t MappedRecorder<Header, Record>::getNumberOfRecords() const {
+  return number_of_records_;
+}
+
+template <typename Header, typename Record>
+const Record& MappedRecorder<Header, Record>::getRecord(const std::size_t &index) const {
+  return *reinterpret_cast<const Record*>(data_ + offset(index));
+}
+
+template <typename Header, typename Record>
+bool MappedRecorder<Header, Record>::isOpen() const {
+  return data_ != nullptr;
+}
+
+template <typename Header, typename Record>
+bool MappedRecorder<Header, Record>::load(const std::string &path) {
+  close();
+  file_ = ::open(path.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (file_ < 0 || ::fstat(file_, &file_stat) != 0 || (std::size_t)file_stat.st_size < offset(0)
+      || !map(file_stat.st_size)) {
+    close();
+    return false;
+  }
+
+  const Prefix *prefix = reinterpret_cast<const Prefix*>(data_);
+  if (std::memcmp(prefix->magic, "FCREC01", 8) != 0 || prefix->header_size != sizeof(Header)
+      || prefix->record_size != sizeof(Record) || offset(prefix->number_of_records) > mapped_size_) {
+    close();
+    return false;
+  }
+  number_of_records_ = prefix->number_of_records;
+  return true;
+}
+
+template <typename Header, typename Record>
+bool MappedRecorder<Header, Record>::map(const std::size_t &size) {
+  if (data_) {
+    ::munmap(data_, mapped_size_);
+    data_ = nullptr;
+  }
+  int protection = writable_ ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *data = ::mmap(nullptr, size, protection, MAP_SHARED, file_, 0);
+  if (data == MAP_FAILED) {
+    mapped_size_ = 0;
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  mapped_size_ = size;
+  return true;
+}
+
+template <typename Header, typename Record>
+std::size_t MappedRecorder<Header, Record>::offset(const std::size_t &index) {
+  return sizeof(Prefix) + sizeof(Header) + index*sizeof(Record);
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_MOMENTS_ACCUMULATOR_H
+#define GUARD_MOMENTS_ACCUMULATOR_H
+
+#include <cmath>
+// auto-generated from ./msg directory libraries
+#include <formation_control/FormationStatistics.h>
+
+/*  This class purpose is to provide the formation statistics (first and second order momentums) of a group of points
+ *  in the 2D space without recomputing them from scratch every time one of the points moves: the five sums (x, y,
+ *  x^2, xy, y^2) are updated by delta when a point is added, removed or moved, and they are divided by the number of
+ *  points only when the statistics are requested. Each sum uses a compensated (Neumaier) summation to avoid the
+ *  accumulation of rounding errors over long runs, where the same point is added and removed many times.
+ *
+ *  It is header-only and has no ROS dependency other than the FormationStatistics message, thus it can be shared by
+ *  the VisualizationCore, the AgentCore and offline analysis tools.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class MomentsAccumulator {
+ public:
+  MomentsAccumulator();
+
+  /*  Adds the given point to the group.
+   *
+   *  Parameters:
+   *    + x: x coordinate of the point;
+   *    + y: y coordinate of the point.
+   *  Other methods called:
+   *    + accumulate
+   */
+  void add(const double &x, const double &y);
+
+  /*  Removes all the points from the group.
+   */
+  void clear();
+
+  /*  Returns the number of points in the group.
+   *
+   *  Return value:
+   *    + number of points.
+   */
+  int getCount() const;
+
+  /*  Divides the sums by the number of points to retrieve the formation statistics of the group.
+   *
+   *  Return value:
+   *    + formation statistics of the group (all zeros if it is empty).
+   */
+  formation_control::FormationStatistics getStatistics() const;
+
+  /*  Removes the given point from the group (it must have been added before). When the group becomes empty, all the
+   *  sums are reset.
+   *
+   *  Parameters:
+   *    + x: x coordinate of the point;
+   *    + y: y coordinate of the point.
+   *  Other methods called:
+   *    + accumulate
+   *    + clear
+   */
+  void remove(const double &x, const double &y);
+
+  /*  Moves a point of the group from the old position to the new one (i.e. removes the old and adds the new point).
+   *
+   *  Parameters:
+   *    + x_old: previous x coordinate of the point;
+   *    + y_old: previous y coordinate of the point;
+   *    + x_new: current x coordinate of the point;
+   *    + y_new: current y coordinate of the point.
+   *  Other methods called:
+   *    + accumulate
+   */
+  void update(const double &x_old, const double &y_old, const double &x_new, const double &y_new);
+
+ private:
+  static const int NUMBER_OF_SUMS = 5;  // see FormationStatistics.msg (mx, my, mxx, mxy, myy)
+
+  int count_;
+  double sums_[NUMBER_OF_SUMS];
+  double compensations_[NUMBER_OF_SUMS];  // rounding errors of the sums (Neumaier)
+
+  /*  Adds the contribution of the given point, multiplied by the given sign, to each sum.
+   *
+   *  Parameters:
+   *    + x: x coordinate of the point;
+   *    + y: y coordinate of the point;
+   *    + sign: +1 to add the point, -1 to remove it.
+   *  Other methods called:
+   *    + compensatedSum
+   */
+  void accumulate(const double &x, const double &y, const double &sign);
+
+  /*  Adds the given value to the sum following the Neumaier compensated summation: the low order bits lost in the
+   *  sum are stored in the compensation term, which is added back only when the sum is read.
+   *
+   *  Parameters:
+   *    + value: value to be added;
+   *    + sum: running sum passed by reference;
+   *    + compensation: running compensation passed by reference.
+   */
+  void compensatedSum(const double &value, double &sum, double &compensation) const;
+};
+
+inline MomentsAccumulator::MomentsAccumulator() {
+  clear();
+}
+
+inline void MomentsAccumulator::accumulate(const double &x, const double &y, const double &sign) {
+  const double values[NUMBER_OF_SUMS] = {x, y, x*x, x*y, y*y};
+  for (int i = 0; i < NUMBER_OF_SUMS; i++) {
+    compensatedSum(sign*values[i], sums_[i], compensations_[i]);
+  }
+}
+
+inline void MomentsAccumulator::add(const double &x, const double &y) {
+  accumulate(x, y, 1);
+  count_++;
+}
+
+inline void MomentsAccumulator::clear() {
+  count_ = 0;
+  for (int i = 0; i < NUMBER_OF_SUMS; i++) {
+    sums_[i] = 0;
+    compensations_[i] = 0;
+  }
+}
+
+inline void MomentsAccumulator::compensatedSum(const double &value, double &sum, double &compensation) const {
+  double t = sum + value;
+  if (std::abs(sum) >= std::abs(value)) {
+    compensation += (sum - t) + value;
+  }
+  else {
+    compensation += (value - t) + sum;
+  }
+  sum = t;
+}
+
+inline int MomentsAccumulator::getCount() const {
+  return count_;
+}
+
+inline formation_control::FormationStatistics MomentsAccumulator::getStatistics() const {
+  formation_control::FormationStatistics stats;
+  if (count_ <= 0) {
+    return stats;
+  }
+
+  stats.m_x = (sums_[0] + compensations_[0]) / count_;
+  stats.m_y = (sums_[1] + compensations_[1]) / count_;
+  stats.m_xx = (sums_[2] + compensations_[2]) / count_;
+  stats.m_xy = (sums_[3] + compensations_[3]) / count_;
+  stats.m_yy = (sums_[4] + compensations_[4]) / count_;
+  return stats;
+}
+
+inline void MomentsAccumulator::remove(const double &x, const double &y) {
+  accumulate(x, y, -1);
+  if (--count_ <= 0) {
+    clear();  // discards the residual rounding errors
+  }
+}
+
+inline void MomentsAccumulator::update(const double &x_old, const double &y_old, const double &x_new, const double &y_new) {
+  accumulate(x_old, y_old, -1);
+  accumulate(x_new, y_new, 1);
+}
+
+#endif
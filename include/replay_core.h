@@ -0,0 +1,114 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_REPLAY_CORE_H
+#define GUARD_REPLAY_CORE_H
+
+#include <chrono>
+#include "agent_core.h"
+// default values for the replay settings (if not specified by the user)
+#define DEFAULT_REPLAY_REPETITIONS 1
+#define DEFAULT_REPLAY_TOLERANCE 1e-9  // max difference between recorded and replayed outputs
+
+// results of the replay of a single recording
+struct ReplayResults {
+  int agent_id;
+  int steps;
+  int first_divergence;  // first step whose outputs differ by more than the tolerance, negative if none
+  double max_error;  // max difference between recorded and replayed outputs
+  double steps_per_second;  // wall clock
+};
+
+/*  This class purpose is to replay offline the loop of an agent recorded with the record_prefix param (see AgentCore
+ *  and MappedRecorder), e.g. to profile and to diff the hot path of the algorithm on exactly the same inputs of a slow
+ *  or oscillating run. A headless agent is created with the recorded gains and initial pose, then each recorded step
+ *  is fed to it (time, target statistics and consensus inputs, see AgentCore::replayStep) as fast as the CPU allows,
+ *  without ROS master nor timers. The replayed outputs (estimate, commands and poses) are compared with the recorded
+ *  ones: they match exactly with the same build, unless the recorded agent ran the guidance on its own timer (see
+ *  guidance_sample_time param), while a different build shows where its outputs diverge.
+ *
+ *  The recording can be replayed many times in a row (e.g. for a profiler), the outputs are compared only the first
+ *  time.
+ *
+ *  For more info on this class usage, check the README.md in the package folder.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class ReplayCore {
+ public:
+  /*  The constructor maps the given recording and retrieves the params of the recorded agent from its header.
+   *
+   *  Parameters:
+   *    + path: path of the recording;
+   *    + verbosity_level: verbosity level of this class and of the replayed agent.
+   */
+  ReplayCore(const std::string &path, const int &verbosity_level);
+
+  /*  Checks whether the recording has been loaded.
+   *
+   *  Return value:
+   *    + true if the recording can be replayed.
+   */
+  bool isLoaded() const;
+
+  /*  Replays the whole recording the given number of times, each time with a new headless agent.
+   *
+   *  Parameters:
+   *    + repetitions: number of replays;
+   *    + tolerance: max difference between recorded and replayed outputs.
+   *  Other methods called:
+   *    + computeError
+   *  Return value:
+   *    + results of the replay.
+   */
+  ReplayResults run(const int &repetitions, const double &tolerance);
+
+ private:
+  LoopRecorder recording_;
+  AgentParameters agent_parameters_;
+  int verbosity_level_;
+
+  /*  Computes the max difference between the outputs of the given steps.
+   *
+   *  Parameters:
+   *    + recorded: recorded step;
+   *    + replayed: replayed step.
+   *  Return value:
+   *    + max absolute difference of the outputs (angles are compared on the circle).
+   */
+  double computeError(const LoopRecord &recorded, const LoopRecord &replayed) const;
+
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the replay in a homogeneous
+   *  format.
+   *
+   *  Parameters:
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
+   */
+  std::string consolePrefix(const std::string &caller_name) const;
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+};
+
+#endif
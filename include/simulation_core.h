@@ -0,0 +1,143 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_SIMULATION_CORE_H
+#define GUARD_SIMULATION_CORE_H
+
+#include <chrono>
+#include "agent_core.h"
+#include "moments_accumulator.h"
+#include "swarm_state.h"
+// default values for the simulation settings (if not specified by the user)
+#define DEFAULT_SIMULATION_DURATION 60.0  // expressed in seconds (simulated time)
+#define DEFAULT_SIMULATION_TOLERANCE 0.05  // norm of the error between effective and target statistics
+#define DEFAULT_SIMULATION_SEED 0
+
+// settings of a single simulation run
+struct SimulationSettings {
+  int number_of_agents;
+  double sample_time;  // expressed in seconds
+  double duration;  // expressed in seconds (simulated time)
+  double tolerance;
+  unsigned int seed;  // initial poses of the agents
+  double world_limit;  // in meters, in a "square world" centered in the origin (initial poses)
+  std::vector<double> target_statistics;  // (m_x, m_y, m_xx, m_xy, m_yy)
+  int verbosity_level;
+  bool batched;  // the agents are stepped all at once in a SwarmState ("all" communication topology only)
+};
+
+// results of a single simulation run
+struct SimulationResults {
+  int number_of_agents;
+  int steps;
+  double convergence_time;  // expressed in seconds (simulated time), negative if not reached
+  double final_error;
+  double steps_per_second;  // wall clock
+  double sent_ratio;  // handed over estimates w.r.t. the computed ones (lower than 1 if event triggered)
+};
+
+/*  This class purpose is to run a headless simulation of the whole algorithm as fast as the CPU allows: a single
+ *  thread steps all the agents (consensus, control, guidance and dynamics) in lockstep, hands over their estimated
+ *  statistics directly in memory (all-to-all or with the selected communication topology) and advances the simulated
+ *  time by one sample time per step. There is no ROS master, tf nor marker at all: the agents are created headless
+ *  (see AgentCore) and all the target statistics are provided directly by this class. The simulated time belongs to
+ *  the single run (each agent receives it, see AgentCore::setTime), thus many runs can be executed on different
+ *  threads at the same time (see SweepCore).
+ *
+ *  In batched mode the headless agents are only used to initialize a SwarmState, which then steps all of them at
+ *  once with the same algorithm (the state of all the agents is stored in contiguous arrays): it is the fastest way to
+ *  simulate thousands of agents, but it only supports the "all" communication topology.
+ *
+ *  At the end of each run, it reports the convergence time of the effective statistics of the (real) agents to the
+ *  target ones (the time after which the error stays below the given tolerance), the final error and the number of
+ *  steps per second (wall clock), which can be used to tune the algorithm gains and to time regressions in the hot
+ *  path of the algorithm. With the event triggered broadcast (see AgentCore), only the triggered estimates are handed
+ *  over and the ratio of the sent estimates is reported too.
+ *
+ *  For more info on this class usage, check the README.md in the package folder.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class SimulationCore {
+ public:
+  /*  The constructor creates all the headless agents with random initial poses (generated from the given seed) and
+   *  the given common params, and provides them the target statistics.
+   *
+   *  Parameters:
+   *    + settings: settings of the simulation;
+   *    + agent_parameters: params shared by all the agents (the agent-specific ones are set by this class).
+   */
+  SimulationCore(const SimulationSettings &settings, const AgentParameters &agent_parameters);
+  ~SimulationCore();
+
+  /*  Executes the whole simulation (settings_.duration of simulated time) and evaluates its results.
+   *
+   *  Return value:
+   *    + results of the simulation.
+   *  Other methods called:
+   *    + computeError
+   *    + step
+   */
+  SimulationResults run();
+
+ private:
+  SimulationSettings settings_;
+  int verbosity_level_;
+
+  std::vector<AgentCore*> agents_;
+  SwarmState *swarm_state_;  // only in batched mode
+  std::set<int> hosted_agent_ids_;
+  formation_control::FormationStatistics target_statistics_;
+  ros::Time time_;
+
+  /*  Computes the error between the effective statistics of the (real) agents (those of the SwarmState in batched
+   *  mode) and the target statistics.
+   *
+   *  Return value:
+   *    + norm of the difference of the two statistics vectors.
+   */
+  double computeError() const;
+
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the simulation in a homogeneous
+   *  format.
+   *
+   *  Parameters:
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
+   */
+  std::string consolePrefix(const std::string &caller_name) const;
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+
+  /*  Executes a single algorithm step for all the agents, hands over their estimated statistics to all the others
+   *  (each agent discards those of the non-neighbor agents) if their broadcast is triggered, and advances the
+   *  simulated time by one sample time. In batched mode the whole step is executed by the SwarmState.
+   *
+   *  Return value:
+   *    + number of estimates handed over.
+   */
+  int step();
+};
+
+#endif
@@ -0,0 +1,287 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_SPATIAL_GRID_H
+#define GUARD_SPATIAL_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*  This class purpose is to answer the k-nearest-neighbor and the radius queries over a set of points in the 2D space
+ *  (e.g. the positions of all the agents) without comparing every pair of points. The points are bucketed in a
+ *  uniform grid over their bounding box, stored contiguously cell by cell (counting sort), and a query visits only
+ *  the cells around the query point, ring by ring, until no closer point can be found. The whole grid is rebuilt
+ *  from scratch in linear time (e.g. every sample time), reusing its buffers, thus there are no allocations in the
+ *  steady state.
+ *
+ *  The cell size can be given, otherwise it is chosen to hold about two points per cell on average. In both cases
+ *  the number of cells is bounded by four times the number of points (the cells are enlarged if needed), so that
+ *  sparse outliers can't blow up the memory.
+ *
+ *  It is header-only and has no ROS dependency. It is not thread safe: the queries can be run concurrently, but not
+ *  while the grid is built.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class SpatialGrid {
+ public:
+  SpatialGrid();
+
+  /*  Replaces all the points of the grid with the given ones.
+   *
+   *  Parameters:
+   *    + n: number of points;
+   *    + ids: ids of the points (e.g. agent ids);
+   *    + x: x coordinates of the points;
+   *    + y: y coordinates of the points;
+   *    + cell_size: side of the cells in meters (not positive means automatic).
+   */
+  void build(const int &n, const int *ids, const double *x, const double *y, const double &cell_size);
+
+  /*  Returns the side of the cells chosen by the last build.
+   *
+   *  Return value:
+   *    + cell size in meters.
+   */
+  double getCellSize() const;
+
+  /*  Returns the number of points in the grid.
+   *
+   *  Return value:
+   *    + number of points.
+   */
+  int getCount() const;
+
+  /*  Finds the k points closest to the given position, skipping the point with the given id (e.g. the agent itself).
+   *
+   *  Parameters:
+   *    + x: x coordinate of the query position;
+   *    + y: y coordinate of the query position;
+   *    + k: max number of points to be found;
+   *    + exclude_id: id of the point to be skipped;
+   *    + result: pairs of distance and id of the points found, sorted by distance (it is overwritten).
+   *  Return value:
+   *    + number of points found (less than k only if the grid holds less points).
+   */
+  int knn(const double &x, const double &y, const int &k, const int &exclude_id,
+          std::vector<std::pair<double, int>> &result) const;
+
+  /*  Finds all the points within the given distance from the given position, skipping the point with the given id.
+   *
+   *  Parameters:
+   *    + x: x coordinate of the query position;
+   *    + y: y coordinate of the query position;
+   *    + radius: max distance in meters;
+   *    + exclude_id: id of the point to be skipped;
+   *    + result: pairs of distance and id of the points found, sorted by distance (it is overwritten).
+   *  Return value:
+   *    + number of points found.
+   */
+  int radius(const double &x, const double &y, const double &radius, const int &exclude_id,
+             std::vector<std::pair<double, int>> &result) const;
+
+ private:
+  struct Entry {
+    double x;
+    double y;
+    int id;
+  };
+
+  double min_x_;
+  double min_y_;
+  double cell_size_;
+  int cells_x_;
+  int cells_y_;
+  std::vector<int> cell_begin_;  // entries of the cell c are in [cell_begin_[c], cell_begin_[c+1])
+  std::vector<Entry> entries_;  // sorted by cell
+  std::vector<int> point_cells_;  // cell of each point (only used while building)
+
+  /*  Returns the cell coordinate of the given position along one axis, clamped to the grid.
+   *
+   *  Parameters:
+   *    + value: coordinate of the position;
+   *    + min: lower bound of the grid along the axis;
+   *    + cells: number of cells along the axis.
+   *  Return value:
+   *    + cell coordinate in range [0, cells).
+   */
+  int getCell(const double &value, const double &min, const int &cells) const;
+
+  /*  Adds to the given max-heap the points of the cells at the given Chebyshev distance from the given cell, closer
+   *  than the given squared distance and keeping at most k of them (the farthest one on top).
+   *
+   *  Parameters:
+   *    + x: x coordinate of the query position;
+   *    + y: y coordinate of the query position;
+   *    + cell_x: x coordinate of the query cell;
+   *    + cell_y: y coordinate of the query cell;
+   *    + ring: Chebyshev distance of the visited cells from the query cell;
+   *    + k: max size of the heap;
+   *    + max_distance_2: squared distance bound of the points;
+   *    + exclude_id: id of the point to be skipped;
+   *    + heap: pairs of squared distance and id passed by reference.
+   */
+  void visitRing(const double &x, const double &y, const int &cell_x, const int &cell_y, const int &ring,
+                 const std::size_t &k, const double &max_distance_2, const int &exclude_id,
+                 std::vector<std::pair<double, int>> &heap) const;
+};
+
+inline SpatialGrid::SpatialGrid() {
+  build(0, nullptr, nullptr, nullptr, 0);
+}
+
+inline void SpatialGrid::build(const int &n, const int *ids, const double *x, const double *y, const double &cell_size) {
+  min_x_ = 0;
+  min_y_ = 0;
+  double max_x = 0;
+  double max_y = 0;
+  if (n > 0) {
+    min_x_ = *std::min_element(x, x + n);
+    min_y_ = *std::min_element(y, y + n);
+    max_x = *std::max_element(x, x + n);
+    max_y = *std::max_element(y, y + n);
+  }
+  double width = std::max(max_x - min_x_, 1e-6);
+  double height = std::max(max_y - min_y_, 1e-6);
+
+  // about two points per cell by default, and never more cells than four times the points
+  cell_size_ = (cell_size > 0) ? cell_size : std::sqrt(2*width*height/std::max(n, 1));
+  cell_size_ = std::max(cell_size_, std::sqrt(width*height/(4.0*std::max(n, 1))));
+  cells_x_ = std::min((int)std::ceil(width/cell_size_), std::max(4*n, 1));
+  cells_y_ = std::min((int)std::ceil(height/cell_size_), std::max(4*n, 1));
+  cells_x_ = std::max(cells_x_, 1);
+  cells_y_ = std::max(cells_y_, 1);
+
+  // counting sort of the points by cell
+  cell_begin_.assign(cells_x_*cells_y_ + 1, 0);
+  point_cells_.resize(n);
+  for (int i = 0; i < n; i++) {
+    point_cells_[i] = getCell(y[i], min_y_, cells_y_)*cells_x_ + getCell(x[i], min_x_, cells_x_);
+    cell_begin_[point_cells_[i] + 1]++;
+  }
+  for (std::size_t c = 1; c < cell_begin_.size(); c++) {
+    cell_begin_[c] += cell_begin_[c - 1];
+  }
+  entries_.resize(n);
+  for (int i = n - 1; i >= 0; i--) {
+    Entry &entry = entries_[--cell_begin_[point_cells_[i] + 1]];
+    entry.x = x[i];
+    entry.y = y[i];
+    entry.id = ids[i];
+  }
+  // each cell_begin_[c+1] now points to the beginning of the cell c
+  for (std::size_t c = 0; c + 1 < cell_begin_.size(); c++) {
+    cell_begin_[c] = cell_begin_[c + 1];
+  }
+  cell_begin_.back() = n;
+}
+
+inline double SpatialGrid::getCellSize() const {
+  return cell_size_;
+}
+
+inline int SpatialGrid::getCell(const double &value, const double &min, const int &cells) const {
+  int cell = std::floor((value - min)/cell_size_);
+  return std::min(std::max(cell, 0), cells - 1);
+}
+
+inline int SpatialGrid::getCount() const {
+  return entries_.size();
+}
+
+inline int SpatialGrid::knn(const double &x, const double &y, const int &k, const int &exclude_id,
+                            std::vector<std::pair<double, int>> &result) const {
+  result.clear();
+  if (k <= 0) {
+    return 0;
+  }
+
+  int cell_x = getCell(x, min_x_, cells_x_);
+  int cell_y = getCell(y, min_y_, cells_y_);
+  int max_ring = std::max(std::max(cell_x, cells_x_ - 1 - cell_x), std::max(cell_y, cells_y_ - 1 - cell_y));
+  for (int ring = 0; ring <= max_ring; ring++) {
+    visitRing(x, y, cell_x, cell_y, ring, k, std::numeric_limits<double>::infinity(), exclude_id, result);
+    // the points of the following rings are farther than ring*cell_size_ from the query position
+    double bound = ring*cell_size_;
+    if ((int)result.size() >= k && result.front().first <= bound*bound) {
+      break;
+    }
+  }
+
+  std::sort_heap(result.begin(), result.end());
+  for (auto &found : result) {
+    found.first = std::sqrt(found.first);
+  }
+  return result.size();
+}
+
+inline int SpatialGrid::radius(const double &x, const double &y, const double &radius, const int &exclude_id,
+                               std::vector<std::pair<double, int>> &result) const {
+  result.clear();
+  if (!(radius >= 0)) {
+    return 0;
+  }
+
+  int cell_x = getCell(x, min_x_, cells_x_);
+  int cell_y = getCell(y, min_y_, cells_y_);
+  int max_ring = std::max(std::max(cell_x, cells_x_ - 1 - cell_x), std::max(cell_y, cells_y_ - 1 - cell_y));
+  max_ring = std::min<double>(max_ring, std::ceil(radius/cell_size_));
+  for (int ring = 0; ring <= max_ring; ring++) {
+    visitRing(x, y, cell_x, cell_y, ring, entries_.size(), radius*radius, exclude_id, result);
+  }
+
+  std::sort_heap(result.begin(), result.end());
+  for (auto &found : result) {
+    found.first = std::sqrt(found.first);
+  }
+  return result.size();
+}
+
+inline void SpatialGrid::visitRing(const double &x, const double &y, const int &cell_x, const int &cell_y,
+                                   const int &ring, const std::size_t &k, const double &max_distance_2,
+                                   const int &exclude_id, std::vector<std::pair<double, int>> &heap) const {
+  int begin_y = std::max(cell_y - ring, 0);
+  int end_y = std::min(cell_y + ring, cells_y_ - 1);
+  for (int cy = begin_y; cy <= end_y; cy++) {
+    // inner rows of the ring have only their first and last cell
+    bool border_row = (cy == cell_y - ring || cy == cell_y + ring);
+    int step = (border_row || ring == 0) ? 1 : 2*ring;
+    for (int cx = cell_x - ring; cx <= cell_x + ring; cx += step) {
+      if (cx < 0 || cx >= cells_x_) {
+        continue;
+      }
+      int cell = cy*cells_x_ + cx;
+      for (int e = cell_begin_[cell]; e < cell_begin_[cell + 1]; e++) {
+        const Entry &entry = entries_[e];
+        double distance_2 = (entry.x - x)*(entry.x - x) + (entry.y - y)*(entry.y - y);
+        if (entry.id == exclude_id || distance_2 > max_distance_2) {
+          continue;
+        }
+        if (heap.size() < k) {
+          heap.push_back(std::make_pair(distance_2, entry.id));
+          std::push_heap(heap.begin(), heap.end());
+        }
+        else if (distance_2 < heap.front().first) {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.back() = std::make_pair(distance_2, entry.id);
+          std::push_heap(heap.begin(), heap.end());
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,298 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_STATS_GEOMETRY_H
+#define GUARD_STATS_GEOMETRY_H
+
+#include <cmath>
+#include <limits>
+#include <string>
+// auto-generated from ./msg directory libraries
+#include <formation_control/FormationStatistics.h>
+#include <formation_control/FormationStatisticsArray.h>
+#include <formation_control/FormationStatisticsStamped.h>
+
+// ellipse represented by formation statistics: 2D pose of its center and "generalized diameters" (the variances
+// along its axes, see StatsGeometry::computeA)
+struct StatsEllipse {
+  double x;
+  double y;
+  double theta;
+  double a_x;
+  double a_y;
+};
+
+/*  This class purpose is to collect the conversions between the formation statistics (first and second order
+ *  momentums, mx, my, mxx, mxy, myy) and the ellipses which represent them, together with the conversions between the
+ *  statistics messages and plain arrays (or the array messages which pack the statistics of many agents). All the
+ *  methods are static and allocation free (but the unpacking of the array messages), and there is no logging.
+ *
+ *  Besides the single statistics conversions, the batch ones convert many statistics at once from a structure of
+ *  arrays (one contiguous array for each component, e.g. the estimates of all the agents): they are plain loops
+ *  without branches nor calls other than the math functions, with a cache friendly memory access. The batch
+ *  conversion from statistics to ellipses gets the "generalized diameters" as the eigenvalues of the covariance
+ *  matrix (a single hypot instead of the sin and cos of the orientation), which is the same as the single conversion
+ *  up to rounding errors, but it can't correct the orientation (see thetaCorrection).
+ *
+ *  It is header-only and has no ROS dependency other than the statistics messages, thus it can be shared by the
+ *  VisualizationCore, the AgentCore, the SwarmCore and offline analysis tools.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class StatsGeometry {
+ public:
+  static const int NUMBER_OF_STATS = 5;  // see FormationStatistics.msg (mx, my, mxx, mxy, myy)
+
+  /*  Computes the "generalized diameter" starting from the given real diameter of the ellipse.
+   *
+   *  Parameters:
+   *    + diameter: represents one of the two diameters of the ellipse;
+   *    + number_of_agents: number of agents represented by the ellipse.
+   *  Return value:
+   *    + the so called "generalized diameter".
+   */
+  static double computeA(const double &diameter, const int &number_of_agents);
+
+  /*  Computes the real diameter of the ellipse starting from the given "generalized diameter".
+   *
+   *  Parameters:
+   *    + a: the so called "generalized diameter" (it is proportional to the real diameter);
+   *    + number_of_agents: number of agents represented by the ellipse.
+   *  Return value:
+   *    + diameter of the ellipse.
+   */
+  static double computeDiameter(const double &a, const int &number_of_agents);
+
+  /*  Computes the statistics from the given ellipse.
+   *
+   *  Parameters:
+   *    + ellipse: 2D pose of the center and "generalized diameters" of the ellipse.
+   *  Return value:
+   *    + statistics represented by the ellipse.
+   */
+  static formation_control::FormationStatistics ellipseToStats(const StatsEllipse &ellipse);
+
+  /*  Computes the statistics of many ellipses at once (see ellipseToStats).
+   *
+   *  Parameters:
+   *    + n: number of ellipses;
+   *    + ellipses: arrays of the ellipse components in the following order (x, y, theta, a_x, a_y);
+   *    + stats: arrays where the statistics are stored in the following order (mx, my, mxx, mxy, myy).
+   */
+  static void ellipsesToStats(const int &n, const double *const ellipses[NUMBER_OF_STATS],
+                              double *const stats[NUMBER_OF_STATS]);
+
+  /*  Converts statistics from a plain array to formation_control::FormationStatistics ROS message.
+   *
+   *  Parameters:
+   *    + values: data is stored in the following order (mx, my, mxx, mxy, myy).
+   *  Return value:
+   *    + message filled with the given values.
+   */
+  static formation_control::FormationStatistics fromArray(const double values[NUMBER_OF_STATS]);
+
+  /*  Computes the ellipse which represents the given statistics: the orientation of its axes is in [-pi/2, pi/2]
+   *  (which is enough thanks to its simmetry), unless a previous orientation is given (see thetaCorrection).
+   *
+   *  Parameters:
+   *    + stats: formation statistics;
+   *    + theta_old: previous orientation of the ellipse (it must be nan otherwise).
+   *  Other methods called:
+   *    + thetaCorrection
+   *  Return value:
+   *    + 2D pose of the center and "generalized diameters" of the ellipse.
+   */
+  static StatsEllipse statsToEllipse(const formation_control::FormationStatistics &stats,
+                                     const double &theta_old = std::numeric_limits<double>::quiet_NaN());
+
+  /*  Computes the ellipses of many statistics at once (see statsToEllipse, the orientations are not corrected).
+   *
+   *  Parameters:
+   *    + n: number of statistics;
+   *    + stats: arrays of the statistics components in the following order (mx, my, mxx, mxy, myy);
+   *    + ellipses: arrays where the ellipses are stored in the following order (x, y, theta, a_x, a_y).
+   */
+  static void statsToEllipses(const int &n, const double *const stats[NUMBER_OF_STATS],
+                              double *const ellipses[NUMBER_OF_STATS]);
+
+  /*  Returns the orientation equivalent to the given one for an ellipse (i.e. rotated by a multiple of pi/2, with the
+   *  diameters swapped accordingly) which is the closest to the previous one, in range [-pi, pi]. It avoids the
+   *  discontinuities of the orientation on pi/2 and -pi/2 (e.g. for the interactive markers "attached" to an ellipse).
+   *
+   *  Parameters:
+   *    + theta: current orientation of the ellipse;
+   *    + theta_old: previous orientation of the ellipse.
+   *  Return value:
+   *    + corrected orientation.
+   */
+  static double thetaCorrection(const double &theta, const double &theta_old);
+
+  /*  Converts statistics from formation_control::FormationStatistics ROS message to a plain array.
+   *
+   *  Parameters:
+   *    + stats: structure containing the statistics (mx, my, mxx, mxy, myy);
+   *    + values: array where the statistics are stored in the same order.
+   */
+  static void toArray(const formation_control::FormationStatistics &stats, double values[NUMBER_OF_STATS]);
+
+  /*  Unpacks the given array message (e.g. sent by a SwarmCore for all its hosted agents) and passes the statistics of
+   *  each agent to the given callback as if they were sent by the agent itself (single message with the frame of its
+   *  virtual agent). The same message is reused for all the agents, thus the callback must copy what it needs.
+   *
+   *  Parameters:
+   *    + array: statistics of a group of agents, it must have as many agent ids as statistics;
+   *    + frame_agent_prefix: prefix of the agent frames (e.g. "agent_");
+   *    + frame_virtual_suffix: suffix of the virtual agent frames (e.g. "_virtual");
+   *    + callback: called as callback(index, msg) for each agent, where index is its position in the array.
+   *  Return value:
+   *    + false if the array sizes are different (the callback is never called).
+   */
+  template <typename Callback>
+  static bool unpackArray(const formation_control::FormationStatisticsArray &array,
+                          const std::string &frame_agent_prefix, const std::string &frame_virtual_suffix,
+                          Callback callback);
+};
+
+inline double StatsGeometry::computeA(const double &diameter, const int &number_of_agents) {
+  return diameter*diameter / (4*number_of_agents);
+}
+
+inline double StatsGeometry::computeDiameter(const double &a, const int &number_of_agents) {
+  return 2*std::sqrt(number_of_agents*std::abs(a));
+}
+
+inline formation_control::FormationStatistics StatsGeometry::ellipseToStats(const StatsEllipse &ellipse) {
+  const double c = std::cos(ellipse.theta);
+  const double s = std::sin(ellipse.theta);
+
+  formation_control::FormationStatistics stats;
+  stats.m_x = ellipse.x;
+  stats.m_y = ellipse.y;
+  stats.m_xx = ellipse.a_x*c*c + ellipse.a_y*s*s + ellipse.x*ellipse.x;
+  stats.m_xy = (ellipse.a_x - ellipse.a_y)*s*c + ellipse.x*ellipse.y;
+  stats.m_yy = ellipse.a_x*s*s + ellipse.a_y*c*c + ellipse.y*ellipse.y;
+  return stats;
+}
+
+inline void StatsGeometry::ellipsesToStats(const int &n, const double *const ellipses[NUMBER_OF_STATS],
+                                           double *const stats[NUMBER_OF_STATS]) {
+  const double *x = ellipses[0];
+  const double *y = ellipses[1];
+  const double *theta = ellipses[2];
+  const double *a_x = ellipses[3];
+  const double *a_y = ellipses[4];
+  for (int i = 0; i < n; i++) {
+    const double c = std::cos(theta[i]);
+    const double s = std::sin(theta[i]);
+    stats[0][i] = x[i];
+    stats[1][i] = y[i];
+    stats[2][i] = a_x[i]*c*c + a_y[i]*s*s + x[i]*x[i];
+    stats[3][i] = (a_x[i] - a_y[i])*s*c + x[i]*y[i];
+    stats[4][i] = a_x[i]*s*s + a_y[i]*c*c + y[i]*y[i];
+  }
+}
+
+inline formation_control::FormationStatistics StatsGeometry::fromArray(const double values[NUMBER_OF_STATS]) {
+  formation_control::FormationStatistics stats;
+  stats.m_x = values[0];
+  stats.m_y = values[1];
+  stats.m_xx = values[2];
+  stats.m_xy = values[3];
+  stats.m_yy = values[4];
+  return stats;
+}
+
+inline StatsEllipse StatsGeometry::statsToEllipse(const formation_control::FormationStatistics &stats,
+                                                  const double &theta_old) {
+  // central moments (m_xy is twice the covariance)
+  const double m_xy = 2*(stats.m_xy - stats.m_x*stats.m_y);
+  const double m_xx = stats.m_xx - stats.m_x*stats.m_x;
+  const double m_yy = stats.m_yy - stats.m_y*stats.m_y;
+
+  StatsEllipse ellipse;
+  ellipse.x = stats.m_x;
+  ellipse.y = stats.m_y;
+  ellipse.theta = std::atan2(m_xy, (m_xx - m_yy))/2;
+  if (!std::isnan(theta_old)) {
+    ellipse.theta = thetaCorrection(ellipse.theta, theta_old);
+  }
+
+  const double c = std::cos(ellipse.theta);
+  const double s = std::sin(ellipse.theta);
+  ellipse.a_x = m_xx*c*c + m_yy*s*s + m_xy*s*c;
+  ellipse.a_y = m_yy*c*c + m_xx*s*s - m_xy*s*c;
+  return ellipse;
+}
+
+inline void StatsGeometry::statsToEllipses(const int &n, const double *const stats[NUMBER_OF_STATS],
+                                           double *const ellipses[NUMBER_OF_STATS]) {
+  for (int i = 0; i < n; i++) {
+    const double m_x = stats[0][i];
+    const double m_y = stats[1][i];
+    const double m_xy = 2*(stats[3][i] - m_x*m_y);
+    const double m_xx = stats[2][i] - m_x*m_x;
+    const double m_yy = stats[4][i] - m_y*m_y;
+    // the axes are the eigenvectors of the covariance matrix: a_x and a_y are its eigenvalues
+    const double trace = m_xx + m_yy;
+    const double radius = std::hypot(m_xx - m_yy, m_xy);
+    ellipses[0][i] = m_x;
+    ellipses[1][i] = m_y;
+    ellipses[2][i] = std::atan2(m_xy, (m_xx - m_yy))/2;
+    ellipses[3][i] = (trace + radius)/2;
+    ellipses[4][i] = (trace - radius)/2;
+  }
+}
+
+inline double StatsGeometry::thetaCorrection(const double &theta, const double &theta_old) {
+  double theta_corrected = theta;
+  double min_distance = std::numeric_limits<double>::infinity();
+  for (int k = 0; k < 4; k++) {
+    const double candidate = std::remainder(theta + k*M_PI_2, 2*M_PI);  // normalized in [-pi, pi]
+    const double distance = std::abs(std::remainder(theta_old - candidate, 2*M_PI));
+    if (distance < min_distance) {
+      theta_corrected = candidate;
+      min_distance = distance;
+    }
+  }
+  return theta_corrected;
+}
+
+inline void StatsGeometry::toArray(const formation_control::FormationStatistics &stats,
+                                   double values[NUMBER_OF_STATS]) {
+  values[0] = stats.m_x;
+  values[1] = stats.m_y;
+  values[2] = stats.m_xx;
+  values[3] = stats.m_xy;
+  values[4] = stats.m_yy;
+}
+
+template <typename Callback>
+bool StatsGeometry::unpackArray(const formation_control::FormationStatisticsArray &array,
+                                const std::string &frame_agent_prefix, const std::string &frame_virtual_suffix,
+                                Callback callback) {
+  if (array.agent_ids.size() != array.stats.size()) {
+    return false;
+  }
+
+  formation_control::FormationStatisticsStamped msg;
+  msg.header = array.header;
+  for (std::size_t i = 0; i < array.agent_ids.size(); i++) {
+    msg.header.frame_id = frame_agent_prefix + std::to_string(array.agent_ids[i]) + frame_virtual_suffix;
+    msg.agent_id = array.agent_ids[i];
+    msg.stats = array.stats[i];
+    callback(i, msg);
+  }
+  return true;
+}
+
+#endif
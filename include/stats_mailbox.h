@@ -0,0 +1,370 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_STATS_MAILBOX_H
+#define GUARD_STATS_MAILBOX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <vector>
+// auto-generated from ./msg directory libraries
+#include <formation_control/FormationStatistics.h>
+
+/*  This class purpose is to collect the last statistics received from each agent between two consecutive consensus
+ *  steps, without blocking the threads which receive them and without any allocation in the steady state. There is a
+ *  preallocated slot for each sender (from 0 to the given capacity), protected by a sequence lock: the writer makes
+ *  the sequence odd while it copies the statistics and even again when it is done, and the reader retries the copy
+ *  if the sequence has changed in the middle (a slot which is still being written after a few attempts is left for
+ *  the following collection). A slot is new for the reader whenever its sequence differs from the one seen at the
+ *  previous collection (i.e. the sequence also acts as a freshness stamp).
+ *
+ *  Each slot is assigned to a single agent id: by default the slot index is the agent id itself (e.g. when all the
+ *  agents are neighbors), otherwise the owner of the mailbox assigns the slots to the current neighbors (e.g. through
+ *  an id to slot index) and reassigns them when the neighbors change, so that the memory and the collection time
+ *  depend only on the number of neighbors. The statistics stored for an agent which no longer owns the slot are
+ *  discarded, and the statistics and the counters of the previous owner are discarded on reassignment.
+ *
+ *  Optionally, the last statistics of each agent can be reused in the following collections when nothing new has been
+ *  received (e.g. a packet is lost), until they become older than a given max age, and they can be weighted by their
+ *  age (from 1 when just received to 0 at the max age). The collecting thread also counts, for each agent, the
+ *  collections with new statistics (fresh), with reused statistics (reused) and without any statistics (missed).
+ *
+ *  The statistics can be stored together with their time derivative and the stamp given by the sender: when they are
+ *  collected later than a given delay after that stamp (e.g. late or reused ones), they are extrapolated linearly
+ *  once, beyond that delay up to the collection time and at most by a given max horizon, while their age (for the
+ *  reuse and the weighting) is always measured from their reception.
+ *
+ *  Many threads can store statistics at the same time: they contend only when they carry statistics of the same
+ *  agent (the last one wins), while the statistics of the slots beyond the capacity are kept in a map under a mutex
+ *  (slow path, e.g. for unexpected agent ids, which are never reused nor counted). Only a single thread can collect
+ *  the statistics.
+ *
+ *  It is header-only and has no ROS dependency other than the FormationStatistics message.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class StatsMailbox {
+ public:
+  static const int NUMBER_OF_STATS = 5;  // see FormationStatistics.msg (mx, my, mxx, mxy, myy)
+
+  StatsMailbox();
+
+  /*  Assigns the given slot to the given agent, discarding the statistics and the counters of its previous owner. It
+   *  can be called while other threads store or collect statistics (a store of the previous owner which is still in
+   *  progress is either discarded or overwritten).
+   *
+   *  Parameters:
+   *    + slot: index of the slot in range [0, capacity);
+   *    + id: id of the agent (-1 frees the slot).
+   */
+  void assign(const int &slot, const int &id);
+
+  /*  Sums all the statistics stored since the previous call (and the still valid old ones, if max_age is positive)
+   *  and marks them as collected. It must be called always by the same thread.
+   *
+   *  Parameters:
+   *    + now: current time in seconds;
+   *    + max_age: max age in seconds of the reused statistics (0 means that they are never reused);
+   *    + age_weighting: whether the statistics are weighted by their age (or all of them have unitary weight);
+   *    + prediction_delay: time in seconds after the stamp of the sender until which the statistics are current
+   *      (they are extrapolated beyond it);
+   *    + max_horizon: max time in seconds the statistics are extrapolated with their derivative (0 means never);
+   *    + sum: array where the weighted sum of the statistics is stored (it is overwritten);
+   *    + weight: sum of the weights of the statistics passed by reference.
+   *  Return value:
+   *    + number of agents whose statistics have been summed.
+   */
+  int collect(const double &now, const double &max_age, const bool &age_weighting, const double &prediction_delay,
+              const double &max_horizon, double sum[NUMBER_OF_STATS], double &weight);
+
+  /*  Returns the number of preallocated slots.
+   *
+   *  Return value:
+   *    + agent ids are in range [0, capacity).
+   */
+  int getCapacity() const;
+
+  /*  Retrieves the owner and the counters of the collections of the given slot, since it has been assigned. It must
+   *  be called by the collecting thread.
+   *
+   *  Parameters:
+   *    + slot: index of the slot;
+   *    + id: id of the agent which owns the slot passed by reference;
+   *    + fresh: number of collections with new statistics passed by reference;
+   *    + reused: number of collections with reused statistics passed by reference;
+   *    + missed: number of collections without any statistics passed by reference.
+   *  Return value:
+   *    + false if nothing has ever been received from the owner of the slot (or it is beyond the capacity).
+   */
+  bool getCounters(const int &slot, int &id, unsigned long &fresh, unsigned long &reused,
+                   unsigned long &missed) const;
+
+  /*  Preallocates the slots in range [0, capacity), each one assigned to the agent id equal to its index, and
+   *  discards all the stored statistics. It is not thread safe (it has to be called before any other method).
+   *
+   *  Parameters:
+   *    + capacity: number of preallocated slots.
+   */
+  void reserve(const int &capacity);
+
+  /*  Stores the given statistics of the given agent in the given slot, replacing those not collected yet, unless the
+   *  slot is assigned to another agent. It never waits for the collecting thread.
+   *
+   *  Parameters:
+   *    + slot: index of the slot assigned to the agent (beyond the capacity the slow path is used);
+   *    + id: id of the agent which has sent the statistics;
+   *    + stats: statistics to be stored;
+   *    + stats_dot: time derivative of the statistics (all zeros if unknown, it is discarded beyond the capacity);
+   *    + stamp: time of reception in seconds (it is used to evaluate the age of the statistics);
+   *    + stats_stamp: time in seconds given by the sender to the statistics (it is used for the extrapolation).
+   */
+  void store(const int &slot, const int &id, const formation_control::FormationStatistics &stats,
+             const formation_control::FormationStatistics &stats_dot, const double &stamp, const double &stats_stamp);
+
+ private:
+  static const int MAX_READ_ATTEMPTS = 4;
+
+  struct Slot {
+    Slot() : sequence(0), id(-1), stamp(std::numeric_limits<double>::quiet_NaN()) {}
+    std::atomic<unsigned int> sequence;  // odd while a writer is copying the statistics
+    std::atomic<int> id;  // owner of the slot (-1 if free)
+    std::atomic<double> stats[NUMBER_OF_STATS];
+    std::atomic<double> stats_dot[NUMBER_OF_STATS];
+    std::atomic<double> stamp;  // nan until the owner stores its first statistics
+    std::atomic<double> stats_stamp;
+  };
+
+  // last collected statistics of an agent (used only by the collecting thread)
+  struct Link {
+    Link() : sequence(0), id(-1), stamp(0), stats_stamp(0), valid(false), fresh(0), reused(0), missed(0) {}
+    unsigned int sequence;
+    int id;
+    double stats[NUMBER_OF_STATS];
+    double stats_dot[NUMBER_OF_STATS];
+    double stamp;
+    double stats_stamp;
+    bool valid;
+    unsigned long fresh;
+    unsigned long reused;
+    unsigned long missed;
+  };
+
+  std::vector<Slot> slots_;
+  std::vector<Link> links_;
+  std::map<int, formation_control::FormationStatistics> overflow_;  // slots beyond the capacity
+  std::mutex overflow_mutex_;
+
+  /*  Acquires the given slot for writing (other writers of the same agent can be in the middle of the copy).
+   *
+   *  Parameters:
+   *    + slot: slot to be written.
+   *  Return value:
+   *    + sequence of the slot before the acquisition (the slot is released by setting it to this value plus 2).
+   */
+  unsigned int acquire(Slot &slot) const;
+
+  /*  Copies the statistics of the given slot in the given link, if they are new and consistent (i.e. not overwritten
+   *  in the meantime, see the class description). The link is reset when the slot has been assigned to another agent.
+   *
+   *  Parameters:
+   *    + slot: slot of the agent;
+   *    + link: last collected statistics of the agent passed by reference.
+   *  Return value:
+   *    + true if new statistics have been copied.
+   */
+  bool read(Slot &slot, Link &link) const;
+};
+
+inline StatsMailbox::StatsMailbox() {}
+
+inline unsigned int StatsMailbox::acquire(Slot &slot) const {
+  unsigned int sequence = slot.sequence.load(std::memory_order_relaxed);
+  while ((sequence & 1) || !slot.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire)) {
+    sequence = slot.sequence.load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  return sequence;
+}
+
+inline void StatsMailbox::assign(const int &slot, const int &id) {
+  if (slot < 0 || slot >= (int)slots_.size()) {
+    return;
+  }
+
+  Slot &target = slots_[slot];
+  unsigned int sequence = acquire(target);
+  target.id.store(id, std::memory_order_relaxed);
+  target.stamp.store(std::numeric_limits<double>::quiet_NaN(), std::memory_order_relaxed);
+  target.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+inline int StatsMailbox::collect(const double &now, const double &max_age, const bool &age_weighting,
+                                 const double &prediction_delay, const double &max_horizon,
+                                 double sum[NUMBER_OF_STATS], double &weight) {
+  int count = 0;
+  weight = 0;
+  for (int s = 0; s < NUMBER_OF_STATS; s++) {
+    sum[s] = 0;
+  }
+
+  for (std::size_t id = 0; id < slots_.size(); id++) {
+    Link &link = links_[id];
+    bool fresh = read(slots_[id], link);
+    if (!link.valid) {
+      continue;  // nothing ever received from this agent
+    }
+
+    double age = now - link.stamp;
+    if (!fresh && (max_age <= 0 || age > max_age)) {
+      link.missed++;
+      continue;
+    }
+    fresh ? link.fresh++ : link.reused++;
+
+    double w = 1;
+    if (age_weighting && max_age > 0) {
+      w = std::min(std::max(1 - age/max_age, 0.0), 1.0);
+    }
+    double horizon = std::min(std::max(now - link.stats_stamp - prediction_delay, 0.0), max_horizon);
+    for (int s = 0; s < NUMBER_OF_STATS; s++) {
+      sum[s] += w*(link.stats[s] + link.stats_dot[s]*horizon);
+    }
+    weight += w;
+    count++;
+  }
+
+  overflow_mutex_.lock();
+  for (auto const &received : overflow_) {
+    sum[0] += received.second.m_x;
+    sum[1] += received.second.m_y;
+    sum[2] += received.second.m_xx;
+    sum[3] += received.second.m_xy;
+    sum[4] += received.second.m_yy;
+    weight += 1;
+    count++;
+  }
+  overflow_.clear();
+  overflow_mutex_.unlock();
+
+  return count;
+}
+
+inline int StatsMailbox::getCapacity() const {
+  return slots_.size();
+}
+
+inline bool StatsMailbox::getCounters(const int &slot, int &id, unsigned long &fresh, unsigned long &reused,
+                                      unsigned long &missed) const {
+  if (slot < 0 || slot >= (int)links_.size() || !links_.at(slot).valid) {
+    return false;
+  }
+  id = links_.at(slot).id;
+  fresh = links_.at(slot).fresh;
+  reused = links_.at(slot).reused;
+  missed = links_.at(slot).missed;
+  return true;
+}
+
+inline bool StatsMailbox::read(Slot &slot, Link &link) const {
+  unsigned int sequence = slot.sequence.load(std::memory_order_acquire);
+  if (sequence == link.sequence) {
+    return false;  // nothing new from this agent
+  }
+
+  // a writer could have been preempted in the middle of the copy: the slot is left for the following collection
+  // after a few attempts, instead of waiting for it
+  double stats[NUMBER_OF_STATS];
+  double stats_dot[NUMBER_OF_STATS];
+  double stamp = 0;
+  double stats_stamp = 0;
+  int id = -1;
+  for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+    if (sequence & 1) {
+      sequence = slot.sequence.load(std::memory_order_acquire);
+      continue;
+    }
+    for (int s = 0; s < NUMBER_OF_STATS; s++) {
+      stats[s] = slot.stats[s].load(std::memory_order_relaxed);
+      stats_dot[s] = slot.stats_dot[s].load(std::memory_order_relaxed);
+    }
+    stamp = slot.stamp.load(std::memory_order_relaxed);
+    stats_stamp = slot.stats_stamp.load(std::memory_order_relaxed);
+    id = slot.id.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    unsigned int sequence_end = slot.sequence.load(std::memory_order_relaxed);
+    if (sequence_end == sequence) {
+      if (id != link.id) {
+        link = Link();  // the slot has been assigned to another agent
+        link.id = id;
+      }
+      link.sequence = sequence;
+      if (std::isnan(stamp)) {
+        link.valid = false;  // assigned, but nothing stored yet
+        return false;
+      }
+      std::copy(stats, stats + NUMBER_OF_STATS, link.stats);
+      std::copy(stats_dot, stats_dot + NUMBER_OF_STATS, link.stats_dot);
+      link.stamp = stamp;
+      link.stats_stamp = stats_stamp;
+      link.valid = true;
+      return true;
+    }
+    sequence = sequence_end;  // overwritten in the meantime, retries with the newest statistics
+  }
+  return false;
+}
+
+inline void StatsMailbox::reserve(const int &capacity) {
+  slots_ = std::vector<Slot>(capacity);
+  links_.assign(capacity, Link());
+  for (int slot = 0; slot < capacity; slot++) {
+    slots_[slot].id = slot;
+    links_[slot].id = slot;
+  }
+  overflow_.clear();
+}
+
+inline void StatsMailbox::store(const int &slot, const int &id, const formation_control::FormationStatistics &stats,
+                                const formation_control::FormationStatistics &stats_dot, const double &stamp,
+                                const double &stats_stamp) {
+  if (slot < 0 || slot >= (int)slots_.size()) {
+    overflow_mutex_.lock();
+    overflow_[slot] = stats;
+    overflow_mutex_.unlock();
+    return;
+  }
+
+  Slot &target = slots_[slot];
+  unsigned int sequence = acquire(target);
+  if (target.id.load(std::memory_order_relaxed) != id) {
+    target.sequence.store(sequence, std::memory_order_release);  // reassigned in the meantime (nothing has changed)
+    return;
+  }
+
+  const double values[NUMBER_OF_STATS] = {stats.m_x, stats.m_y, stats.m_xx, stats.m_xy, stats.m_yy};
+  const double values_dot[NUMBER_OF_STATS] = {stats_dot.m_x, stats_dot.m_y, stats_dot.m_xx, stats_dot.m_xy,
+                                              stats_dot.m_yy};
+  for (int s = 0; s < NUMBER_OF_STATS; s++) {
+    target.stats[s].store(values[s], std::memory_order_relaxed);
+    target.stats_dot[s].store(values_dot[s], std::memory_order_relaxed);
+  }
+  target.stamp.store(stamp, std::memory_order_relaxed);
+  target.stats_stamp.store(stats_stamp, std::memory_order_relaxed);
+  target.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+#endif
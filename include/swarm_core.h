@@ -0,0 +1,207 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_SWARM_CORE_H
+#define GUARD_SWARM_CORE_H
+
+#include "agent_core.h"
+
+/*  This class purpose is to host many AgentCore instances in a single ROS node, to avoid the overhead of a distinct
+ *  process (with its own spinner threads, TF broadcaster and shared statistics connections) for each simulated agent.
+ *  All the hosted agents are driven by a single shared timer and their estimated statistics are handed over among
+ *  them directly in memory, without any serialization. The external interface is the same of the standalone agents:
+ *  the estimated statistics of the hosted agents are still published in the shared topic (so that the visualization
+ *  and agents hosted elsewhere keep working), and the statistics received from the external agents are forwarded to
+ *  all the hosted ones (with a neighbor-limited communication topology, each hosted agent subscribes on its own to
+ *  the topics of its external neighbors).
+ *
+ *  With aggregate_statistics enabled (only with "all" topology), the estimated statistics of all the hosted agents
+ *  are packed in a single message published in the shared array topic every sample time, instead of one message per
+ *  agent in the shared topic: the number of packets sent per second becomes independent of the number of agents.
+ *  Otherwise each hosted agent publishes its estimate in its own TDMA slot, like a standalone agent does: the shared
+ *  timer starts at the beginning of a TDMA frame (frame_tdma) and a one-shot timer per agent publishes its estimate
+ *  when the slot of the agent is reached (stamped at the beginning of the slot), so that the link monitors of the
+ *  receivers keep checking the slots of the hosted agents too (the arrays are never checked, see LinkMonitor).
+ *
+ *  With compact_statistics enabled, the statistics of the external agents are received in the compact format from
+ *  the shared compact topic (see CompactCodec), like the hosted agents publish theirs. Likewise, with
+ *  predict_statistics enabled (and compact_statistics disabled) they are received with their time derivative from the
+ *  shared predicted topic, and the hosted agents hand over their derivative in memory as well (see
+ *  AgentCore::getSharedStatistics). The aggregated statistics are always sent in the full format.
+ *
+ *  The poses of all the hosted agents are broadcasted to the TF ROS environment together, in a single message at most
+ *  at tf_rate (0 means every sample time).
+ *
+ *  Each hosted agent retrieves its own settings from its private namespace (e.g. ~agent_1/x), falling back on the
+ *  private namespace of this node for the common ones (e.g. the content of agent_initialization.yaml). The agent ids
+ *  can be listed explicitly, otherwise they range from 1 to number_of_agents.
+ *
+ *  For more info on this class usage, check the README.md in the package folder.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ *
+ *  ROS params:
+ *    + sample_time
+ *    + number_of_agents
+ *    + agent_ids
+ *    + verbosity_level
+ *    + topic_queue_length
+ *    + shared_stats_topic
+ *    + shared_stats_array_topic
+ *    + shared_stats_compact_topic
+ *    + shared_stats_predicted_topic
+ *    + compact_statistics
+ *    + compact_resolution
+ *    + predict_statistics
+ *    + aggregate_statistics
+ *    + frame_tdma
+ *    + frame_agent_prefix
+ *    + frame_virtual_suffix
+ *    + communication_topology
+ *    + tf_rate
+ */
+class SwarmCore {
+ public:
+  /*  The constructor retrieves the swarm parameters from ROS params if specified by the user (default values
+   *  otherwise), creates all the hosted agents (each one in its own private namespace), subscribes to the shared
+   *  topic for the statistics of the external agents (only with "all" topology) and starts the shared timer.
+   */
+  SwarmCore();
+  ~SwarmCore();
+
+ private:
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle *private_node_handle_;
+  ros::Publisher stats_array_publisher_;
+  ros::Subscriber stats_subscriber_;
+  ros::Subscriber stats_array_subscriber_;
+  ros::Timer algorithm_timer_;
+  std::vector<ros::Timer> transmit_timers_;  // one-shot, one for each hosted agent
+  tf::TransformBroadcaster tf_broadcaster_;
+
+  double sample_time_;
+  int number_of_agents_;
+  int verbosity_level_;
+
+  int topic_queue_length_;
+  std::string shared_stats_topic_name_;
+  std::string shared_stats_array_topic_name_;
+  std::string shared_stats_compact_topic_name_;
+  std::string shared_stats_predicted_topic_name_;
+  bool compact_statistics_;
+  bool predict_statistics_;
+  CompactCodec compact_codec_;
+  std::string frame_agent_prefix_;
+  std::string frame_virtual_suffix_;
+  std::string communication_topology_;
+  bool aggregate_statistics_;
+  double tf_rate_;
+  ros::Time last_tf_broadcast_;
+  double frame_tdma_;  // expressed in seconds
+  std::vector<formation_control::FormationStatisticsPredicted> transmit_statistics_;  // waiting for the agent slot
+  std::mutex transmit_statistics_mutex_;
+
+  std::vector<AgentCore*> agents_;
+  std::set<int> hosted_agent_ids_;
+
+  /*  This is the main method of the swarm and it is automatically called by a timer event every sample_time_. It
+   *  executes a single algorithm step for all the hosted agents, then it hands over their estimated statistics to all
+   *  the other hosted agents and publishes them for the external ones (all together in the shared array topic, if
+   *  aggregate_statistics_ is enabled, otherwise each one is scheduled in the TDMA slot of its agent and published by
+   *  transmitCallback). The estimates suppressed by the event triggered broadcast (see AgentCore::triggerBroadcast)
+   *  are not handed over either, thus the hosted agents keep the last broadcasted ones like the external agents do.
+   *
+   *  Parameters:
+   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (the expected time of the event is the
+   *      beginning of the current TDMA frame).
+   *  Other methods called:
+   *    + broadcastPoses
+   *    + transmitCallback
+   */
+  void algorithmCallback(const ros::TimerEvent &timer_event);
+
+  /*  Broadcasts the current poses of all the hosted agents (real and virtual) to the TF ROS environment in a single
+   *  message, at most at tf_rate_ (0 means every sample time).
+   */
+  void broadcastPoses();
+
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the node in a homogeneous format.
+   *
+   *  Parameters:
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
+   */
+  std::string consolePrefix(const std::string &caller_name) const;
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+
+  /*  Unpacks the estimated statistics of a group of agents received in a single message from the shared array topic
+   *  and forwards them one by one to the hosted agents.
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of several agents.
+   *  Other methods called:
+   *    + receivedStatsCallback
+   */
+  void receivedStatsArrayCallback(const formation_control::FormationStatisticsArray &received);
+
+  /*  Forwards the statistics received from the shared topic to all the hosted agents, unless the message has been
+   *  sent by one of them (these statistics have been already handed over in memory).
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of a certain agent.
+   */
+  void receivedStatsCallback(const formation_control::FormationStatisticsStamped &received);
+
+  /*  Converts the compact statistics received from the shared compact topic (see CompactCodec) and forwards them as
+   *  if they were received in the full format.
+   *
+   *  Parameters:
+   *    + received: compact statistics of a certain agent.
+   *  Other methods called:
+   *    + receivedStatsCallback
+   */
+  void receivedStatsCompactCallback(const formation_control::FormationStatisticsCompact &received);
+
+  /*  Forwards the statistics received from the shared predicted topic to all the hosted agents together with their
+   *  time derivative, unless the message has been sent by one of them (see receivedStatsCallback).
+   *
+   *  Parameters:
+   *    + received: a ROS custom message which carries the estimated statistics of a certain agent and their time
+   *      derivative.
+   */
+  void receivedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &received);
+
+  /*  Publishes the estimated statistics of the given hosted agent previously scheduled by algorithmCallback. It is
+   *  called by the one-shot timer of the agent in its TDMA transmission slot (or directly, if the slot has already
+   *  been passed).
+   *
+   *  Parameters:
+   *    + timer_event: a ros::TimerEvent variable automatically filled by ROS (not used, but necessary);
+   *    + index: index of the hosted agent.
+   */
+  void transmitCallback(const ros::TimerEvent &timer_event, const std::size_t &index);
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_SWARM_STATE_H
+#define GUARD_SWARM_STATE_H
+
+#include "agent_core.h"
+
+/*  This class purpose is to step a whole group of agents at once, with the same algorithm of the AgentCore (dynamic
+ *  consensus, control law, LOS guidance and bicycle model), when all of them are driven by the same host (e.g. the
+ *  headless SimulationCore). The state of the agents is stored as a structure of arrays (one contiguous array for
+ *  each pose, twist and statistics component) and each phase of the algorithm is a plain loop over all the agents,
+ *  without any message, quaternion or per-agent matrix in between: the compiler can vectorize most of the loops and
+ *  the whole step is cache friendly even with tens of thousands of agents.
+ *
+ *  The agents are loaded from (headless) AgentCore objects, thus they share exactly the same params, and they must
+ *  share the same gains (those of the first loaded agent are used). The estimated statistics are shared all-to-all
+ *  at the end of each step (i.e. "all" communication topology): the sum of all the estimates is computed once per
+ *  step, so the consensus is linear in the number of agents. Since the model is planar, the heading is stored as a
+ *  scalar.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class SwarmState {
+ public:
+  /*  The constructor initializes an empty group of agents which share the given gains.
+   *
+   *  Parameters:
+   *    + gains: gains and limits of the algorithm shared by all the agents;
+   *    + verbosity_level: verbosity level of the console messages.
+   */
+  SwarmState(const AgentGains &gains, const int &verbosity_level);
+
+  /*  Appends the given agent to the group copying its current state (poses, twists, estimated and target
+   *  statistics). The agent itself is not modified by the following steps.
+   *
+   *  Parameters:
+   *    + agent: agent to be copied.
+   */
+  void addAgent(const AgentCore &agent);
+
+  /*  Executes a single iteration of the algorithm for all the agents of the group (the same as AgentCore, with all
+   *  the guidance and dynamics steps of the sample time), and shares the new estimated statistics among all of them.
+   *
+   *  Other methods called:
+   *    + consensus
+   *    + control
+   *    + dynamics
+   *    + guidance
+   */
+  void algorithmStep();
+
+  /*  Returns the number of agents in the group.
+   *
+   *  Return value:
+   *    + number of agents.
+   */
+  int getNumberOfAgents() const;
+
+  /*  Returns the x coordinates of all the (real) agents, in the same order they have been added.
+   *
+   *  Return value:
+   *    + contiguous array of x coordinates.
+   */
+  const std::vector<double> &getX() const;
+
+  /*  Returns the y coordinates of all the (real) agents, in the same order they have been added.
+   *
+   *  Return value:
+   *    + contiguous array of y coordinates.
+   */
+  const std::vector<double> &getY() const;
+
+ private:
+  AgentGains gains_;
+  int verbosity_level_;
+  int number_of_agents_;
+  bool shared_;  // false until the first estimates are shared (as the AgentCore, nothing is received at first)
+
+  // real agents
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> theta_;
+  std::vector<double> x_dot_;
+  std::vector<double> y_dot_;
+  std::vector<double> theta_dot_;
+  // virtual agents
+  std::vector<double> x_virtual_;
+  std::vector<double> y_virtual_;
+  std::vector<double> x_dot_virtual_;
+  std::vector<double> y_dot_virtual_;
+  // statistics (mx, my, mxx, mxy, myy)
+  std::vector<double> estimated_statistics_[DEFAULT_NUMBER_OF_STATS];
+  std::vector<double> target_statistics_[DEFAULT_NUMBER_OF_STATS];
+  // guidance commands
+  std::vector<double> speed_command_sat_;
+  std::vector<double> steer_command_sat_;
+
+  /*  Updates the estimated statistics of all the agents with the dynamic discrete consensus of the AgentCore, where
+   *  each agent receives the estimates of all the others.
+   */
+  void consensus();
+
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the group in a homogeneous format.
+   *
+   *  Parameters:
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
+   */
+  std::string consolePrefix(const std::string &caller_name) const;
+
+  /*  Computes the control law of the AgentCore for all the virtual agents and integrates their poses. The system of
+   *  the control law is solved in closed form, since all its matrices are diagonal apart from the jacobian of phi.
+   */
+  void control();
+
+  /*  Integrates the bicycle model of the AgentCore for all the real agents over a single guidance step, with the
+   *  current guidance commands.
+   */
+  void dynamics();
+
+  /*  Computes the LOS guidance commands of the AgentCore for all the real agents.
+   */
+  void guidance();
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_SWEEP_CORE_H
+#define GUARD_SWEEP_CORE_H
+
+#include "simulation_core.h"
+#include "task_pool.h"
+// default values for the sweep settings (if not specified by the user)
+#define DEFAULT_SWEEP_FORMATIONS 1  // random initial formations for each combination of params
+#define DEFAULT_SWEEP_SAMPLES 100  // random combinations of params (random mode only)
+#define DEFAULT_SWEEP_THREADS 0  // 0 means one for each core
+
+// candidate values of a swept agent param (e.g. k_p_speed), each one is a single number or a vector of numbers
+struct SweepParameter {
+  std::string name;
+  std::vector<std::vector<double>> values;
+};
+
+// settings of a whole sweep
+struct SweepSettings {
+  std::vector<int> numbers_of_agents;
+  int formations;  // random initial formations (consecutive seeds) for each combination of params
+  bool random;  // random combinations of the params instead of all of them (grid)
+  int samples;  // number of random combinations (random mode only)
+  unsigned int seed;  // first seed of the initial formations (and seed of the random combinations)
+  int threads;  // not positive means one for each core
+};
+
+// settings and results of a single run of the sweep
+struct SweepRun {
+  SimulationSettings settings;
+  std::vector<std::vector<double>> values;  // value of each swept param
+  SimulationResults results;
+  std::string error;  // what the simulation has thrown, empty if the run has completed
+};
+
+/*  This class purpose is to tune the algorithm gains (e.g. diag_elements_gamma, diag_elements_b, k_p_speed, k_p_steer
+ *  and velocity_virtual_threshold) by running many headless simulations (see SimulationCore) in parallel on all the
+ *  cores, instead of launching the agents by hand one configuration at a time. The runs are all the combinations of
+ *  the candidate values of the swept params (grid) or the given number of random combinations (each scalar param is
+ *  drawn uniformly between its lowest and highest candidate values, each vector param is one of its candidates), for
+ *  each number of agents and for each of the given number of random initial formations (like those of
+ *  demo_5_agents_random.launch, but reproducible given the seed).
+ *
+ *  The runs are executed by a work-stealing pool of threads (see TaskPool): each run owns its agents and its
+ *  simulated time, thus they share nothing but the (read only) settings, and the results are stored in the run itself.
+ *
+ *  For more info on this class usage, check the README.md in the package folder.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class SweepCore {
+ public:
+  /*  The constructor generates all the runs of the sweep (grid or random combinations of the swept params, for each
+   *  number of agents and initial formation), without executing them.
+   *
+   *  Parameters:
+   *    + sweep_settings: settings of the sweep;
+   *    + simulation_settings: settings shared by all the runs (number of agents and seed are set by this class);
+   *    + agent_parameters: params shared by all the agents (the swept ones are set by this class);
+   *    + parameters: swept params and their candidate values.
+   *  Other methods called:
+   *    + addRuns
+   */
+  SweepCore(const SweepSettings &sweep_settings, const SimulationSettings &simulation_settings,
+            const AgentParameters &agent_parameters, const std::vector<SweepParameter> &parameters);
+
+  /*  Returns the swept params.
+   *
+   *  Return value:
+   *    + swept params and their candidate values.
+   */
+  const std::vector<SweepParameter>& getParameters() const;
+
+  /*  Returns all the runs of the sweep (with their results, once executed).
+   *
+   *  Return value:
+   *    + runs of the sweep.
+   */
+  const std::vector<SweepRun>& getRuns() const;
+
+  /*  Executes all the runs of the sweep in parallel and stores their results.
+   *
+   *  Other methods called:
+   *    + getAgentParameters
+   */
+  void run();
+
+ private:
+  SweepSettings sweep_settings_;
+  AgentParameters agent_parameters_;
+  std::vector<SweepParameter> parameters_;
+  std::vector<SweepRun> runs_;
+  int verbosity_level_;
+
+  /*  Adds the runs of the given combination of params, i.e. one for each number of agents and initial formation.
+   *
+   *  Parameters:
+   *    + simulation_settings: settings shared by all the runs;
+   *    + values: value of each swept param.
+   */
+  void addRuns(const SimulationSettings &simulation_settings, const std::vector<std::vector<double>> &values);
+
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the sweep in a homogeneous format.
+   *
+   *  Parameters:
+   *    + caller_name: name of the method which displays the message.
+   *  Return value:
+   *    + prefix of the message (class and method names).
+   */
+  std::string consolePrefix(const std::string &caller_name) const;
+
+  /*  Returns the params of the agents of the given run, i.e. the shared ones overridden by the swept ones.
+   *
+   *  Parameters:
+   *    + run: run of the sweep.
+   *  Return value:
+   *    + params of the agents.
+   */
+  AgentParameters getAgentParameters(const SweepRun &run) const;
+
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_TASK_POOL_H
+#define GUARD_TASK_POOL_H
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*  This class purpose is to execute many independent tasks (identified by their index, e.g. the runs of a parameter
+ *  sweep) on all the cores with a work-stealing scheduling: the tasks are split in contiguous blocks among the worker
+ *  threads, each worker executes its own tasks from the back of its queue and, when it runs out of them, it steals
+ *  the tasks from the front of the queues of the other workers. Thus the workers stay busy until the very end even if
+ *  the tasks have very different lengths (e.g. simulations with 5 and 1000 agents), while they rarely contend the same
+ *  queue (each queue has its own mutex, held only to pop a single task).
+ *
+ *  It is header-only and has no ROS dependency. The tasks can't add other tasks, and they must be thread safe w.r.t.
+ *  each other (e.g. each one stores its results in its own slot of a preallocated vector). A task that throws doesn't
+ *  stop the others: its exception is caught by the worker and returned to the caller at the end of the run.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class TaskPool {
+ public:
+  /*  The constructor only sets the number of worker threads (the threads are started by each run).
+   *
+   *  Parameters:
+   *    + number_of_threads: number of worker threads (not positive means one for each core).
+   */
+  explicit TaskPool(const int &number_of_threads);
+
+  /*  Returns the number of worker threads.
+   *
+   *  Return value:
+   *    + number of worker threads.
+   */
+  int getNumberOfThreads() const;
+
+  /*  Executes the given task for all the indices in range [0, number_of_tasks) on the worker threads, and returns
+   *  when all of them are completed (or failed).
+   *
+   *  Parameters:
+   *    + number_of_tasks: number of tasks;
+   *    + task: function called with the index of each task.
+   *  Other methods called:
+   *    + popTask
+   *  Return value:
+   *    + exception thrown by each task (null if it has completed), to be rethrown by the caller.
+   */
+  std::vector<std::exception_ptr> run(const int &number_of_tasks, const std::function<void(const int &)> &task);
+
+ private:
+  struct WorkerQueue {
+    std::deque<int> tasks;
+    std::mutex mutex;
+  };
+
+  int number_of_threads_;
+
+  /*  Pops the next task of the given worker: the last one of its own queue or, if empty, the first one of the queue
+   *  of another worker (in order, starting from the following one).
+   *
+   *  Parameters:
+   *    + queues: queues of all the workers;
+   *    + worker: index of the worker;
+   *    + task: index of the task passed by reference (i.e. used by the caller).
+   *  Return value:
+   *    + false if all the queues are empty.
+   */
+  bool popTask(std::vector<WorkerQueue> &queues, const int &worker, int &task) const;
+};
+
+inline TaskPool::TaskPool(const int &number_of_threads) {
+  number_of_threads_ = number_of_threads;
+  if (number_of_threads_ <= 0) {
+    number_of_threads_ = std::max((int)std::thread::hardware_concurrency(), 1);
+  }
+}
+
+inline int TaskPool::getNumberOfThreads() const {
+  return number_of_threads_;
+}
+
+inline bool TaskPool::popTask(std::vector<WorkerQueue> &queues, const int &worker, int &task) const {
+  WorkerQueue &own = queues.at(worker);
+  own.mutex.lock();
+  bool found = !own.tasks.empty();
+  if (found) {
+    task = own.tasks.back();
+    own.tasks.pop_back();
+  }
+  own.mutex.unlock();
+
+  for (int i = 1; i < (int)queues.size() && !found; i++) {
+    WorkerQueue &victim = queues.at((worker + i) % queues.size());
+    victim.mutex.lock();
+    found = !victim.tasks.empty();
+    if (found) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+    }
+    victim.mutex.unlock();
+  }
+  return found;
+}
+
+inline std::vector<std::exception_ptr> TaskPool::run(const int &number_of_tasks,
+                                                     const std::function<void(const int &)> &task) {
+  int number_of_workers = std::max(std::min(number_of_threads_, number_of_tasks), 1);
+  std::vector<WorkerQueue> queues(number_of_workers);
+  for (int i = 0; i < number_of_tasks; i++) {
+    // contiguous blocks: each worker executes its own block in order, while the others steal from its end
+    queues.at((long)i*number_of_workers/number_of_tasks).tasks.push_front(i);
+  }
+
+  std::vector<std::exception_ptr> errors(std::max(number_of_tasks, 0));
+  auto worker_loop = [&](const int &worker) {
+    int index;
+    while (popTask(queues, worker, index)) {
+      try {
+        task(index);
+      }
+      catch (...) {
+        // an exception escaping a worker thread would terminate the whole process (each task has its own slot)
+        errors.at(index) = std::current_exception();
+      }
+    }
+  };
+
+  // the calling thread is the first worker
+  std::vector<std::thread> workers;
+  for (int worker = 1; worker < number_of_workers; worker++) {
+    workers.push_back(std::thread(worker_loop, worker));
+  }
+  worker_loop(0);
+  for (auto &thread : workers) {
+    thread.join();
+  }
+  return errors;
+}
+
+#endif
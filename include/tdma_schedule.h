@@ -0,0 +1,92 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUARD_TDMA_SCHEDULE_H
+#define GUARD_TDMA_SCHEDULE_H
+
+#include <algorithm>
+#include <cmath>
+
+/*  This class purpose is to collect the TDMA schedule shared by the agents (which transmit in their slot) and by the
+ *  nodes which check the arrivals (see LinkMonitor): the first slot of each frame is reserved for the computation of
+ *  all the agents and the agent N speaks in the N+1th one, wrapped around if the agents exceed the slots. All the
+ *  methods are static.
+ *
+ *  It is header-only and has no ROS dependency.
+ *
+ *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
+ */
+class TdmaSchedule {
+ public:
+  /*  Computes the TDMA frame which fits an integer number of times in the sample time, so that each algorithm step
+   *  starts at the same offset of a frame and the slots do not drift: the given frame is kept if the ratio is an
+   *  integer within the same tolerance of getNumberOfSlots, otherwise the closest exact fraction of the sample time
+   *  is returned (the sample time itself if the frame is longer).
+   *
+   *  Parameters:
+   *    + sample_time: sample time of the algorithm in seconds;
+   *    + frame_tdma: requested length of the TDMA frame in seconds.
+   *  Return value:
+   *    + length of the frame in seconds (the requested one if any of the given lengths is not positive).
+   */
+  static double getFrame(const double &sample_time, const double &frame_tdma);
+
+  /*  Computes the number of whole slots in a TDMA frame. The default slot (frame/(N+1)) is not exact in floating
+   *  point, thus the ratio is rounded to the closest integer when it is within a small tolerance of it.
+   *
+   *  Parameters:
+   *    + frame_tdma: length of the TDMA frame in seconds;
+   *    + slot_tdma: length of a TDMA slot in seconds.
+   *  Return value:
+   *    + number of slots (0 if the slot is not positive).
+   */
+  static int getNumberOfSlots(const double &frame_tdma, const double &slot_tdma);
+
+  /*  Computes the transmission slot of the given agent.
+   *
+   *  Parameters:
+   *    + agent_id: id of the agent (expected to start from 1);
+   *    + number_of_slots: number of slots in the TDMA frame (at least 2).
+   *  Return value:
+   *    + index of the slot in range [1, number_of_slots - 1].
+   */
+  static int getSlot(const int &agent_id, const int &number_of_slots);
+
+ private:
+  static constexpr double SLOTS_TOLERANCE = 1e-6;  // relative to a slot
+};
+
+inline double TdmaSchedule::getFrame(const double &sample_time, const double &frame_tdma) {
+  if (!(sample_time > 0) || !(frame_tdma > 0)) {
+    return frame_tdma;
+  }
+  double frames = sample_time/frame_tdma;
+  double rounded = std::max(std::round(frames), 1.0);
+  if (std::abs(frames - rounded) <= SLOTS_TOLERANCE) {
+    return frame_tdma;
+  }
+  return sample_time/rounded;
+}
+
+inline int TdmaSchedule::getNumberOfSlots(const double &frame_tdma, const double &slot_tdma) {
+  if (slot_tdma <= 0) {
+    return 0;
+  }
+  return std::floor(frame_tdma/slot_tdma + SLOTS_TOLERANCE);
+}
+
+inline int TdmaSchedule::getSlot(const int &agent_id, const int &number_of_slots) {
+  return 1 + (agent_id - 1)%(number_of_slots - 1);
+}
+
+#endif
@@ -15,11 +15,44 @@
 #define GUARD_VISUALIZATION_CORE_H
 
 #include "commons.h"
+#include "agent_registry.h"
+#include "compact_codec.h"
+#include "link_monitor.h"
+#include "moments_accumulator.h"
+#include "spatial_grid.h"
+#include "stats_geometry.h"
 // default values for ROS params (if not specified by the user)
 #define DEFAULT_MARKER_DIST_MIN 0
 #define DEFAULT_MARKER_DIST_MAX 0.5
 #define DEFAULT_MARKER_STEER_MIN -0.52
 #define DEFAULT_MARKER_STEER_MAX 0.52
+#define DEFAULT_TF_TOPIC "/tf"
+#define DEFAULT_ELLIPSE_POSITION_TOLERANCE 0.005  // expressed in meters
+#define DEFAULT_ELLIPSE_ANGLE_TOLERANCE 0.01  // expressed in radians
+#define DEFAULT_ELLIPSE_DIAMETER_TOLERANCE 0.005  // expressed in meters
+#define DEFAULT_ELLIPSE_REFRESH_PERIOD 1.0  // expressed in seconds (0 means that unchanged ellipses are never refreshed)
+#define DEFAULT_TARGET_RATE 10.0  // expressed in hertz (0 means that every change is published)
+#define DEFAULT_GRID_CELL_SIZE 0  // expressed in meters (0 means that it is chosen from the density of the agents)
+#define DEFAULT_PROXIMITY_DISTANCE 0  // expressed in meters (0 means that the proximity is not monitored)
+#define DEFAULT_AGENT_TIMEOUT 5.0  // expressed in seconds (0 means that silent agents are never evicted)
+#define DEFAULT_INGEST_THREADS 2  // spinner threads of the statistics and poses callbacks
+
+// last known pose of an agent frame (real or virtual), stored in dense tables indexed by the agent id
+struct AgentPose {
+  geometry_msgs::Pose pose;
+  ros::Time stamp;
+  bool valid;
+};
+
+// geometry of the last published ellipse of a frame (see updateSpanningEllipse)
+struct EllipseState {
+  double x;
+  double y;
+  double theta;
+  double diameter_x;
+  double diameter_y;
+  ros::Time last_publish;
+};
 
 /*  This class purpose is to provide a ROS interface (using rviz) which lets to visualize and guide a swarm of agents
  *  generated by the AgentCore class and which evolves through a consensus based completely distributed algorithm.
@@ -38,6 +71,54 @@
  *  callbacks on the data produced by the single agent (i.e. it is most AgentCore driven, except for the control of
  *  the target statistics, for which this class is the master).
  *
+ *  With a neighbor-limited communication topology (see AgentCore), this class subscribes to the topics of all the
+ *  agents (from 1 to number_of_agents) and, in the case of the k-nearest-neighbor graph, it is also the one which
+ *  assigns the neighbors to each agent, based on the current distances between the (real) agents. The distances are
+ *  not computed between every pair of agents: every sample time the poses are bucketed in a uniform grid (see
+ *  SpatialGrid, with grid_cell_size side of the cells) and only the agents in the cells around each one are compared.
+ *  The same grid is used to monitor the proximity of the agents: the pairs of real agents closer than
+ *  proximity_distance (0 means never) are reported on the diagnostics topic, together with the minimum distance.
+ *
+ *  The agents are connected when their first statistics are received and they are evicted when silent for longer
+ *  than agent_timeout (see AgentRegistry, which is indexed by agent id): only the connected agents are considered in
+ *  the effective ellipses and in the neighbor assignment, and the poses and the ellipse of an evicted agent are
+ *  dropped. When an agent (re)joins, the current target statistics are sent only to it, on its own latched target
+ *  topic (e.g. target_stats/agent_1), while the changes of the target are still published to all the agents on the
+ *  target topic, which is latched as well (an agent restarted before its eviction does not rejoin).
+ *
+ *  The poses of the real and virtual agents are stored on receipt (from the tf messages broadcasted by the agents and
+ *  from the agent_poses topic) in dense tables indexed by the agent id, thus the effective statistics are computed
+ *  without querying the tf tree (there is no tf listener, each tf message is parsed only once).
+ *
+ *  All the transforms broadcasted by this class (agent poses received from the agent_poses topic and ellipses) are
+ *  queued and sent together in a single message at tf_rate (0 means every sample time): only the last transform of
+ *  each frame is kept, thus the tf traffic does not depend on the rate of the statistics messages.
+ *
+ *  An ellipse (marker and transform) is republished only when its geometry has changed by more than the given
+ *  tolerances (see ellipse_position_tolerance, ellipse_angle_tolerance and ellipse_diameter_tolerance params) or when
+ *  it has not been republished for ellipse_refresh_period (e.g. for a late rviz). Likewise, the target statistics
+ *  changed through the interactive markers are coalesced and published to the agents at most at target_rate (the last
+ *  one is always published when the mouse is released), so that a drag can't flood the target topic.
+ *
+ *  With compact_statistics enabled, the statistics of the agents are received in the compact format from the shared
+ *  compact topic (see CompactCodec). With predict_statistics enabled instead, they are received from the shared
+ *  predicted topic and their time derivative is discarded.
+ *
+ *  This class also serves the sync service of the standalone agents without an explicit id (see AgentCore and
+ *  SyncAgent.srv): it assigns them compact ids (from 1 to number_of_agents) and a common start of the algorithm,
+ *  aligned to the TDMA frames (frame_tdma), sync_delay after the first request, so that the whole swarm comes up with
+ *  a single request per agent and starts in the same TDMA frame.
+ *
+ *  The end-to-end latency, the inter-arrival jitter and the arrivals outside the TDMA slot of the statistics shared
+ *  by each agent (see LinkMonitor, with frame_tdma and slot_tdma equal to those of the agents) are published on the
+ *  diagnostics topic at diagnostics_rate (0 means never).
+ *
+ *  The callbacks are split in separate queues, each one with its own spinner threads, so that a burst of messages
+ *  from a large swarm never delays the algorithm timer nor the operator: the statistics, the agent poses and the tf
+ *  messages are handled by ingest_threads threads (they only update the registry and the dense pose tables), the
+ *  algorithm timer (effective ellipses, eviction and neighbors) by a single thread, and the interactive markers by
+ *  the thread of their server. The node spinner serves the rest (sync service, tf and diagnostics timers).
+ *
  *  For more info on this class usage, check the README.md in the package folder.
  *
  *  If you edit this class, please try to follow these C++ style guidelines: http://wiki.ros.org/CppStyleGuide.
@@ -46,11 +127,28 @@
  *    + sample_time
  *    + number_of_agents
  *    + verbosity_level
+ *    + communication_topology
+ *    + number_of_neighbors
  *    + topic_queue_length
  *    + shared_stats_topic
+ *    + shared_stats_array_topic
+ *    + shared_stats_compact_topic
+ *    + shared_stats_predicted_topic
+ *    + compact_statistics
+ *    + compact_resolution
+ *    + predict_statistics
  *    + target_stats_topic
  *    + agent_poses_topic
+ *    + tf_topic
+ *    + tf_rate
+ *    + frame_tdma
+ *    + slot_tdma
+ *    + diagnostics_topic
+ *    + diagnostics_rate
+ *    + neighbors_topic
  *    + marker_topic
+ *    + sync_service
+ *    + sync_delay
  *    + frame_map
  *    + frame_agent_prefix
  *    + frame_effective_prefix
@@ -62,6 +160,15 @@
  *    + marker_dist_max
  *    + marker_steer_min
  *    + marker_steer_max
+ *    + ellipse_position_tolerance
+ *    + ellipse_angle_tolerance
+ *    + ellipse_diameter_tolerance
+ *    + ellipse_refresh_period
+ *    + target_rate
+ *    + grid_cell_size
+ *    + proximity_distance
+ *    + agent_timeout
+ *    + ingest_threads
  *    + target_statistics
  *    + target_from_physics
  */
@@ -70,43 +177,96 @@ class VisualizationCore {
   /*  The constructor retrieves some settings parameters from ROS params if specified by the user (default values
    *  otherwise), initializes all the target statistics with values provided by the user (e.g. using the default 
    *  configuration file, visualization_initialization.yaml) and the publishers and subscribers needed. Lastly, it
-   *  initializes also 3 interacrive markers, which are used in rviz to move the target statistics in the 2D space.
+   *  initializes also 3 interacrive markers, which are used in rviz to move the target statistics in the 2D space,
+   *  and it starts the spinners of the ingest and algorithm callback queues.
    *
    *  Other methods called:
    *    + interactiveMarkerInitialization
    *    + statsVectorPhysicsToMsg
    *    + statsVectorToMsg
+   *    + subscribeStatistics
    *    + updateTarget
    */
   VisualizationCore();
   ~VisualizationCore();
 
  private:
+  static const int MAX_TABLE_AGENT_ID = 65535;  // bounds the size of the dense pose tables (not the compact ids)
+
+  // declared first: the subscribers and timers on them are destroyed before the queues
+  ros::CallbackQueue ingest_queue_;
+  ros::CallbackQueue algorithm_queue_;
   ros::NodeHandle node_handle_;
   ros::NodeHandle *private_node_handle_;
+  ros::NodeHandle ingest_node_handle_;  // statistics, agent poses and tf messages
+  ros::NodeHandle algorithm_node_handle_;  // algorithm timer
+  ros::AsyncSpinner *ingest_spinner_;
+  ros::AsyncSpinner *algorithm_spinner_;
+  int ingest_threads_;
   ros::Publisher target_stats_publisher_;
   ros::Publisher marker_publisher_;
+  ros::Publisher diagnostics_publisher_;
   ros::Subscriber stats_subscriber_;
+  ros::Subscriber stats_array_subscriber_;
+  std::vector<double> stats_array_buffer_;  // reused by each array message (no concurrent calls on a subscriber)
+  std::vector<ros::Subscriber> agent_stats_subscribers_;  // only with neighbor-limited topologies
   ros::Subscriber agent_poses_subscriber_;
+  ros::Subscriber tf_subscriber_;
+  std::map<int, ros::Publisher> neighbors_publishers_;  // only with "knn" topology
   ros::Timer algorithm_timer_;
-  tf::TransformListener tf_listener_;
+  ros::Timer tf_timer_;
+  ros::Timer diagnostics_timer_;
   tf::TransformBroadcaster tf_broadcaster_;
+  std::map<std::string, tf::StampedTransform> queued_transforms_;  // last transform of each child frame
+  std::mutex queued_transforms_mutex_;
   interactive_markers::InteractiveMarkerServer *interactive_marker_server_;
 
   double sample_time_;
+  double tf_rate_;
+  double frame_tdma_;
+  double slot_tdma_;
+  double diagnostics_rate_;
   int number_of_agents_;
   int verbosity_level_;
 
+  std::string communication_topology_;
+  int number_of_neighbors_;
+  std::map<int, std::set<int>> neighbors_;  // last neighbors assigned to each agent (only with "knn" topology)
+  double grid_cell_size_;
+  double proximity_distance_;
+  SpatialGrid agent_grid_;  // current positions of the real agents (only with "knn" topology or proximity monitor)
+  std::vector<int> agent_grid_ids_;  // same order of agent_grid_x_ and agent_grid_y_
+  std::vector<double> agent_grid_x_;
+  std::vector<double> agent_grid_y_;
+  int proximity_pairs_;  // pairs of agents closer than proximity_distance_ at the last sample time
+  double proximity_min_distance_;  // minimum distance between two agents at the last sample time
+  std::mutex proximity_mutex_;
+
   geometry_msgs::Pose target_pose_;
   double target_a_x_;
   double target_a_y_;
 
   int topic_queue_length_;
   std::string shared_stats_topic_name_;
+  std::string shared_stats_array_topic_name_;
+  std::string shared_stats_compact_topic_name_;
+  std::string shared_stats_predicted_topic_name_;
+  bool compact_statistics_;
+  bool predict_statistics_;
+  CompactCodec compact_codec_;
   std::string target_stats_topic_name_;
   std::string agent_poses_topic_name_;
+  std::string tf_topic_name_;
+  std::string neighbors_topic_name_;
   std::string marker_topic_name_;
   std::string sync_service_name_;
+  ros::ServiceServer sync_server_;
+  double sync_delay_;
+  ros::Time sync_start_time_;  // fixed by the first sync request
+  std::set<int> sync_available_ids_;  // from 1 to number_of_agents_
+  std::map<std::string, int> sync_node_ids_;  // agent id assigned to each node
+  std::mutex sync_mutex_;
+  std::string diagnostics_topic_name_;
 
   std::string frame_map_;
   std::string frame_agent_prefix_;
@@ -117,19 +277,44 @@ class VisualizationCore {
   std::string frame_target_ellipse_;
 
   formation_control::FormationStatisticsStamped target_statistics_;
+  double target_rate_;
+  bool target_pending_;  // target statistics changed but not published yet (see publishTargetStats)
+  ros::Time last_target_publish_;
+  std::mutex target_mutex_;
   std::vector<formation_control::FormationStatisticsStamped> shared_statistics_grouped_;
-  std::vector<int> connected_agents_;
+  AgentRegistry connected_agents_;  // ids up to MAX_TABLE_AGENT_ID
+  std::mutex connected_agents_mutex_;
+  double agent_timeout_;
+  unsigned long evicted_agents_;  // since the beginning
+  std::map<int, ros::Publisher> agent_target_publishers_;  // latched, of the agents joined at least once
+  LinkMonitor link_monitor_;  // ids up to number_of_agents_
+  std::vector<AgentPose> agent_poses_;  // indexed by agent id
+  std::vector<AgentPose> agent_virtual_poses_;  // indexed by agent id
+  MomentsAccumulator agent_moments_;  // effective statistics of the agent_poses_ table
+  MomentsAccumulator agent_virtual_moments_;  // effective statistics of the agent_virtual_poses_ table
+  std::mutex agent_poses_mutex_;
 
   double marker_dist_min_;
   double marker_dist_max_;
   double marker_steer_min_;
   double marker_steer_max_;
+  double ellipse_position_tolerance_;
+  double ellipse_angle_tolerance_;
+  double ellipse_diameter_tolerance_;
+  double ellipse_refresh_period_;
+  std::map<std::string, EllipseState> ellipses_;  // last published ellipse of each frame
+  std::mutex ellipses_mutex_;
 
 
-  /*  Broadcasts the given agent pose to the tf with the proper frame name (agent id dependent).
+  /*  Queues the given agent pose for the tf with the proper frame name (agent id dependent) and stores it in the
+   *  pose table of the agent.
    *
    *  Parameters:
    *    + pose: pose of the agent (paired with a header and its id).
+   *  Other methods called:
+   *    + parseAgentFrame
+   *    + queueTransform
+   *    + storeAgentPose
    */
   void agentPosesCallback(const geometry_msgs::PoseStamped &pose);
 
@@ -138,62 +323,76 @@ class VisualizationCore {
    *  known globally only by an external node like this one). The aim is to show that the effective ellipse of real
    *  and virtual agents are close to their estimation, and eventually also to the target ellipse (on convergence).
    *
+   *  The target statistics coalesced since the last publication are also published, if still pending.
+   *
    *  Parameters:
    *    + timer_event: ROS structure which stores the timer info (not used in this case).
    *  Other methods called:
+   *    + assignNeighbors
    *    + computeEffectiveEllipse
+   *    + evictAgents
+   *    + monitorProximity
+   *    + publishTargetStats
+   *    + updateAgentGrid
    */
   void algorithmCallback(const ros::TimerEvent &timer_event);
 
-  /*  Computes the "generalized diameter" starting from the given real diameter of the ellipse.
-   *
-   *  Parameters:
-   *    + diameter: represents one of the two diameters of the ellipse.
-   *  Return value:
-   *    + the so called "generalized diameter".
-   */
-  double computeA(const double &diameter) const;
-
-  /*  Computes the real diameter of the ellipse starting from the given "generalized diameter".
+  /*  Computes the k-nearest-neighbor communication graph from the current positions of the real agents (see
+   *  updateAgentGrid) and publishes the new neighbors to the agents whose neighbors have changed. The graph is made
+   *  undirected (if an agent is one of the nearest neighbors of another one, they are linked both ways) to preserve
+   *  the average consensus.
    *
-   *  Parameters:
-   *    + a: the so called "generalized diameter" (it is proportional to the real diameter).
-   *  Return value:
-   *    + diameter of the ellipse.
+   *  Other methods called:
+   *    + getAgentTopic
    */
-  double computeDiameter(const double &a) const;
+  void assignNeighbors();
 
-  /*  Retrieves all the current poses of real or virtual agents (depending on the given parameter) from tf, computes
-   *  their current (and effective) formation statistics and updates the proper (effective) spanning ellipse.
-   *  The word "effective" is used to distinguish the real formation statistics from the agent estimates.
+  /*  Retrieves the current (and effective) formation statistics of real or virtual agents (depending on the given
+   *  parameter) and updates the proper (effective) spanning ellipse. The statistics are kept up to date by the moments
+   *  accumulators of the pose tables, which hold only the connected agents (see storeAgentPose and evictAgents). The
+   *  word "effective" is used to distinguish the real formation statistics from the agent estimates.
    *
    *  Parameters:
    *    + frame_suffix: distinguishes between real and virtual effective ellipses.
    *  Other methods called:
-   *    + computeStatsFromPoses
    *    + updateSpanningEllipse
    */
   void computeEffectiveEllipse(const std::string &frame_suffix);
 
-  /*  Computes the formation statistics (momentums of first and second order) of a given group of agents.
+  /*  Returns the prefix of the messages displayed by the CONSOLE_STREAM macro (see commons.h), which is used by all
+   *  the other methods to show errors, warnings and useful info about the state of the node in a homogeneous format.
    *
    *  Parameters:
-   *    + poses: vector containing the pose of all the agents (or virtual agents).
+   *    + caller_name: name of the method which displays the message.
    *  Return value:
-   *    + effective statistics of the given formation (real or virtual agents).
+   *    + prefix of the message (class and method names).
    */
-  formation_control::FormationStatistics computeStatsFromPoses(const std::vector<geometry_msgs::Pose> &poses) const;
+  std::string consolePrefix(const std::string &caller_name) const;
 
-  /*  Displays a message with a specific log level, using the proper ROS MACRO. This method is used by all the others
-   *  to show errors, warnings and useful info about the state of the node in a homogeneous format; it provides also
-   *  five distinct verbosity levels for debug info (e.g. to investigate specific variables and the flow of the code).
+  /*  Publishes the latency, jitter and out-of-slot arrivals of the statistics shared by each agent (see LinkMonitor)
+   *  on the diagnostics topic, together with the number of connected and evicted agents and the proximity of the
+   *  agents (see monitorProximity) if enabled. It is automatically called by a timer event at diagnostics_rate_.
    *
    *  Parameters:
-   *    + caller_name: name of the method which calls this one;
-   *    + message: stream to be sent to the console;
-   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *    + timer_event: ROS structure which stores the timer info (not used in this case).
+   */
+  void diagnosticsCallback(const ros::TimerEvent &timer_event);
+
+  /*  Evicts the agents which have not shared their statistics for longer than agent_timeout_ (see AgentRegistry):
+   *  their poses are removed from the pose tables (and from their moments accumulators) and their ellipses are
+   *  deleted.
    */
-  void console(const std::string &caller_name, std::stringstream &message, const int &log_level) const;
+  void evictAgents();
+
+  /*  Returns the name of the topic dedicated to the given agent (e.g. shared_stats/agent_1).
+   *
+   *  Parameters:
+   *    + topic: base name of the topic;
+   *    + id: agent id.
+   *  Return value:
+   *    + agent specific topic name.
+   */
+  std::string getAgentTopic(const std::string &topic, const int &id) const;
 
   /*  When an interactive marker is moved in rviz, this callback is called. It updates the target ellipse accordingly
    *  to which marker has been moved: the two diameters can be just stretched, while the pose has a sort of dynamics
@@ -203,10 +402,11 @@ class VisualizationCore {
    *  Parameters:
    *    + feedback: interactive marker feedback structure which stores all its info (current pose, ...).
    *  Other methods called:
-   *    + computeA
    *    + interactiveMarkerGuidance
-   *    + physicsToStats
+   *    + publishTargetStats
    *    + updateTarget
+   *    + StatsGeometry::computeA
+   *    + StatsGeometry::ellipseToStats
    */
   void interactiveMarkerCallback(const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback);
 
@@ -225,14 +425,46 @@ class VisualizationCore {
    *  its border to change its diameters.
    *
    *  Other methods called:
-   *    + computeDiameter
    *    + makeInteractiveMarkerAxis
    *    + makeInteractiveMarkerPose
-   *    + saturation
-   *    + statsToPhysics
+   *    + StatsGeometry::computeDiameter
+   *    + StatsGeometry::statsToEllipse
    */
   void interactiveMarkerInitialization();
 
+  /*  Checks whether the messages with the given log level have to be displayed: errors, warnings and info are always
+   *  shown, while there are five distinct verbosity levels for debug info (e.g. to investigate specific variables and
+   *  the flow of the code). It is used by the CONSOLE_STREAM macro before any formatting of the message.
+   *
+   *  Parameters:
+   *    + log_level: integer in range [-3, 5] respectively from fatal to very verbose debug messages.
+   *  Return value:
+   *    + true if the message has to be displayed.
+   */
+  bool isConsoleEnabled(const int &log_level) const;
+
+  /*  Checks whether the given ellipse has to be republished w.r.t. the last published one of the same frame: its
+   *  geometry has changed by more than the tolerances or the last publication is older than ellipse_refresh_period_.
+   *
+   *  Parameters:
+   *    + old: last published ellipse;
+   *    + current: new ellipse;
+   *    + now: current time.
+   *  Return value:
+   *    + true if the ellipse has to be republished.
+   */
+  bool isEllipseChanged(const EllipseState &old, const EllipseState &current, const ros::Time &now) const;
+
+  /*  Retrieves the current poses of all the connected real or virtual agents (depending on the given parameter) from
+   *  the pose tables. The agents whose pose has not been stored yet are skipped.
+   *
+   *  Parameters:
+   *    + frame_suffix: distinguishes between real and virtual agents.
+   *  Return value:
+   *    + map of the agent poses with the agent id as key.
+   */
+  std::map<int, geometry_msgs::Pose> lookupAgentPoses(const std::string &frame_suffix);
+
   /*  Builds a simple gray cube (visualization_msgs::Marker::CUBE) on rviz with the given scale factor.
    *
    *  Parameters:
@@ -284,18 +516,82 @@ class VisualizationCore {
    */
   void makeInteractiveMarkerPose(const geometry_msgs::Pose &pose);
 
-  /*  Computes the statistics from the ellipse described by its geometric variables: the 2D pose of its center and the
-   *  length of its diameters (a_x and a_y are not properly the diameters, let's call them "generalized diameters").
+  /*  Counts the pairs of real agents closer than proximity_distance_ and finds the minimum distance between two
+   *  agents from their current positions (see updateAgentGrid), warning when the close pairs increase. Note that it is
+   *  necessary to use a mutex protection on the results because they are read by the diagnostics timer.
+   */
+  void monitorProximity();
+
+  /*  Extracts the agent id from the given frame name (e.g. agent_1 or agent_1_virtual) and checks whether it belongs
+   *  to a real or a virtual agent. The other frames (e.g. ellipses) are discarded.
    *
    *  Parameters:
-   *    + pose: 2D pose of the center of the ellipse representing the given statistics.
-   *    + a_x: "generalized diameter" of the ellipse.
-   *    + a_y: "generalized diameter" of the ellipse.
+   *    + frame: name of the frame (a leading '/' is ignored);
+   *    + id: agent id passed by reference (i.e. used by the caller);
+   *    + is_virtual: true for a virtual agent frame, passed by reference (i.e. used by the caller).
    *  Return value:
-   *    + it is either the target statistics or an agent current estimate statistics.
+   *    + true if the frame belongs to a (real or virtual) agent.
    */
-  formation_control::FormationStatistics physicsToStats(const geometry_msgs::Pose &pose, const double &a_x,
-                                                        const double &a_y) const;
+  bool parseAgentFrame(const std::string &frame, int &id, bool &is_virtual) const;
+
+  /*  Adds the given statistics to the link monitor, marks the agent as seen (see connected_agents_) and publishes
+   *  the given spanning ellipse of the agent. If the agent has just (re)joined, it also sends the target statistics
+   *  to it (and only to it).
+   *
+   *  Parameters:
+   *    + shared: an agent current estimate statistics with header and id;
+   *    + slot_check: whether the statistics are expected in the TDMA slot of the agent (see LinkMonitor);
+   *    + ellipse: ellipse of the given statistics (see StatsGeometry).
+   *  Other methods called:
+   *    + publishAgentTarget
+   *    + publishSpanningEllipse
+   */
+  void processSharedStats(const formation_control::FormationStatisticsStamped &shared, const bool &slot_check,
+                          const StatsEllipse &ellipse);
+
+  /*  Publishes the current target statistics on the target topic of the given agent (advertised and latched the
+   *  first time, so that a late subscription of the agent gets them anyway).
+   *
+   *  Parameters:
+   *    + id: agent id.
+   *  Other methods called:
+   *    + getAgentTopic
+   */
+  void publishAgentTarget(const int &id);
+
+  /*  Queues the pose of the given ellipse for the next tf broadcast and publishes its marker (see makeEllipse), only
+   *  if it has changed w.r.t. the last published one of the same frame (see isEllipseChanged). Note that it is
+   *  necessary to use a mutex protection on the last published ellipses because they are shared among threads.
+   *
+   *  Parameters:
+   *    + frame: frame of the ellipse;
+   *    + id: to distinguish between agents (each one has its own ellipse of it estimate statistics);
+   *    + ellipse: 2D pose of the center and "generalized diameters" of the ellipse.
+   *  Other methods called:
+   *    + isEllipseChanged
+   *    + makeEllipse
+   *    + queueTransform
+   *    + StatsGeometry::computeDiameter
+   */
+  void publishSpanningEllipse(const std::string &frame, const int &id, const StatsEllipse &ellipse);
+
+  /*  Publishes the pending target statistics (see updateTargetStats) in the proper (predefined) topic, if target_rate_
+   *  allows it (otherwise they stay pending). It has the effect to provide to all the agents (which are subscribed to
+   *  this topic) the new target statistics.
+   *
+   *  Parameters:
+   *    + force: whether the pending target statistics are published regardless of target_rate_.
+   */
+  void publishTargetStats(const bool &force);
+
+  /*  Queues the given transform for the next tf broadcast, replacing the one of the same child frame if it has not
+   *  been sent yet. Note that it is necessary to use a mutex protection on the queue because it is shared among
+   *  threads.
+   *
+   *  Parameters:
+   *    + transform: transform to be broadcasted.
+   */
+  void queueTransform(const tf::StampedTransform &transform);
 
   /*  Computes the saturation of the given value w.r.t. the provided thresholds.
    *
@@ -308,49 +604,47 @@ class VisualizationCore {
    */
   double saturation(const double &value, const double &min, const double &max) const;
 
-  /*  Updates the spanning ellipse of a specific agent from its current estimate statistics received from the shared
-   *  topic. If it is the first statistics received from a certain agent, it also broadcasts the target statistics to
-   *  all the agents to let the new one knows it.
+  /*  Unpacks the estimated statistics of a group of agents (e.g. all the agents hosted by a SwarmCore) received in a
+   *  single message from the shared array topic, converts all of them to ellipses in a single batch (see
+   *  StatsGeometry::statsToEllipses) and processes them one by one as if they were received separately. The batch
+   *  arrays are kept in a member buffer, which grows only with the largest array received.
+   *
+   *  Parameters:
+   *    + shared: a ROS custom message which carries the estimated statistics of several agents.
+   *  Other methods called:
+   *    + processSharedStats
+   */
+  void sharedStatsArrayCallback(const formation_control::FormationStatisticsArray &shared);
+
+  /*  Processes the current estimate statistics of a specific agent received from the shared topic (see
+   *  processSharedStats).
    *
    *  Parameters:
    *    + shared: an agent current estimate statistics with header and id.
    *  Other methods called:
-   *    + updateSpanningEllipse
-   *    + updateTarget
+   *    + processSharedStats
    */
   void sharedStatsCallback(const formation_control::FormationStatisticsStamped &shared);
 
-  /*  Computes the 2D pose of the center of the ellipse from the given statistics vector and fills the "generalized
-   *  diameters" (a_x and a_y) which are passed by reference to this method.
+  /*  Converts the compact statistics received from the shared compact topic (see CompactCodec) and processes them as
+   *  if they were received in the full format (see processSharedStats).
    *
    *  Parameters:
-   *    + stats: an agent current estimate statistics (target statistics are handled with the other method).
-   *    + a_x: "generalized diameter" of the ellipse passed by reference (i.e. used by the caller).
-   *    + a_y: "generalized diameter" of the ellipse passed by reference (i.e. used by the caller).
+   *    + shared: compact statistics of a certain agent.
    *  Other methods called:
-   *    + statsToPhysics
-   *  Return value:
-   *    + 2D pose of the center of the ellipse representing the given statistics.
+   *    + processSharedStats
    */
-  tf::Pose statsToPhysics(const formation_control::FormationStatistics &stats, double &a_x, double &a_y);
+  void sharedStatsCompactCallback(const formation_control::FormationStatisticsCompact &shared);
 
-  /*  Computes the 2D pose of the center of the ellipse from the given statistics vector and fills the "generalized
-   *  diameters" (a_x and a_y) which are passed by reference to this method. Only in the case of target statistics, a
-   *  correction on the yaw term of the pose is necessary to ensure that the angle belongs to [-pi,pi] to avoid an
-   *  annoing discontinuity of the pose of the interactive markers "attached" to the target ellipse.
+  /*  Processes the current estimate statistics of a specific agent received from the shared predicted topic, without
+   *  their time derivative (see processSharedStats).
    *
    *  Parameters:
-   *    + stats: it is either the target statistics or an agent current estimate statistics.
-   *    + a_x: "generalized diameter" of the ellipse passed by reference (i.e. used by the caller).
-   *    + a_y: "generalized diameter" of the ellipse passed by reference (i.e. used by the caller).
-   *    + theta_old: represent the previous orientation of the target ellipse (it must be nan otherwise).
+   *    + shared: an agent current estimate statistics with header, id and time derivative.
    *  Other methods called:
-   *    + thetaCorrection
-   *  Return value:
-   *    + 2D pose of the center of the ellipse representing the given statistics.
+   *    + processSharedStats
    */
-  tf::Pose statsToPhysics(const formation_control::FormationStatistics &stats, double &a_x, double &a_y,
-                          const double &theta_old);
+  void sharedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &shared);
 
   /*  Convetrs statistics from std::vector<double> ellipse geometry data vector to
    *  formation_control::FormationStatistics ROS message.
@@ -358,8 +652,8 @@ class VisualizationCore {
    *  Parameters:
    *    + vector: data is stored in the following order (x, y, theta, ax, ay).
    *  Other methods called:
-   *    + computeA
-   *    + physicsToStats
+   *    + StatsGeometry::computeA
+   *    + StatsGeometry::ellipseToStats
    *  Return value:
    *    + message filled with the given values.
    */
@@ -375,29 +669,83 @@ class VisualizationCore {
    */
   formation_control::FormationStatistics statsVectorToMsg(const std::vector<double> &vector) const;
 
-  /*  Updates the orientation of the target ellipse to avoid an annoing discontinuity of the pose of the interactive
-   *  markers which are "attached" to it. To do so, it evaluates the closest configuration to the previous orientation
-   *  handling the discontinuity on pi/2 and -pi/2 and converting the angle to the range [-pi, pi].
+  /*  Stores the given pose in the proper pose table (real or virtual agents), unless it is older than the one already
+   *  stored or the agent is not connected (never seen or evicted, see connected_agents_), and updates by delta the
+   *  moments accumulator of the table. Note that it is necessary to use a mutex protection on the tables because they
+   *  are shared among threads (the tables lock is taken before the connected agents one).
+   *
+   *  Parameters:
+   *    + id: agent id (index of the tables);
+   *    + is_virtual: selects the table of the virtual agents;
+   *    + pose: current pose of the agent;
+   *    + stamp: time of the given pose.
+   */
+  void storeAgentPose(const int &id, const bool &is_virtual, const geometry_msgs::Pose &pose, const ros::Time &stamp);
+
+  /*  Subscribes to the given topic of the shared statistics on the ingest queue, with the full, the compact or the
+   *  predicted message type (see compact_statistics_ and predict_statistics_).
+   *
+   *  Parameters:
+   *    + topic: name of the topic;
+   *    + queue_length: length of the subscriber queue.
+   *  Return value:
+   *    + subscriber of the topic.
+   */
+  ros::Subscriber subscribeStatistics(const std::string &topic, const int &queue_length);
+
+  /*  Serves the sync service of the agents: it assigns the requested agent id if still available (or the previous one
+   *  of the same node, if restarted), the lowest available one otherwise, and replies with the number of agents and
+   *  the common start of the algorithm. The latter is fixed by the first request (sync_delay later, rounded to the
+   *  following TDMA frame), thus all the agents which are up by then start in the same TDMA frame, while the late
+   *  ones start in a following frame of the same sequence.
    *
    *  Parameters:
-   *    + theta: the current orientation of the target ellipse passed by reference (i.e. used by the caller).
-   *    + theta_old: the previous orientation of the target ellipse.
+   *    + request: requested agent id (0 means any) and name of the node;
+   *    + response: assigned agent id, number of agents and common start.
+   *  Return value:
+   *    + false if all the agent ids have already been assigned.
    */
-  void thetaCorrection(double &theta, const double &theta_old) const;
+  bool syncAgentCallback(formation_control::SyncAgent::Request &request, formation_control::SyncAgent::Response &response);
+
+  /*  Stores in the pose tables the transforms of the agent frames w.r.t. frame_map_ received from tf, which are
+   *  broadcasted by the agents themselves. The other transforms are discarded.
+   *
+   *  Parameters:
+   *    + msg: tf message with a batch of transforms.
+   *  Other methods called:
+   *    + parseAgentFrame
+   *    + storeAgentPose
+   */
+  void tfCallback(const tf2_msgs::TFMessage &msg);
+
+  /*  Broadcasts all the queued transforms in a single tf message and empties the queue. It is automatically called by
+   *  a timer event at tf_rate_ (every sample time if not positive).
+   *
+   *  Parameters:
+   *    + timer_event: ROS structure which stores the timer info (not used in this case).
+   */
+  void tfTimerCallback(const ros::TimerEvent &timer_event);
+
+  /*  Rebuilds the spatial grid of the current positions of the real agents (see SpatialGrid), which are retrieved
+   *  from the pose tables.
+   *
+   *  Other methods called:
+   *    + lookupAgentPoses
+   */
+  void updateAgentGrid();
 
   /*  Updates the ellipse marker shown in rviz of the given statistics, which can be either the target statistics
    *  (depicted in orange) or an agent current estimate statistics (depicted in blu). An ellipse can be represented
    *  by the pose of its center and the length of its diameters, and thanks to its simmetry the rotation can belong
    *  to [-pi/2, pi/2] (and this is how an ellipse marker is encoded in rviz). However, in the case of the target
    *  statistics, a correction on the yaw term of the pose is necessary to ensure that the angle belongs to [-pi,pi]
-   *  to avoid an annoing discontinuity of the pose of the interactive markers "attached" to the target ellipse.
+   *  to avoid an annoing discontinuity of the pose of the interactive markers "attached" to the target ellipse (the
+   *  last published orientation is used as reference, see StatsGeometry::thetaCorrection).
    *
    *  Parameters:
    *    + msg: it is either the target statistics or an agent current estimate statistics.
    *  Other methods called:
-   *    + computeDiameter
-   *    + makeEllipse
-   *    + statsToPhysics
+   *    + publishSpanningEllipse
    */
   void updateSpanningEllipse(const formation_control::FormationStatisticsStamped &msg);
 
@@ -411,11 +759,13 @@ class VisualizationCore {
    */
   void updateTarget(const formation_control::FormationStatistics &target);
 
-  /*  Publishes the given target statistics in the proper (predefined) topic. It has the effect to provide to all the
-   *  agents (which are subscribed to this topic) the new target statistics.
+  /*  Replaces the target statistics with the given ones and publishes them (see publishTargetStats), unless the last
+   *  publication is too recent: in this case they are left pending and only the last ones are published later.
    *
    *  Parameters:
    *    + target: new target statistics to be published.
+   *  Other methods called:
+   *    + publishTargetStats
    */
   void updateTargetStats(const formation_control::FormationStatistics &target);
 };
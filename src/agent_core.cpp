@@ -13,165 +13,198 @@
 
 #include "agent_core.h"
 
-AgentCore::AgentCore() {
-  // handles server private parameters (private names are protected from accidental name collisions)
-  private_node_handle_ = new ros::NodeHandle("~");
-
-  private_node_handle_->param("sample_time", sample_time_, (double)DEFAULT_SAMPLE_TIME);
-  private_node_handle_->param("slot_tdma", slot_tdma_, (double)DEFAULT_SLOT_TDMA);
-  private_node_handle_->param("agent_id", agent_id_, DEFAULT_AGENT_ID);
-  private_node_handle_->param("number_of_stats", number_of_stats_, DEFAULT_NUMBER_OF_STATS);
-  private_node_handle_->param("number_of_velocities", number_of_velocities_, DEFAULT_NUMBER_OF_VELOCITIES);
-  private_node_handle_->param("verbosity_level", verbosity_level_, DEFAULT_VERBOSITY_LEVEL);
-  private_node_handle_->param("velocity_virtual_threshold", velocity_virtual_threshold_, (double)DEFAULT_VELOCITY_VIRTUAL_THRESHOLD);
-  private_node_handle_->param("speed_min", speed_min_, (double)DEFAULT_SPEED_MIN);
-  private_node_handle_->param("speed_max", speed_max_, (double)DEFAULT_SPEED_MAX);
-  private_node_handle_->param("steer_min", steer_min_, (double)DEFAULT_STEER_MIN);
-  private_node_handle_->param("steer_max", steer_max_, (double)DEFAULT_STEER_MAX);
-  private_node_handle_->param("k_p_speed", k_p_speed_, (double)DEFAULT_K_P_SPEED);
-  private_node_handle_->param("k_p_steer", k_p_steer_, (double)DEFAULT_K_P_STEER);
-  private_node_handle_->param("vehicle_length", vehicle_length_, (double)DEFAULT_VEHICLE_LENGTH);
-  private_node_handle_->param("world_limit", world_limit_, (double)DEFAULT_WORLD_LIMIT);
-
-  const std::vector<double> DEFAULT_DIAG_ELEMENTS_GAMMA = {100, 100, 5, 10, 5};
-  const std::vector<double> DEFAULT_DIAG_ELEMENTS_LAMBDA = {0, 0, 0, 0, 0};
-  const std::vector<double> DEFAULT_DIAG_ELEMENTS_B = {100, 100};
-  std::vector<double> diag_elements_gamma;
-  std::vector<double> diag_elements_lambda;
-  std::vector<double> diag_elements_b;
-  private_node_handle_->param("diag_elements_gamma", diag_elements_gamma, DEFAULT_DIAG_ELEMENTS_GAMMA);
-  private_node_handle_->param("diag_elements_lambda", diag_elements_lambda, DEFAULT_DIAG_ELEMENTS_LAMBDA);
-  private_node_handle_->param("diag_elements_b", diag_elements_b, DEFAULT_DIAG_ELEMENTS_B);
-
-  gamma_ = Eigen::Map<Eigen::VectorXd>(diag_elements_gamma.data(), number_of_stats_).asDiagonal();
-  lambda_ = Eigen::Map<Eigen::VectorXd>(diag_elements_lambda.data(), number_of_stats_).asDiagonal();
-  b_ = Eigen::Map<Eigen::VectorXd>(diag_elements_b.data(), number_of_velocities_).asDiagonal();
-  jacob_phi_ = Eigen::MatrixXd::Identity(number_of_stats_, number_of_velocities_);
-  phi_dot_.resize(number_of_stats_);
-
-  std::random_device rd;
-  std::mt19937 generator(rd());
-  std::uniform_real_distribution<> distrib_position(-world_limit_, world_limit_);
-  std::uniform_real_distribution<> distrib_orientation(-M_PI, M_PI);
-  double theta;
-  // agent pose initialization (we assume a null twist at the beginning)
-  private_node_handle_->param("x", pose_.position.x, distrib_position(generator));
-  private_node_handle_->param("y", pose_.position.y, distrib_position(generator));
-  private_node_handle_->param("theta", theta, distrib_orientation(generator));
-  pose_.orientation.w = 1;
-  setTheta(pose_.orientation, theta);
-  pose_virtual_ = pose_;
-
-  std::vector<double> initial_estimation = {pose_.position.x, pose_.position.y, std::pow(pose_.position.x, 2),
-                                            pose_.position.x * pose_.position.y, std::pow(pose_.position.y, 2)};
-  estimated_statistics_ = statsVectorToMsg(initial_estimation);
-  target_statistics_ = estimated_statistics_;
-
-  private_node_handle_->param("topic_queue_length", topic_queue_length_, DEFAULT_TOPIC_QUEUE_LENGTH);
-  private_node_handle_->param("shared_stats_topic", shared_stats_topic_name_, std::string(DEFAULT_SHARED_STATS_TOPIC));
-  private_node_handle_->param("target_stats_topic", target_stats_topic_name_, std::string(DEFAULT_TARGET_STATS_TOPIC));
-  private_node_handle_->param("marker_topic", marker_topic_name_, std::string(DEFAULT_MARKER_TOPIC));
-  private_node_handle_->param("marker_path_lifetime", marker_path_lifetime_, DEFAULT_MARKER_PATH_LIFETIME);
-  private_node_handle_->param("enable_path", enable_path_, true);
-
-  private_node_handle_->param("frame_map", frame_map_, std::string(DEFAULT_FRAME_MAP));
-  private_node_handle_->param("frame_agent_prefix", frame_agent_prefix_, std::string(DEFAULT_FRAME_AGENT_PREFIX));
-  private_node_handle_->param("frame_virtual_suffix", frame_virtual_suffix_, std::string(DEFAULT_FRAME_VIRTUAL_SUFFIX));
-
-  agent_frame_ = frame_agent_prefix_ + std::to_string(agent_id_);
-  agent_virtual_frame_ = agent_frame_ + frame_virtual_suffix_;
+AgentCore::AgentCore() : AgentCore(ros::NodeHandle("~"), std::set<int>()) {}
 
-  stats_publisher_ = node_handle_.advertise<formation_control::FormationStatisticsStamped>(shared_stats_topic_name_, topic_queue_length_);
-  stats_subscriber_ = node_handle_.subscribe(shared_stats_topic_name_, topic_queue_length_, &AgentCore::receivedStatsCallback, this);
-  target_stats_subscriber_ = node_handle_.subscribe(target_stats_topic_name_, topic_queue_length_, &AgentCore::targetStatsCallback, this);
-  marker_publisher_ = node_handle_.advertise<visualization_msgs::Marker>(marker_topic_name_, topic_queue_length_);
+AgentCore::AgentCore(const ros::NodeHandle &private_node_handle, const std::set<int> &hosted_agent_ids) {
+  node_handle_ = new ros::NodeHandle();
+  // handles server private parameters (private names are protected from accidental name collisions)
+  private_node_handle_ = new ros::NodeHandle(private_node_handle);
+  headless_ = false;
+  hosted_agent_ids_ = hosted_agent_ids;
+  hosted_ = !hosted_agent_ids_.empty();
+  // hosted agents poses are broadcasted by the host
+  tf_broadcaster_ = hosted_ ? nullptr : new tf::TransformBroadcaster();
+
+  initialize();
+}
 
-  waitForSlotTDMA(sample_time_);  // sync to the next sample time slot
-  // must be immediately after the waitForSlotTDMA method to ensure a satisfactory synchronization with TDMA protocol
-  algorithm_timer_ = private_node_handle_->createTimer(ros::Duration(sample_time_), &AgentCore::algorithmCallback, this);
+AgentCore::AgentCore(const AgentParameters &parameters, const std::set<int> &hosted_agent_ids) {
+  // no ROS communication at all (the host drives the agent)
+  node_handle_ = nullptr;
+  private_node_handle_ = nullptr;
+  tf_broadcaster_ = nullptr;
+  headless_ = true;
+  headless_parameters_ = parameters;
+  headless_time_ = ros::Time(1, 0);
+  hosted_agent_ids_ = hosted_agent_ids;
+  hosted_ = true;
+
+  initialize();
 }
 
 AgentCore::~AgentCore() {
+  if (!headless_ && !hosted_ && enable_timing_) {
+    printTiming();  // hosted agents timing is available only on the diagnostics topic
+  }
+  delete loop_recorder_;
+  delete tf_broadcaster_;
   delete private_node_handle_;
+  delete node_handle_;
 }
 
-visualization_msgs::Marker AgentCore::addToMarkerPath(const geometry_msgs::Point &p_old, const geometry_msgs::Point &p_new,
-                                                      const std::string &frame) {
-  visualization_msgs::Marker marker;
-  marker.header.frame_id = frame_map_;
-  marker.header.stamp = ros::Time(0);
-  marker.type = visualization_msgs::Marker::LINE_STRIP;
-  marker.action = visualization_msgs::Marker::ADD;
-  marker.ns = frame + "_path";
-  marker.id = marker_path_id_++;
-  marker.frame_locked = true;
-  marker.lifetime = ros::Duration(marker_path_lifetime_);
-  if (frame.find(frame_virtual_suffix_) != std::string::npos) {
-    marker.color.a = 0.5;
-    marker.color.r = 1.0;
-    marker.color.g = 0.5;
-    marker.color.b = 0.0;
+ros::Publisher AgentCore::advertiseStatistics(const std::string &topic) {
+  if (compact_statistics_) {
+    return node_handle_->advertise<formation_control::FormationStatisticsCompact>(topic, topic_queue_length_);
   }
-  else {
-    marker.color.a = 0.5;
-    marker.color.r = 0.0;
-    marker.color.g = 0.5;
-    marker.color.b = 1.0;
+  if (predict_statistics_) {
+    return node_handle_->advertise<formation_control::FormationStatisticsPredicted>(topic, topic_queue_length_);
   }
-  marker.points.push_back(p_old);
-  marker.points.push_back(p_new);
-  // relative pose is zero: the frame is already properly centered and rotated
-  marker.scale.x = 0.05;
-
-  return marker;
+  return node_handle_->advertise<formation_control::FormationStatisticsStamped>(topic, topic_queue_length_);
 }
 
 void AgentCore::algorithmCallback(const ros::TimerEvent &timer_event) {
-  consensus();  // also clears the received statistics container
-  control();  // also publishes virtual agent pose and path
-  guidance();
-  dynamics();  // also publishes agent pose and path
-
-  waitForSlotTDMA(slot_tdma_*agent_id_);  // sync to the next transmission TDMA slot (agent dependent)
+  std::chrono::steady_clock::time_point start = LatencyHistogram::now();
+  double jitter = (timer_event.current_real - timer_event.current_expected).toSec();
+
+  state_mutex_.lock();
+  algorithmStep();
+  state_mutex_.unlock();
+
+  transmit_statistics_mutex_.lock();
+  transmit_statistics_ = getSharedStatistics();
+  transmit_scheduled_ = updateTiming(TIMING_ALGORITHM, start);
+  transmit_statistics_mutex_.unlock();
+
+  if (enable_timing_) {
+    timing_[TIMING_TIMER_JITTER].add(jitter);
+    if (jitter + std::chrono::duration<double>(transmit_scheduled_ - start).count() > sample_time_) {
+      deadline_misses_++;
+    }
+  }
 
-  // publishes the last estimated statistics in the proper TDMA slot
-  formation_control::FormationStatisticsStamped msg;
-  msg.header.frame_id = agent_virtual_frame_;
-  msg.header.stamp = ros::Time::now();
-  msg.agent_id = agent_id_;
-  msg.stats = estimated_statistics_;
-  stats_publisher_.publish(msg);
+  // schedules the last estimated statistics in the proper TDMA slot (agent dependent)
+  ros::Duration delay = timer_event.current_expected + ros::Duration(transmit_offset_) - getTime();
+  if (delay <= ros::Duration(0)) {
+    CONSOLE_STREAM(WARN, "Computation exceeded the TDMA transmission slot (" << -delay.toSec() << "s late).");
+    transmitCallback(timer_event);
+    return;
+  }
+  transmit_timer_.stop();
+  transmit_timer_.setPeriod(delay);
+  transmit_timer_.start();
+}
 
-  std::stringstream s;
-  s << "Estimated statistics published.";
-  console(__func__, s, DEBUG);
+void AgentCore::algorithmStep() {
+  std::chrono::steady_clock::time_point start = LatencyHistogram::now();
+  consensus();  // also clears the received statistics container
+  start = updateTiming(TIMING_CONSENSUS, start);
+  control();  // also publishes virtual agent path
+  start = updateTiming(TIMING_CONTROL, start);
+  // the vehicle tracks the new virtual pose over the whole sample time (or on its own timer, see guidanceCallback)
+  for (int step = 0; !guidance_loop_ && step < guidance_steps_; step++) {
+    guidance();
+    start = updateTiming(TIMING_GUIDANCE, start);
+    dynamics();  // also publishes agent path
+    start = updateTiming(TIMING_DYNAMICS, start);
+  }
+  updateLoopRecord();
+  broadcastPoses();
+  publishDiagnostics();
 }
 
 void AgentCore::broadcastPath(const geometry_msgs::Pose &pose_new, const geometry_msgs::Pose &pose_old, const std::string &frame) {
-  if (enable_path_) {
-    marker_publisher_.publish(addToMarkerPath(pose_old.position, pose_new.position, frame));
+  if (!enable_path_) {
+    return;
+  }
+
+  ros::Time now = getTime();
+  MarkerPath &path = marker_paths_[frame];
+  if (path.points.empty()) {
+    updateMarkerPath(pose_old.position, now, path);
+  }
+  updateMarkerPath(pose_new.position, now, path);
+
+  // a LINE_STRIP needs at least two points; the rate limit bounds the marker traffic regardless of the decimation
+  bool rate_elapsed = marker_path_rate_ <= 0 || now - path.last_publish >= ros::Duration(1.0 / marker_path_rate_);
+  if (path.changed && path.points.size() > 1 && rate_elapsed) {
+    marker_publisher_.publish(getMarkerPath(path, frame));
+    path.last_publish = now;
+    path.changed = false;
   }
 }
 
-void AgentCore::broadcastPose(const geometry_msgs::Pose &pose, const std::string &frame) {
-  tf::Pose p;
-  tf::poseMsgToTF(pose, p);
-  tf_broadcaster_.sendTransform(tf::StampedTransform(p, ros::Time::now(), frame_map_, frame));
+void AgentCore::broadcastPoses() {
+  if (hosted_) {
+    return;  // the host broadcasts the poses of all its agents together
+  }
+
+  ros::Time now = getTime();
+  if (tf_rate_ > 0 && now - last_tf_broadcast_ < ros::Duration(1.0 / tf_rate_)) {
+    return;
+  }
+  tf_broadcaster_->sendTransform(getPoseTransforms());
+  last_tf_broadcast_ = now;
+}
+
+double AgentCore::computeSlotTDMA() const {
+  int number_of_slots = TdmaSchedule::getNumberOfSlots(frame_tdma_, slot_tdma_);
+  if (number_of_slots < 2) {
+    CONSOLE_STREAM(ERROR, "The TDMA frame (" << frame_tdma_ << ") can't hold any transmission slot (" << slot_tdma_ << ").");
+    return 0;
+  }
+  if (agent_id_ < 1) {
+    return 0;  // agent ids are expected to start from 1 (id 0 speaks in the computation slot)
+  }
+
+  // the first slot is reserved for the computation of all the agents
+  int slot = TdmaSchedule::getSlot(agent_id_, number_of_slots);
+  if (slot != agent_id_) {
+    CONSOLE_STREAM(WARN, "Not enough TDMA slots for agent " << agent_id_ << " (it shares the slot " << slot << ").");
+  }
+
+  CONSOLE_STREAM(INFO, "TDMA transmission slot " << slot << " of " << number_of_slots - 1 << " (" << slot*slot_tdma_ << "s).");
+  return slot*slot_tdma_;
 }
 
 void AgentCore::consensus() {
-  Eigen::RowVectorXd x = statsMsgToVector(estimated_statistics_);
-  received_statistics_mutex_.lock();
-  Eigen::MatrixXd x_j = statsMsgToMatrix(received_statistics_);
-  // clears the private variable for following callbacks
-  received_statistics_.clear();
-  received_statistics_mutex_.unlock();
-
-  std::stringstream s;
-  s << "Received statistics from " << x_j.rows()  << " agents.";
-  console(__func__, s, INFO);
-  s << "Received statistics \n" << x_j;
-  console(__func__, s, DEBUG);
+  StatsVector x = statsMsgToVector(estimated_statistics_);
+  if (!replay_) {
+    loop_record_.time = getTime().toSec();
+    StatsGeometry::toArray(target_statistics_, loop_record_.target);
+    // also marks the received statistics as collected for the following callbacks (stale ones are weighted by age)
+    loop_record_.received_weight = 0;
+    // the received statistics are extrapolated once, from one sample time after the stamp of their sender
+    double max_horizon = predict_statistics_ ? prediction_max_horizon_ : 0;
+    loop_record_.received_count = received_statistics_.collect(loop_record_.time, stale_statistics_max_age_,
+                                                               stale_statistics_weighting_, sample_time_, max_horizon,
+                                                               loop_record_.received_sum, loop_record_.received_weight);
+
+    loop_record_.degree = loop_record_.received_count;
+    if (communication_topology_ != "all") {
+      // the real degree of the agent in the communication graph (even if some neighbors have not been received)
+      neighbors_mutex_.lock();
+      loop_record_.degree = std::max(loop_record_.degree, (int)neighbors_.size());
+      neighbors_mutex_.unlock();
+    }
+
+    // with event triggered broadcast the neighbors know only the last broadcasted estimate: using it in place of x_k
+    // keeps the Laplacian term zero-sum over the agents, thus the average of the estimates is still preserved
+    StatsGeometry::toArray(estimated_statistics_, loop_record_.shared);
+    transmit_statistics_mutex_.lock();
+    if (event_threshold_ > 0 && !last_broadcast_statistics_.estimate.header.stamp.isZero()) {
+      // the neighbors extrapolate it as well (see predict_statistics param)
+      StatsVector shared = extrapolateStatistics(last_broadcast_statistics_.estimate,
+                                                 last_broadcast_statistics_.stats_dot, loop_record_.time);
+      Eigen::Map<StatsVector>(loop_record_.shared) = shared;
+    }
+    transmit_statistics_mutex_.unlock();
+  }
+  StatsVector x_j_sum = Eigen::Map<StatsVector>(loop_record_.received_sum);
+  double x_j_weight = loop_record_.received_weight;
+  StatsVector x_hat = Eigen::Map<StatsVector>(loop_record_.shared);
+
+  CONSOLE_STREAM(INFO, "Received statistics from " << loop_record_.received_count  << " agents.");
+  CONSOLE_STREAM(DEBUG, "Sum of received statistics (" << x_j_sum.transpose() << ").");
 
   // time derivative of phi(p) = [px, py, pxx, pxy, pyy]
   phi_dot_ << twist_virtual_.linear.x,
@@ -180,46 +213,27 @@ void AgentCore::consensus() {
               pose_virtual_.position.y*twist_virtual_.linear.x + pose_virtual_.position.x*twist_virtual_.linear.y,
               2*pose_virtual_.position.y*twist_virtual_.linear.y;
 
-  double convergence_consensus_limit = 1.0/(x_j.rows() + 1);  // 1/deg_max >> (I - Ts*L) is primitive
+  double convergence_consensus_limit = 1.0/(loop_record_.degree + 1);  // 1/deg_max >> (I - Ts*L) is primitive
   if (sample_time_ >= convergence_consensus_limit) {
-    s << "The current sample time (" << sample_time_
-      << ") does not guarantee the consensus convergence (upper bound: " << convergence_consensus_limit << ").";
-    console(__func__, s, ERROR);
+    CONSOLE_STREAM(ERROR, "The current sample time (" << sample_time_
+                          << ") does not guarantee the consensus convergence (upper bound: " << convergence_consensus_limit << ").");
   }
 
-  // dynamic discrete consensus: x_k+1 = phi_k*Ts + (I - Ts*L)x_k = phi_k*Ts + x_k + Ts*sum_j(x_j_k - x_k)
-  x += phi_dot_*sample_time_ + (x_j.rowwise() - x).colwise().sum()*sample_time_;
+  // dynamic discrete consensus: x_k+1 = phi_k*Ts + (I - Ts*L)x_k = phi_k*Ts + x_k + Ts*sum_j(w_j*(x_j_k - x_k))
+  estimated_statistics_dot_ = phi_dot_ + x_j_sum - x_j_weight*x_hat;
+  x += estimated_statistics_dot_*sample_time_;
 
   estimated_statistics_ = statsVectorToMsg(x);
 
-  s << "Estimated statistics (" << x << ").";
-  console(__func__, s, INFO);
+  CONSOLE_STREAM(INFO, "Estimated statistics (" << x.transpose() << ").");
 }
 
-void AgentCore::console(const std::string &caller_name, std::stringstream &message, const int &log_level) const {
-  std::stringstream s;
-  s << "[AgentCore::" << caller_name << "::Agent_" << agent_id_ << "]  " << message.str();
-
-  if (log_level < WARN) {  // error messages
-    ROS_ERROR_STREAM(s.str());
-  }
-  else if (log_level == WARN) {  // warn messages
-    ROS_WARN_STREAM(s.str());
-  }
-  else if (log_level == INFO) {  // info messages
-    ROS_INFO_STREAM(s.str());
-  }
-  else if (log_level > INFO && log_level <= verbosity_level_) {  // debug messages
-    ROS_DEBUG_STREAM(s.str());
-  }
-
-  // clears the stringstream passed to this method
-  message.clear();
-  message.str(std::string());
+std::string AgentCore::consolePrefix(const std::string &caller_name) const {
+  return "[AgentCore::" + caller_name + "::Agent_" + std::to_string(agent_id_) + "]  ";
 }
 
 void AgentCore::control() {
-  Eigen::VectorXd stats_error = statsMsgToVector(target_statistics_) - statsMsgToVector(estimated_statistics_);
+  StatsVector stats_error = statsMsgToVector(target_statistics_) - statsMsgToVector(estimated_statistics_);
   // update non constant values of the jacobian of phi(p) = [px, py, pxx, pxy, pyy]
   jacob_phi_(2,0) = 2*pose_virtual_.position.x;
   jacob_phi_(3,0) = pose_virtual_.position.y;
@@ -227,8 +241,8 @@ void AgentCore::control() {
   jacob_phi_(4,1) = 2*pose_virtual_.position.y;
 
   // twist_virtual = inv(B + Jphi'*lambda*Jphi) * Jphi' * gamma * stats_error
-  Eigen::VectorXd control_law = (b_ + jacob_phi_.transpose()*lambda_*jacob_phi_).inverse()
-                                *jacob_phi_.transpose()*gamma_*stats_error;
+  VelocityVector control_law = solveVelocitySystem(b_ + jacob_phi_.transpose()*lambda_*jacob_phi_,
+                                                   jacob_phi_.transpose()*gamma_*stats_error);
 
   // control command saturation
   double current_velocity_virtual = std::sqrt(std::pow(control_law(0),2) + std::pow(control_law(1),2));
@@ -237,66 +251,229 @@ void AgentCore::control() {
   }
 
   geometry_msgs::Pose pose_old = pose_virtual_;
-  pose_virtual_.position.x = integrator(pose_virtual_.position.x, twist_virtual_.linear.x, control_law(0), 1);
-  pose_virtual_.position.y = integrator(pose_virtual_.position.y, twist_virtual_.linear.y, control_law(1), 1);
-  setTheta(pose_virtual_.orientation, std::atan2(control_law(1), control_law(0)));
+  pose_virtual_.position.x = integrator(pose_virtual_.position.x, twist_virtual_.linear.x, control_law(0), 1, sample_time_);
+  pose_virtual_.position.y = integrator(pose_virtual_.position.y, twist_virtual_.linear.y, control_law(1), 1, sample_time_);
+  theta_virtual_ = std::atan2(control_law(1), control_law(0));
   twist_virtual_.linear.x = control_law(0);
   twist_virtual_.linear.y = control_law(1);
 
-  std::stringstream s;
-  s << "Statistics error (" << (Eigen::RowVectorXd)stats_error << ").";
-  console(__func__, s, DEBUG_V);
-  s << "Control commands (" << (Eigen::RowVectorXd)control_law << ").";
-  console(__func__, s, DEBUG_VV);
-  s << "Virtual pose (" << pose_virtual_.position.x << ", " << pose_virtual_.position.y << ").";
-  console(__func__, s, DEBUG_VVV);
-  s << "Virtual twist (" << twist_virtual_.linear.x << ", " << twist_virtual_.linear.y << ").";
-  console(__func__, s, DEBUG_VVV);
-
-  broadcastPose(pose_virtual_, agent_virtual_frame_);
+  CONSOLE_STREAM(DEBUG_V, "Statistics error (" << stats_error.transpose() << ").");
+  CONSOLE_STREAM(DEBUG_VV, "Control commands (" << control_law.transpose() << ").");
+  CONSOLE_STREAM(DEBUG_VVV, "Virtual pose (" << pose_virtual_.position.x << ", " << pose_virtual_.position.y << ").");
+  CONSOLE_STREAM(DEBUG_VVV, "Virtual twist (" << twist_virtual_.linear.x << ", " << twist_virtual_.linear.y << ").");
+
   broadcastPath(pose_virtual_, pose_old, agent_virtual_frame_);
 }
 
 void AgentCore::dynamics() {
-  double theta = getTheta(pose_.orientation);
-  double x_dot_new = speed_command_sat_ * std::cos(theta);
-  double y_dot_new = speed_command_sat_ * std::sin(theta);
+  double x_dot_new = speed_command_sat_ * std::cos(theta_);
+  double y_dot_new = speed_command_sat_ * std::sin(theta_);
   double theta_dot_new = speed_command_sat_ / vehicle_length_ * std::tan(steer_command_sat_);
 
   geometry_msgs::Pose pose_old = pose_;
-  pose_.position.x = integrator(pose_.position.x, twist_.linear.x, x_dot_new, 1);
-  pose_.position.y = integrator(pose_.position.y, twist_.linear.y, y_dot_new, 1);
-  setTheta(pose_.orientation, integrator(theta, twist_.angular.z, theta_dot_new, 1));
+  pose_.position.x = integrator(pose_.position.x, twist_.linear.x, x_dot_new, 1, guidance_sample_time_);
+  pose_.position.y = integrator(pose_.position.y, twist_.linear.y, y_dot_new, 1, guidance_sample_time_);
+  theta_ = angles::normalize_angle(integrator(theta_, twist_.angular.z, theta_dot_new, 1, guidance_sample_time_));
   twist_.linear.x = x_dot_new;
   twist_.linear.y = y_dot_new;
   twist_.angular.z = theta_dot_new;
 
-  std::stringstream s;
-  s << "Pose (" << pose_.position.x << ", " << pose_.position.y << ").";
-  console(__func__, s, DEBUG_VVV);
-  s << "Twist (" << twist_.linear.x << ", " << twist_.linear.y << ").";
-  console(__func__, s, DEBUG_VVV);
-  s << "System state (" << x_dot_new << ", " << y_dot_new << ", " << theta_dot_new << ").";
-  console(__func__, s, DEBUG_VVVV);
+  CONSOLE_STREAM(DEBUG_VVV, "Pose (" << pose_.position.x << ", " << pose_.position.y << ").");
+  CONSOLE_STREAM(DEBUG_VVV, "Twist (" << twist_.linear.x << ", " << twist_.linear.y << ").");
+  CONSOLE_STREAM(DEBUG_VVVV, "System state (" << x_dot_new << ", " << y_dot_new << ", " << theta_dot_new << ").");
 
-  broadcastPose(pose_, agent_frame_);
   broadcastPath(pose_, pose_old, agent_frame_);
 }
 
+StatsVector AgentCore::extrapolateStatistics(const formation_control::FormationStatisticsStamped &msg,
+                                             const formation_control::FormationStatistics &stats_dot,
+                                             const double &time) const {
+  StatsVector stats = statsMsgToVector(msg.stats);
+  if (predict_statistics_) {
+    // the statistics are computed one sample time ahead of their stamp (see consensus)
+    double age = time - msg.header.stamp.toSec() - sample_time_;
+    double horizon = std::min(std::max(age, 0.0), prediction_max_horizon_);
+    stats += statsMsgToVector(stats_dot)*horizon;
+  }
+  return stats;
+}
+
 void AgentCore::floor(double &d, const int &precision) const {
   d = std::floor(d*std::pow(10, precision)) / std::pow(10, precision);
 }
 
-Eigen::Vector3d AgentCore::getRPY(const geometry_msgs::Quaternion &quat) const {
-  Eigen::Quaterniond eigen_quat;
-  tf::quaternionMsgToEigen(quat, eigen_quat);
-  Eigen::Vector3d rpy = eigen_quat.normalized().matrix().eulerAngles(0, 1, 2);
-  return rpy;
+int AgentCore::getAgentId() const {
+  return agent_id_;
+}
+
+formation_control::FormationStatisticsStamped AgentCore::getEstimatedStatistics() const {
+  formation_control::FormationStatisticsStamped msg;
+  msg.header.frame_id = agent_virtual_frame_;
+  msg.header.stamp = getTime();
+  msg.agent_id = agent_id_;
+  msg.stats = estimated_statistics_;
+  return msg;
+}
+
+AgentGains AgentCore::getGains() const {
+  AgentGains gains;
+  gains.sample_time = sample_time_;
+  gains.guidance_steps = guidance_steps_;
+  gains.velocity_virtual_threshold = velocity_virtual_threshold_;
+  gains.speed_min = speed_min_;
+  gains.speed_max = speed_max_;
+  gains.steer_min = steer_min_;
+  gains.steer_max = steer_max_;
+  gains.k_p_speed = k_p_speed_;
+  gains.k_p_steer = k_p_steer_;
+  gains.vehicle_length = vehicle_length_;
+  for (int i = 0; i < DEFAULT_NUMBER_OF_STATS; i++) {
+    gains.gamma[i] = gamma_(i,i);
+    gains.lambda[i] = lambda_(i,i);
+  }
+  for (int i = 0; i < DEFAULT_NUMBER_OF_VELOCITIES; i++) {
+    gains.b[i] = b_(i,i);
+  }
+  return gains;
 }
 
-double AgentCore::getTheta(const geometry_msgs::Quaternion &quat) const {
-  Eigen::Vector3d rpy = getRPY(quat);
-  return rpy(2);
+std::string AgentCore::getAgentTopic(const std::string &topic, const int &id) const {
+  return topic + "/" + frame_agent_prefix_ + std::to_string(id);
+}
+
+visualization_msgs::Marker AgentCore::getMarkerPath(const MarkerPath &path, const std::string &frame) const {
+  visualization_msgs::Marker marker;
+  marker.header.frame_id = frame_map_;
+  marker.header.stamp = ros::Time(0);
+  marker.type = visualization_msgs::Marker::LINE_STRIP;
+  marker.action = visualization_msgs::Marker::ADD;
+  marker.ns = frame + "_path";
+  marker.id = 0;  // the whole path is republished every time
+  marker.frame_locked = true;
+  marker.lifetime = ros::Duration(marker_path_lifetime_);
+  if (frame.find(frame_virtual_suffix_) != std::string::npos) {
+    marker.color.a = 0.5;
+    marker.color.r = 1.0;
+    marker.color.g = 0.5;
+    marker.color.b = 0.0;
+  }
+  else {
+    marker.color.a = 0.5;
+    marker.color.r = 0.0;
+    marker.color.g = 0.5;
+    marker.color.b = 1.0;
+  }
+  marker.points.assign(path.points.begin(), path.points.end());
+  // relative pose is zero: the frame is already properly centered and rotated
+  marker.scale.x = 0.05;
+
+  return marker;
+}
+
+int AgentCore::getMaxAgentId() const {
+  int max_agent_id = std::max(number_of_agents_, agent_id_);
+  if (!hosted_agent_ids_.empty()) {
+    max_agent_id = std::max(max_agent_id, *hosted_agent_ids_.rbegin());
+  }
+  return max_agent_id;
+}
+
+int AgentCore::getNeighborSlot(const int &id) {
+  if (communication_topology_ == "all") {
+    return id;
+  }
+  std::lock_guard<std::mutex> lock(neighbors_mutex_);
+  std::map<int, int>::const_iterator it = neighbor_slots_.find(id);
+  return it != neighbor_slots_.end() ? it->second : -1;
+}
+
+bool AgentCore::getParamValue(XmlRpc::XmlRpcValue param, bool &value) const {
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeBoolean) {
+    return false;
+  }
+  value = static_cast<bool&>(param);
+  return true;
+}
+
+bool AgentCore::getParamValue(XmlRpc::XmlRpcValue param, int &value) const {
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeInt) {
+    return false;
+  }
+  value = static_cast<int&>(param);
+  return true;
+}
+
+bool AgentCore::getParamValue(XmlRpc::XmlRpcValue param, double &value) const {
+  if (param.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+    value = static_cast<int&>(param);
+    return true;
+  }
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeDouble) {
+    return false;
+  }
+  value = static_cast<double&>(param);
+  return true;
+}
+
+bool AgentCore::getParamValue(XmlRpc::XmlRpcValue param, std::string &value) const {
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeString) {
+    return false;
+  }
+  value = static_cast<std::string&>(param);
+  return true;
+}
+
+geometry_msgs::Pose AgentCore::getPose() const {
+  geometry_msgs::Pose pose = pose_;
+  pose.orientation = tf::createQuaternionMsgFromYaw(theta_);
+  return pose;
+}
+
+std::vector<tf::StampedTransform> AgentCore::getPoseTransforms() const {
+  ros::Time now = getTime();
+  tf::Pose pose(tf::createQuaternionFromYaw(theta_), tf::Vector3(pose_.position.x, pose_.position.y, pose_.position.z));
+  tf::Pose pose_virtual(tf::createQuaternionFromYaw(theta_virtual_),
+                        tf::Vector3(pose_virtual_.position.x, pose_virtual_.position.y, pose_virtual_.position.z));
+
+  std::vector<tf::StampedTransform> transforms;
+  transforms.push_back(tf::StampedTransform(pose, now, frame_map_, agent_frame_));
+  transforms.push_back(tf::StampedTransform(pose_virtual, now, frame_map_, agent_virtual_frame_));
+  return transforms;
+}
+
+formation_control::FormationStatisticsPredicted AgentCore::getSharedStatistics() const {
+  formation_control::FormationStatisticsPredicted msg;
+  msg.estimate = getEstimatedStatistics();
+  if (predict_statistics_) {
+    msg.stats_dot = statsVectorToMsg(estimated_statistics_dot_);
+  }
+  return msg;
+}
+
+formation_control::FormationStatistics AgentCore::getTargetStatistics() const {
+  return target_statistics_;
+}
+
+ros::Time AgentCore::getTime() const {
+  return headless_ ? headless_time_ : ros::Time::now();
+}
+
+double AgentCore::getTransmitOffset() const {
+  return transmit_offset_;
+}
+
+geometry_msgs::Twist AgentCore::getTwist() const {
+  return twist_;
+}
+
+geometry_msgs::Pose AgentCore::getVirtualPose() const {
+  geometry_msgs::Pose pose = pose_virtual_;
+  pose.orientation = tf::createQuaternionMsgFromYaw(theta_virtual_);
+  return pose;
+}
+
+geometry_msgs::Twist AgentCore::getVirtualTwist() const {
+  return twist_virtual_;
 }
 
 void AgentCore::guidance() {
@@ -309,35 +486,500 @@ void AgentCore::guidance() {
   double speed_command = k_p_speed_*los_distance;
   speed_command_sat_ = saturation(speed_command, speed_min_, speed_max_);
 
-  double steer_command = k_p_steer_*angles::shortest_angular_distance(getTheta(pose_.orientation), los_angle);
+  double steer_command = k_p_steer_*angles::shortest_angular_distance(theta_, los_angle);
   steer_command_sat_ = saturation(steer_command, steer_min_, steer_max_);
 
   // there is no need to get sub-centimeter accuracy
   floor(speed_command_sat_, 1);
 
-  std::stringstream s;
-  s << "Guidance commands (" << speed_command_sat_ << ", " << steer_command_sat_ << ").";
-  console(__func__, s, DEBUG_VV);
-  s << "LOS distance and angle (" << los_distance << ", " << los_angle << ").";
-  console(__func__, s, DEBUG_VVVV);
+  CONSOLE_STREAM(DEBUG_VV, "Guidance commands (" << speed_command_sat_ << ", " << steer_command_sat_ << ").");
+  CONSOLE_STREAM(DEBUG_VVVV, "LOS distance and angle (" << los_distance << ", " << los_angle << ").");
 }
 
-double AgentCore::integrator(const double &out_old, const double &in_old, const double &in_new, const double &k) const {
-  return out_old + k*sample_time_*(in_old + in_new)/2;
+void AgentCore::guidanceCallback(const ros::TimerEvent &timer_event) {
+  std::chrono::steady_clock::time_point start = LatencyHistogram::now();
+  state_mutex_.lock();
+  guidance();
+  start = updateTiming(TIMING_GUIDANCE, start);
+  dynamics();  // also publishes agent path
+  updateTiming(TIMING_DYNAMICS, start);
+  broadcastPoses();
+  state_mutex_.unlock();
+}
+
+void AgentCore::initialize() {
+  getParam("sample_time", sample_time_, (double)DEFAULT_SAMPLE_TIME);
+  getParam("guidance_sample_time", guidance_sample_time_, sample_time_);
+  if (!(guidance_sample_time_ > 0)) {
+    CONSOLE_STREAM(WARN, "The guidance sample time must be positive (the sample time is used).");
+    guidance_sample_time_ = sample_time_;
+  }
+  // the guidance steps must fit exactly in the sample time, so that each of them integrates the vehicle over its length
+  guidance_steps_ = std::max((int)std::round(sample_time_/guidance_sample_time_), 1);
+  if (!(std::abs(guidance_steps_*guidance_sample_time_ - sample_time_) <= 1e-9)) {
+    CONSOLE_STREAM(WARN, "The guidance sample time (" << guidance_sample_time_ << ") is not a fraction of the sample time ("
+                         << sample_time_ << "), " << sample_time_/guidance_steps_ << " is used.");
+  }
+  guidance_sample_time_ = sample_time_/guidance_steps_;
+  guidance_loop_ = false;
+  getParam("frame_tdma", frame_tdma_, sample_time_);
+  // the algorithm timer must start at the same offset of every frame, otherwise the agents drift out of their slots
+  double frame_tdma = TdmaSchedule::getFrame(sample_time_, frame_tdma_);
+  if (frame_tdma != frame_tdma_) {
+    CONSOLE_STREAM(WARN, "The sample time (" << sample_time_ << ") is not a multiple of the TDMA frame (" << frame_tdma_
+                         << "), " << frame_tdma << " is used.");
+    frame_tdma_ = frame_tdma;
+  }
+  getParam("number_of_agents", number_of_agents_, DEFAULT_NUMBER_OF_AGENTS);
+  getParam("agent_id", agent_id_, DEFAULT_AGENT_ID);
+  getParam("verbosity_level", verbosity_level_, DEFAULT_VERBOSITY_LEVEL);
+  getParam("sync_service", sync_service_name_, std::string(DEFAULT_SYNC_SERVICE));
+  sync_start_time_ = ros::Time();
+  if (!headless_ && !hosted_ && agent_id_ == DEFAULT_AGENT_ID) {
+    syncAgent();  // also the number of agents comes from the Ground Station
+  }
+  // by default the frame is shared by all the agents plus the computation slot
+  getParam("slot_tdma", slot_tdma_, frame_tdma_/(number_of_agents_ + 1));
+  getParam("velocity_virtual_threshold", velocity_virtual_threshold_, (double)DEFAULT_VELOCITY_VIRTUAL_THRESHOLD);
+  getParam("speed_min", speed_min_, (double)DEFAULT_SPEED_MIN);
+  getParam("speed_max", speed_max_, (double)DEFAULT_SPEED_MAX);
+  getParam("steer_min", steer_min_, (double)DEFAULT_STEER_MIN);
+  getParam("steer_max", steer_max_, (double)DEFAULT_STEER_MAX);
+  getParam("k_p_speed", k_p_speed_, (double)DEFAULT_K_P_SPEED);
+  getParam("k_p_steer", k_p_steer_, (double)DEFAULT_K_P_STEER);
+  getParam("vehicle_length", vehicle_length_, (double)DEFAULT_VEHICLE_LENGTH);
+  getParam("world_limit", world_limit_, (double)DEFAULT_WORLD_LIMIT);
+
+  const std::vector<double> DEFAULT_DIAG_ELEMENTS_GAMMA = {100, 100, 5, 10, 5};
+  const std::vector<double> DEFAULT_DIAG_ELEMENTS_LAMBDA = {0, 0, 0, 0, 0};
+  const std::vector<double> DEFAULT_DIAG_ELEMENTS_B = {100, 100};
+  std::vector<double> diag_elements_gamma;
+  std::vector<double> diag_elements_lambda;
+  std::vector<double> diag_elements_b;
+  getParam("diag_elements_gamma", diag_elements_gamma, DEFAULT_DIAG_ELEMENTS_GAMMA);
+  getParam("diag_elements_lambda", diag_elements_lambda, DEFAULT_DIAG_ELEMENTS_LAMBDA);
+  getParam("diag_elements_b", diag_elements_b, DEFAULT_DIAG_ELEMENTS_B);
+
+  if (diag_elements_gamma.size() != DEFAULT_NUMBER_OF_STATS || diag_elements_lambda.size() != DEFAULT_NUMBER_OF_STATS
+      || diag_elements_b.size() != DEFAULT_NUMBER_OF_VELOCITIES) {
+    CONSOLE_STREAM(ERROR, "Wrong diagonal elements size (default values are used).");
+    diag_elements_gamma = DEFAULT_DIAG_ELEMENTS_GAMMA;
+    diag_elements_lambda = DEFAULT_DIAG_ELEMENTS_LAMBDA;
+    diag_elements_b = DEFAULT_DIAG_ELEMENTS_B;
+  }
+  gamma_ = Eigen::Map<StatsVector>(diag_elements_gamma.data()).asDiagonal();
+  lambda_ = Eigen::Map<StatsVector>(diag_elements_lambda.data()).asDiagonal();
+  b_ = Eigen::Map<VelocityVector>(diag_elements_b.data()).asDiagonal();
+  jacob_phi_ = JacobianMatrix::Identity();
+  phi_dot_.setZero();
+  estimated_statistics_dot_.setZero();
+
+  int random_seed;
+  getParam("random_seed", random_seed, DEFAULT_RANDOM_SEED);
+  std::random_device rd;
+  // each agent has its own sequence with the same seed
+  std::mt19937 generator((random_seed >= 0) ? random_seed + agent_id_ : rd());
+  std::uniform_real_distribution<> distrib_position(-world_limit_, world_limit_);
+  std::uniform_real_distribution<> distrib_orientation(-M_PI, M_PI);
+  // agent pose initialization (we assume a null twist at the beginning)
+  getParam("x", pose_.position.x, distrib_position(generator));
+  getParam("y", pose_.position.y, distrib_position(generator));
+  getParam("theta", theta_, distrib_orientation(generator));
+  pose_.orientation.w = 1;
+  theta_ = angles::normalize_angle(theta_);
+  pose_virtual_ = pose_;
+  theta_virtual_ = theta_;
+  speed_command_sat_ = 0;
+  steer_command_sat_ = 0;
+
+  std::vector<double> initial_estimation = {pose_.position.x, pose_.position.y, std::pow(pose_.position.x, 2),
+                                            pose_.position.x * pose_.position.y, std::pow(pose_.position.y, 2)};
+  estimated_statistics_ = statsVectorToMsg(initial_estimation);
+  target_statistics_ = estimated_statistics_;
+  target_stamp_ = ros::Time();
+
+  getParam("topic_queue_length", topic_queue_length_, DEFAULT_TOPIC_QUEUE_LENGTH);
+  getParam("shared_stats_topic", shared_stats_topic_name_, std::string(DEFAULT_SHARED_STATS_TOPIC));
+  getParam("shared_stats_array_topic", shared_stats_array_topic_name_, std::string(DEFAULT_SHARED_STATS_ARRAY_TOPIC));
+  getParam("shared_stats_compact_topic", shared_stats_compact_topic_name_, std::string(DEFAULT_SHARED_STATS_COMPACT_TOPIC));
+  getParam("shared_stats_predicted_topic", shared_stats_predicted_topic_name_,
+           std::string(DEFAULT_SHARED_STATS_PREDICTED_TOPIC));
+  getParam("compact_statistics", compact_statistics_, false);
+  double compact_resolution;
+  getParam("compact_resolution", compact_resolution, (double)DEFAULT_COMPACT_RESOLUTION);
+  getParam("target_stats_topic", target_stats_topic_name_, std::string(DEFAULT_TARGET_STATS_TOPIC));
+  getParam("neighbors_topic", neighbors_topic_name_, std::string(DEFAULT_NEIGHBORS_TOPIC));
+  getParam("marker_topic", marker_topic_name_, std::string(DEFAULT_MARKER_TOPIC));
+  getParam("marker_path_lifetime", marker_path_lifetime_, DEFAULT_MARKER_PATH_LIFETIME);
+  getParam("marker_path_resolution", marker_path_resolution_, (double)DEFAULT_MARKER_PATH_RESOLUTION);
+  getParam("marker_path_rate", marker_path_rate_, (double)DEFAULT_MARKER_PATH_RATE);
+  getParam("marker_path_max_points", marker_path_max_points_, DEFAULT_MARKER_PATH_MAX_POINTS);
+  getParam("enable_path", enable_path_, true);
+  getParam("tf_rate", tf_rate_, (double)DEFAULT_TF_RATE);
+  getParam("event_threshold", event_threshold_, (double)DEFAULT_EVENT_THRESHOLD);
+  getParam("event_max_silence", event_max_silence_, (double)DEFAULT_EVENT_MAX_SILENCE);
+  const std::vector<double> DEFAULT_EVENT_WEIGHTS = {1, 1, 1, 1, 1};
+  std::vector<double> event_weights;
+  getParam("event_weights", event_weights, DEFAULT_EVENT_WEIGHTS);
+  if (event_weights.size() != DEFAULT_NUMBER_OF_STATS) {
+    CONSOLE_STREAM(ERROR, "Wrong event weights size (default values are used).");
+    event_weights = DEFAULT_EVENT_WEIGHTS;
+  }
+  event_weights_ = Eigen::Map<StatsVector>(event_weights.data());
+  if (event_threshold_ > 0 && event_max_silence_ <= 0) {
+    CONSOLE_STREAM(WARN, "The event triggered broadcast needs a heartbeat (default max silence is used).");
+    event_max_silence_ = DEFAULT_EVENT_MAX_SILENCE;
+  }
+  sent_estimates_ = 0;
+  suppressed_estimates_ = 0;
+  // the receivers have to keep the last estimate of a silent agent at least until its next heartbeat
+  double default_max_age = (event_threshold_ > 0) ? event_max_silence_ + 2*sample_time_ : DEFAULT_STALE_STATISTICS_MAX_AGE;
+  getParam("stale_statistics_max_age", stale_statistics_max_age_, default_max_age);
+  getParam("stale_statistics_weighting", stale_statistics_weighting_, false);
+  getParam("predict_statistics", predict_statistics_, false);
+  getParam("prediction_max_horizon", prediction_max_horizon_, 2*sample_time_);
+  if (predict_statistics_ && compact_statistics_) {
+    CONSOLE_STREAM(WARN, "The compact statistics do not carry the time derivative (prediction disabled).");
+    predict_statistics_ = false;
+  }
+  getParam("diagnostics_topic", diagnostics_topic_name_, std::string(DEFAULT_DIAGNOSTICS_TOPIC));
+  getParam("diagnostics_rate", diagnostics_rate_, (double)DEFAULT_DIAGNOSTICS_RATE);
+  getParam("enable_timing", enable_timing_, !headless_);  // the headless loop is not real time
+  timing_stage_names_ = {"consensus", "control", "guidance", "dynamics", "algorithm", "timer_jitter", "tdma_wait", "publish"};
+  deadline_misses_ = 0;
+  last_deadline_misses_ = 0;
+
+  getParam("frame_map", frame_map_, std::string(DEFAULT_FRAME_MAP));
+  getParam("frame_agent_prefix", frame_agent_prefix_, std::string(DEFAULT_FRAME_AGENT_PREFIX));
+  getParam("frame_virtual_suffix", frame_virtual_suffix_, std::string(DEFAULT_FRAME_VIRTUAL_SUFFIX));
+
+  agent_frame_ = frame_agent_prefix_ + std::to_string(agent_id_);
+  agent_virtual_frame_ = agent_frame_ + frame_virtual_suffix_;
+
+  loop_record_ = LoopRecord();
+  replay_ = false;
+  loop_recorder_ = nullptr;
+  std::string record_prefix;
+  getParam("record_prefix", record_prefix, std::string());
+  if (!record_prefix.empty()) {
+    LoopRecordHeader header;
+    header.agent_id = agent_id_;
+    header.number_of_agents = number_of_agents_;
+    header.x = pose_.position.x;
+    header.y = pose_.position.y;
+    header.theta = theta_;
+    header.gains = getGains();
+    loop_recorder_ = new LoopRecorder();
+    if (!loop_recorder_->create(record_prefix + agent_frame_ + ".rec", header)) {
+      CONSOLE_STREAM(ERROR, "Can't create the loop recording (" << record_prefix + agent_frame_ + ".rec" << ").");
+      delete loop_recorder_;
+      loop_recorder_ = nullptr;
+    }
+  }
+
+  compact_codec_.setup(compact_resolution, frame_agent_prefix_, frame_virtual_suffix_);
+  // the receivers would drop the statistics of the ids which can't be encoded, thus the node must not even start
+  int max_expected_id = std::max(agent_id_, number_of_agents_);
+  if (compact_statistics_ && !headless_ && !CompactCodec::isValidAgentId(max_expected_id)) {
+    CONSOLE_STREAM(FATAL, "The agent ids up to " << max_expected_id << " can't be encoded in the compact statistics "
+                          << "(shutting down).");
+    ros::shutdown();
+    return;
+  }
+  if (compact_statistics_) {
+    CONSOLE_STREAM(INFO, "Compact statistics (max dequantization error " << compact_codec_.getMaxError() << ").");
+  }
+  stats_topic_name_ = compact_statistics_ ? shared_stats_compact_topic_name_ : shared_stats_topic_name_;
+  if (predict_statistics_) {
+    stats_topic_name_ = shared_stats_predicted_topic_name_;
+  }
+
+  // the hosted agents receive most of the statistics in memory, without any latency (the slots of the received
+  // statistics and of the link monitor are reserved on the neighbors, see initializeNeighbors)
+  enable_link_monitor_ = enable_timing_ && !hosted_;
+
+  if (headless_) {
+    enable_path_ = false;
+    transmit_offset_ = 0;  // the host hands over the statistics without any TDMA schedule
+    initializeNeighbors();
+    return;
+  }
+
+  target_stats_subscriber_ = node_handle_->subscribe(target_stats_topic_name_, topic_queue_length_, &AgentCore::targetStatsCallback, this);
+  agent_target_stats_subscriber_ = node_handle_->subscribe(getAgentTopic(target_stats_topic_name_, agent_id_), 1,
+                                                           &AgentCore::targetStatsCallback, this);
+  marker_publisher_ = node_handle_->advertise<visualization_msgs::Marker>(marker_topic_name_, topic_queue_length_);
+  if (diagnostics_rate_ > 0) {
+    diagnostics_publisher_ = node_handle_->advertise<diagnostic_msgs::DiagnosticArray>(diagnostics_topic_name_, topic_queue_length_);
+  }
+
+  initializeNeighbors();  // also advertises the stats publisher on the proper topic
+  transmit_offset_ = computeSlotTDMA();  // the host publishes the statistics in the same slot (see SwarmCore)
+
+  if (hosted_) {
+    // the host drives the algorithm and hands over the shared statistics among its agents
+    return;
+  }
+
+  if (communication_topology_ == "all") {
+    stats_subscriber_ = subscribeStatistics(stats_topic_name_);
+    // statistics aggregated by other nodes (e.g. a SwarmCore with aggregate_statistics enabled)
+    stats_array_subscriber_ = node_handle_->subscribe(shared_stats_array_topic_name_, topic_queue_length_,
+                                                     &AgentCore::receivedStatsArrayCallback, this);
+  }
+
+  // one-shot timer which is rearmed every sample time (see algorithmCallback)
+  transmit_timer_ = private_node_handle_->createTimer(ros::Duration(transmit_offset_), &AgentCore::transmitCallback, this, true, false);
+
+  waitForSlotTDMA(frame_tdma_);  // sync to the next TDMA frame (or to the common start)
+  // must be immediately after the waitForSlotTDMA method to ensure a satisfactory synchronization with TDMA protocol
+  algorithm_timer_ = private_node_handle_->createTimer(ros::Duration(sample_time_), &AgentCore::algorithmCallback, this);
+  if (guidance_steps_ > 1) {
+    guidance_loop_ = true;
+    guidance_timer_ = private_node_handle_->createTimer(ros::Duration(guidance_sample_time_), &AgentCore::guidanceCallback, this);
+    CONSOLE_STREAM(INFO, "Guidance loop at " << 1.0/guidance_sample_time_ << "Hz (" << guidance_steps_ << " steps per sample time).");
+  }
+}
+
+void AgentCore::initializeNeighbors() {
+  getParam("communication_topology", communication_topology_, std::string(DEFAULT_COMMUNICATION_TOPOLOGY));
+  getParam("number_of_neighbors", number_of_neighbors_, DEFAULT_NUMBER_OF_NEIGHBORS);
+
+  if (communication_topology_ == "all") {
+    // every agent is a neighbor and its slot is its own id, up to the highest expected one (the headless agents
+    // reserve them on the first received statistics, thus never if they are stepped all together by a SwarmState)
+    if (!headless_) {
+      stats_publisher_ = advertiseStatistics(stats_topic_name_);
+      reserveNeighborSlots(getMaxAgentId() + 1);
+    }
+    return;
+  }
+  if (!headless_) {
+    stats_publisher_ = advertiseStatistics(getAgentTopic(stats_topic_name_, agent_id_));
+  }
+
+  // the ring is undirected only with the same number of neighbors on both sides
+  if (communication_topology_ == "ring" && (number_of_neighbors_ < 2 || number_of_neighbors_%2 != 0)) {
+    int number_of_neighbors = std::max(number_of_neighbors_ - number_of_neighbors_%2, 2);
+    CONSOLE_STREAM(WARN, "The ring needs an even number of neighbors (" << number_of_neighbors << " are used).");
+    number_of_neighbors_ = number_of_neighbors;
+  }
+
+  std::set<int> neighbors;
+  if (communication_topology_ == "ring" || communication_topology_ == "knn") {
+    // agent ids range in [1, number_of_agents_], the k-nearest-neighbor graph starts from the ring until assigned
+    for (int d = 1; d <= std::max(number_of_neighbors_/2, 1); d++) {
+      neighbors.insert((agent_id_ - 1 + d)%number_of_agents_ + 1);
+      neighbors.insert((agent_id_ - 1 - d + number_of_agents_)%number_of_agents_ + 1);
+    }
+    if (communication_topology_ == "knn" && headless_) {
+      CONSOLE_STREAM(WARN, "A headless agent cannot receive the k-nearest-neighbor graph (ring graph is used).");
+    }
+    else if (communication_topology_ == "knn") {
+      neighbors_subscriber_ = node_handle_->subscribe(getAgentTopic(neighbors_topic_name_, agent_id_), 1, &AgentCore::neighborsCallback, this);
+    }
+  }
+  else if (communication_topology_ == "adjacency") {
+    std::vector<int> neighbors_list;
+    getParam("neighbors", neighbors_list, std::vector<int>());
+    neighbors.insert(neighbors_list.begin(), neighbors_list.end());
+  }
+  else {
+    CONSOLE_STREAM(ERROR, "Wrong communication topology (" << communication_topology_ << "), the agent has no neighbors.");
+  }
+
+  // the undirected k-nearest-neighbor graph can exceed the given degree (further neighbors take the slow path)
+  int number_of_slots = neighbors.size();
+  if (communication_topology_ == "knn") {
+    number_of_slots = std::max(2*number_of_neighbors_, number_of_slots);
+  }
+  reserveNeighborSlots(number_of_slots);
+  updateNeighbors(neighbors);
+}
+
+double AgentCore::integrator(const double &out_old, const double &in_old, const double &in_new, const double &k,
+                             const double &step) const {
+  return out_old + k*step*(in_old + in_new)/2;
+}
+
+bool AgentCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+void AgentCore::neighborsCallback(const formation_control::AgentNeighbors &msg) {
+  updateNeighbors(std::set<int>(msg.neighbors.begin(), msg.neighbors.end()));
+
+  CONSOLE_STREAM(DEBUG, "Neighbors have been assigned by " << msg.header.frame_id << ".");
+}
+
+void AgentCore::printTiming() const {
+  for (int stage = 0; stage < NUMBER_OF_TIMING_STAGES; stage++) {
+    CONSOLE_STREAM(INFO, "Timing of " << timing_stage_names_.at(stage) << ": " << timing_[stage].toString() << ".");
+  }
+  CONSOLE_STREAM(INFO, "Deadline misses: " << deadline_misses_ << " (sample time " << sample_time_ << "s).");
+}
+
+void AgentCore::processReceivedStats(const formation_control::FormationStatisticsStamped &received,
+                                     const formation_control::FormationStatistics &stats_dot, const bool &slot_check) {
+  int slot = agent_id_ != received.agent_id ? getNeighborSlot(received.agent_id) : -1;
+  if (slot >= 0) {
+    if (headless_ && communication_topology_ == "all" && received_statistics_.getCapacity() == 0) {
+      reserveNeighborSlots(getMaxAgentId() + 1);  // a headless agent is driven by a single thread
+    }
+    double now = getTime().toSec();
+    // they are extrapolated only when collected (see consensus)
+    received_statistics_.store(slot, received.agent_id, received.stats, stats_dot, now, received.header.stamp.toSec());
+    if (enable_link_monitor_) {
+      link_monitor_.add(slot, received.agent_id, received.header.stamp.toSec(), now, slot_check);
+    }
+
+    CONSOLE_STREAM(DEBUG_VV, "Received statistics from " << received.header.frame_id  << ".");
+    CONSOLE_STREAM(DEBUG_VVVV, "Received statistics (" << received.stats.m_x << ", " << received.stats.m_y << ", " << received.stats.m_xx
+                               << ", " << received.stats.m_xy << ", " << received.stats.m_yy << ").");
+  }
+}
+
+void AgentCore::publishDiagnostics() {
+  if (headless_ || diagnostics_rate_ <= 0) {
+    return;
+  }
+
+  ros::Time now = getTime();
+  if (now - last_diagnostics_ < ros::Duration(1.0 / diagnostics_rate_)) {
+    return;
+  }
+  last_diagnostics_ = now;
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "formation_control/" + agent_frame_ + "/links";
+  status.hardware_id = agent_frame_;
+  unsigned long total_reused = 0;
+  unsigned long total_missed = 0;
+  for (int slot = 0; slot < received_statistics_.getCapacity(); slot++) {
+    int id;
+    unsigned long fresh, reused, missed;
+    if (!received_statistics_.getCounters(slot, id, fresh, reused, missed)) {
+      continue;
+    }
+    std::string prefix = frame_agent_prefix_ + std::to_string(id);
+    diagnostic_msgs::KeyValue value;
+    value.key = prefix + "_fresh";
+    value.value = std::to_string(fresh);
+    status.values.push_back(value);
+    value.key = prefix + "_reused";
+    value.value = std::to_string(reused);
+    status.values.push_back(value);
+    value.key = prefix + "_missed";
+    value.value = std::to_string(missed);
+    status.values.push_back(value);
+    total_reused += reused;
+    total_missed += missed;
+  }
+  status.message = std::to_string(status.values.size()/3) + " links, " + std::to_string(total_reused) + " reused and "
+                   + std::to_string(total_missed) + " missed estimates";
+  diagnostic_msgs::KeyValue value;
+  value.key = "sent_estimates";
+  value.value = std::to_string(sent_estimates_);
+  status.values.push_back(value);
+  value.key = "suppressed_estimates";
+  value.value = std::to_string(suppressed_estimates_);
+  status.values.push_back(value);
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = now;
+  msg.status.push_back(status);
+
+  if (enable_timing_) {
+    diagnostic_msgs::DiagnosticStatus timing;
+    timing.name = "formation_control/" + agent_frame_ + "/timing";
+    timing.hardware_id = agent_frame_;
+    for (int stage = 0; stage < NUMBER_OF_TIMING_STAGES; stage++) {
+      diagnostic_msgs::KeyValue value;
+      value.key = timing_stage_names_.at(stage);
+      value.value = timing_[stage].toString();
+      timing.values.push_back(value);
+    }
+    unsigned long deadline_misses = deadline_misses_;
+    diagnostic_msgs::KeyValue value;
+    value.key = "deadline_misses";
+    value.value = std::to_string(deadline_misses);
+    timing.values.push_back(value);
+    // DiagnosticStatus::WARN can't be used because of the console output level macro (see commons.h)
+    timing.level = diagnostic_msgs::DiagnosticStatus::OK + (deadline_misses > last_deadline_misses_);
+    timing.message = std::to_string(deadline_misses - last_deadline_misses_) + " deadline misses since the last report";
+    last_deadline_misses_ = deadline_misses;
+    msg.status.push_back(timing);
+  }
+  if (enable_link_monitor_) {
+    msg.status.push_back(link_monitor_.getStatus("formation_control/" + agent_frame_ + "/latency", agent_frame_,
+                                                 frame_agent_prefix_));
+  }
+  diagnostics_publisher_.publish(msg);
+}
+
+void AgentCore::publishStatistics(const formation_control::FormationStatisticsPredicted &msg) {
+  if (headless_) {
+    return;  // the host hands over the statistics
+  }
+  if (predict_statistics_) {
+    stats_publisher_.publish(msg);
+  }
+  else if (!compact_statistics_) {
+    stats_publisher_.publish(msg.estimate);
+  }
+  else {
+    formation_control::FormationStatisticsCompact compact;
+    if (!compact_codec_.encode(msg.estimate, compact)) {
+      CONSOLE_STREAM(ERROR, "The estimated statistics can't be encoded in the compact format (not published).");
+      return;
+    }
+    stats_publisher_.publish(compact);
+  }
+
+  CONSOLE_STREAM(DEBUG, "Estimated statistics published.");
+}
+
+void AgentCore::receivedStatsArrayCallback(const formation_control::FormationStatisticsArray &received) {
+  // the array is sent in the TDMA slot of the aggregating node
+  if (!StatsGeometry::unpackArray(received, frame_agent_prefix_, frame_virtual_suffix_,
+                                  [this](const std::size_t &i, const formation_control::FormationStatisticsStamped &msg) {
+                                    processReceivedStats(msg, formation_control::FormationStatistics(), false);
+                                  })) {
+    CONSOLE_STREAM(ERROR, "Wrong statistics array sizes (" << received.agent_ids.size() << ", " << received.stats.size() << ").");
+  }
 }
 
 void AgentCore::receivedStatsCallback(const formation_control::FormationStatisticsStamped &received) {
-  if (agent_id_ != received.agent_id) {
-    received_statistics_mutex_.lock();
-    received_statistics_[received.agent_id] = received.stats;
-    received_statistics_mutex_.unlock();
+  processReceivedStats(received, formation_control::FormationStatistics(), true);
+}
 
-    std::stringstream s;
-    s << "Received statistics from " << received.header.frame_id  << ".";
-    console(__func__, s, DEBUG_VV);
-    s << "Received statistics (" << received.stats.m_x << ", " << received.stats.m_y << ", " << received.stats.m_xx
-      << ", " << received.stats.m_xy << ", " << received.stats.m_yy << ").";
-    console(__func__, s, DEBUG_VVVV);
+void AgentCore::receivedStatsCompactCallback(const formation_control::FormationStatisticsCompact &received) {
+  receivedStatsCallback(compact_codec_.decode(received, getTime()));
+}
+
+void AgentCore::receivedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &received) {
+  processReceivedStats(received.estimate, received.stats_dot, true);
+}
+
+LoopRecord AgentCore::replayStep(const LoopRecord &record) {
+  loop_record_ = record;
+  headless_time_.fromSec(record.time);
+  target_statistics_ = StatsGeometry::fromArray(record.target);
+
+  replay_ = true;
+  algorithmStep();
+  replay_ = false;
+  return loop_record_;
+}
+
+void AgentCore::reserveNeighborSlots(const int &number_of_slots) {
+  received_statistics_.reserve(number_of_slots);
+  link_monitor_.reserve(enable_link_monitor_ ? number_of_slots : 0, sample_time_, frame_tdma_, slot_tdma_);
+  // each slot starts assigned to the agent id equal to its index (see StatsMailbox::reserve)
+  slot_ids_.resize(number_of_slots);
+  for (int slot = 0; slot < number_of_slots; slot++) {
+    slot_ids_[slot] = slot;
   }
 }
 
@@ -345,74 +987,229 @@ double AgentCore::saturation(const double &value, const double &min, const doubl
   return std::min(std::max(value, min), max);
 }
 
-void AgentCore::setTheta(geometry_msgs::Quaternion &quat, const double &theta) const {
-  Eigen::Vector3d rpy = getRPY(quat);
-  Eigen::Quaterniond eigen_quat = Eigen::AngleAxisd(rpy(0), Eigen::Vector3d::UnitX())
-                                  * Eigen::AngleAxisd(rpy(1), Eigen::Vector3d::UnitY())
-                                  * Eigen::AngleAxisd(theta, Eigen::Vector3d::UnitZ());
-  tf::quaternionEigenToMsg(eigen_quat, quat);
-
-  std::stringstream s;
-  s << "Quaternion updated (" << quat.x << ", " << quat.y << ", " << quat.z << ", " << quat.w << ").";
-  console(__func__, s, DEBUG_VVVV);
+void AgentCore::setTime(const ros::Time &time) {
+  headless_time_ = time;
 }
 
-Eigen::MatrixXd AgentCore::statsMsgToMatrix(const std::map<int, formation_control::FormationStatistics> &msg) const {
-  Eigen::MatrixXd matrix = Eigen::MatrixXd::Zero(msg.size(), number_of_stats_);
-  int id = 0;
-  for (auto const &stat : msg) {
-    matrix.row(id++) = statsMsgToVector(stat.second);
+VelocityVector AgentCore::solveVelocitySystem(const VelocityMatrix &a, const VelocityVector &b) const {
+  double determinant = a(0,0)*a(1,1) - a(0,1)*a(1,0);
+  if (determinant == 0) {
+    CONSOLE_STREAM(ERROR, "Singular control law matrix (null control commands).");
+    return VelocityVector::Zero();
   }
-  return matrix;
+
+  VelocityVector x;
+  x << (a(1,1)*b(0) - a(0,1)*b(1))/determinant,
+       (a(0,0)*b(1) - a(1,0)*b(0))/determinant;
+  return x;
 }
 
-Eigen::VectorXd AgentCore::statsMsgToVector(const formation_control::FormationStatistics &msg) const {
-  Eigen::VectorXd vector(number_of_stats_);
-  vector << msg.m_x, msg.m_y, msg.m_xx, msg.m_xy, msg.m_yy;
+StatsVector AgentCore::statsMsgToVector(const formation_control::FormationStatistics &msg) const {
+  StatsVector vector;
+  StatsGeometry::toArray(msg, vector.data());
   return vector;
 }
 
-formation_control::FormationStatistics AgentCore::statsVectorToMsg(const Eigen::VectorXd &vector) const {
-  formation_control::FormationStatistics msg;
-  if (vector.size() != number_of_stats_) {
-    std::stringstream s;
-    s << "Wrong statistics vector size (" << vector.size() << ").";
-    console(__func__, s, ERROR);
-    return msg;
+formation_control::FormationStatistics AgentCore::statsVectorToMsg(const StatsVector &vector) const {
+  return StatsGeometry::fromArray(vector.data());
+}
+
+formation_control::FormationStatistics AgentCore::statsVectorToMsg(const std::vector<double> &vector) const {
+  if (vector.size() != DEFAULT_NUMBER_OF_STATS) {
+    CONSOLE_STREAM(ERROR, "Wrong statistics vector size (" << vector.size() << ").");
+    return formation_control::FormationStatistics();
   }
-  msg.m_x = vector(0);
-  msg.m_y = vector(1);
-  msg.m_xx = vector(2);
-  msg.m_xy = vector(3);
-  msg.m_yy = vector(4);
+  return statsVectorToMsg(Eigen::Map<const StatsVector>(vector.data()));
+}
 
-  return msg;
+ros::Subscriber AgentCore::subscribeStatistics(const std::string &topic) {
+  if (compact_statistics_) {
+    return node_handle_->subscribe(topic, topic_queue_length_, &AgentCore::receivedStatsCompactCallback, this);
+  }
+  if (predict_statistics_) {
+    return node_handle_->subscribe(topic, topic_queue_length_, &AgentCore::receivedStatsPredictedCallback, this);
+  }
+  return node_handle_->subscribe(topic, topic_queue_length_, &AgentCore::receivedStatsCallback, this);
 }
 
-formation_control::FormationStatistics AgentCore::statsVectorToMsg(const std::vector<double> &vector) const {
-  std::vector<double> v = vector;  // can't use 'data()' method on const std::vector
-  return statsVectorToMsg(Eigen::Map<Eigen::VectorXd>(v.data(), v.size()));
+void AgentCore::syncAgent() {
+  double sync_timeout;
+  getParam("sync_timeout", sync_timeout, (double)DEFAULT_SYNC_TIMEOUT);
+  formation_control::SyncAgent sync;
+  sync.request.agent_id = agent_id_;
+  sync.request.node_name = ros::this_node::getName();
+
+  CONSOLE_STREAM(INFO, "Wait for the Ground Station sync service (" << sync_service_name_ << ").");
+  if (!ros::service::waitForService(sync_service_name_, ros::Duration(sync_timeout))
+      || !ros::service::call(sync_service_name_, sync)) {
+    CONSOLE_STREAM(WARN, "The Ground Station has not assigned the agent id (" << agent_id_ << " is used).");
+    return;
+  }
+  agent_id_ = sync.response.agent_id;
+  number_of_agents_ = sync.response.number_of_agents;
+  sync_start_time_ = sync.response.start_time;
+
+  CONSOLE_STREAM(INFO, "Agent id " << agent_id_ << " of " << number_of_agents_ << " (common start " << sync_start_time_ << ").");
 }
 
 void AgentCore::targetStatsCallback(const formation_control::FormationStatisticsStamped &target) {
+  if (target.header.stamp < target_stamp_) {
+    return;  // e.g. the latched target of a previous join (see VisualizationCore)
+  }
+  target_stamp_ = target.header.stamp;
   target_statistics_ = target.stats;
 
-  std::stringstream s;
-  s << "Target statistics has been changed.";
-  console(__func__, s, INFO);
-  s << "New target statistics (" << target.stats.m_x << ", " << target.stats.m_y << ", " << target.stats.m_xx << ", "
-    << target.stats.m_xy << ", " << target.stats.m_yy << ").";
-  console(__func__, s, DEBUG_VVVV);
+  CONSOLE_STREAM(INFO, "Target statistics has been changed.");
+  CONSOLE_STREAM(DEBUG_VVVV, "New target statistics (" << target.stats.m_x << ", " << target.stats.m_y << ", " << target.stats.m_xx << ", "
+                             << target.stats.m_xy << ", " << target.stats.m_yy << ").");
+}
+
+void AgentCore::transmitCallback(const ros::TimerEvent &timer_event) {
+  transmit_statistics_mutex_.lock();
+  formation_control::FormationStatisticsPredicted msg = transmit_statistics_;
+  std::chrono::steady_clock::time_point start = updateTiming(TIMING_TDMA_WAIT, transmit_scheduled_);
+  transmit_statistics_mutex_.unlock();
+
+  msg.estimate.header.stamp = getTime();
+  if (triggerBroadcast(msg)) {
+    publishStatistics(msg);
+  }
+  updateTiming(TIMING_PUBLISH, start);
+}
+
+bool AgentCore::triggerBroadcast(const formation_control::FormationStatisticsPredicted &msg) {
+  // compared and updated under the same lock: the late path of algorithmCallback transmits on its own thread while
+  // the timer of a previous transmission can still fire, and the consensus reads the last broadcast as well
+  transmit_statistics_mutex_.lock();
+  const formation_control::FormationStatisticsStamped &last = last_broadcast_statistics_.estimate;
+  if (event_threshold_ > 0 && !last.header.stamp.isZero()) {
+    double time = msg.estimate.header.stamp.toSec() + sample_time_;
+    StatsVector change = statsMsgToVector(msg.estimate.stats)
+                         - extrapolateStatistics(last, last_broadcast_statistics_.stats_dot, time);
+    double distance = std::sqrt(change.cwiseProduct(event_weights_).dot(change));
+    bool heartbeat = msg.estimate.header.stamp - last.header.stamp >= ros::Duration(event_max_silence_);
+    if (distance <= event_threshold_ && !heartbeat) {
+      suppressed_estimates_++;
+      transmit_statistics_mutex_.unlock();
+      return false;
+    }
+  }
+
+  last_broadcast_statistics_ = msg;
+  sent_estimates_++;
+  transmit_statistics_mutex_.unlock();
+  return true;
+}
+
+void AgentCore::updateLoopRecord() {
+  StatsGeometry::toArray(estimated_statistics_, loop_record_.estimate);
+  loop_record_.twist_virtual[0] = twist_virtual_.linear.x;
+  loop_record_.twist_virtual[1] = twist_virtual_.linear.y;
+  loop_record_.speed_command = speed_command_sat_;
+  loop_record_.steer_command = steer_command_sat_;
+  loop_record_.pose[0] = pose_.position.x;
+  loop_record_.pose[1] = pose_.position.y;
+  loop_record_.pose[2] = theta_;
+  loop_record_.pose_virtual[0] = pose_virtual_.position.x;
+  loop_record_.pose_virtual[1] = pose_virtual_.position.y;
+  loop_record_.pose_virtual[2] = theta_virtual_;
+
+  if (loop_recorder_ && !loop_recorder_->append(loop_record_)) {
+    CONSOLE_STREAM(ERROR, "Can't append to the loop recording (recording stopped).");
+    delete loop_recorder_;
+    loop_recorder_ = nullptr;
+  }
+}
+
+void AgentCore::updateMarkerPath(const geometry_msgs::Point &point, const ros::Time &stamp, MarkerPath &path) const {
+  if (path.points.empty() || std::hypot(point.x - path.points.back().x, point.y - path.points.back().y) >= marker_path_resolution_) {
+    path.points.push_back(point);
+    path.stamps.push_back(stamp);
+    path.changed = true;
+  }
+
+  ros::Duration lifetime(marker_path_lifetime_);
+  while (path.points.size() > 1 && (stamp - path.stamps.front() > lifetime || (int)path.points.size() > marker_path_max_points_)) {
+    path.points.pop_front();
+    path.stamps.pop_front();
+    path.changed = true;
+  }
+}
+
+void AgentCore::updateNeighbors(const std::set<int> &neighbors) {
+  std::lock_guard<std::mutex> lock(neighbors_mutex_);
+  neighbors_ = neighbors;
+  neighbors_.erase(agent_id_);
+
+  // the kept neighbors keep their slot and the new ones take the free slots, or the slow path past the last slot
+  std::vector<int> old_slot_ids = slot_ids_;
+  neighbor_slots_.clear();
+  for (std::size_t slot = 0; slot < slot_ids_.size(); slot++) {
+    if (slot_ids_[slot] >= 0 && !neighbors_.count(slot_ids_[slot])) {
+      slot_ids_[slot] = -1;
+    }
+    else if (slot_ids_[slot] >= 0) {
+      neighbor_slots_[slot_ids_[slot]] = slot;
+    }
+  }
+  std::size_t free_slot = 0;
+  for (auto const &id : neighbors_) {
+    if (neighbor_slots_.count(id)) {
+      continue;
+    }
+    while (free_slot < slot_ids_.size() && slot_ids_[free_slot] >= 0) {
+      free_slot++;
+    }
+    if (free_slot < slot_ids_.size()) {
+      slot_ids_[free_slot] = id;
+    }
+    neighbor_slots_[id] = free_slot < slot_ids_.size() ? free_slot : slot_ids_.size() + id;
+  }
+  for (std::size_t slot = 0; slot < slot_ids_.size(); slot++) {
+    if (slot_ids_[slot] != old_slot_ids[slot]) {
+      received_statistics_.assign(slot, slot_ids_[slot]);
+      link_monitor_.assign(slot, slot_ids_[slot]);
+    }
+  }
+
+  // removes the subscriptions to the old neighbors and adds the new ones (the hosted agents are handled in memory)
+  for (auto it = neighbor_stats_subscribers_.begin(); it != neighbor_stats_subscribers_.end(); ) {
+    if (!neighbors_.count(it->first)) {
+      it = neighbor_stats_subscribers_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  for (auto const &id : neighbors_) {
+    if (!headless_ && !hosted_agent_ids_.count(id) && !neighbor_stats_subscribers_.count(id)) {
+      neighbor_stats_subscribers_[id] = subscribeStatistics(getAgentTopic(stats_topic_name_, id));
+    }
+  }
+
+  CONSOLE_STREAM(INFO, "Communication graph updated (" << neighbors_.size() << " neighbors, "
+                       << neighbor_stats_subscribers_.size() << " subscriptions).");
+}
+
+std::chrono::steady_clock::time_point AgentCore::updateTiming(const int &stage,
+                                                             const std::chrono::steady_clock::time_point &start) {
+  if (!enable_timing_) {
+    return start;
+  }
+  std::chrono::steady_clock::time_point now = LatencyHistogram::now();
+  timing_[stage].add(std::chrono::duration<double>(now - start).count());
+  return now;
 }
 
 void AgentCore::waitForSlotTDMA(const double &deadline) const{
   ros::Time slot;
-  // rounds to the current exact decisecond (hhmmss:x00) plus the proper deadline (agent dependent)
-  slot.fromSec(std::floor(ros::Time::now().toSec()*10)/10 + deadline);
+  // rounds to the beginning of the current TDMA frame plus the proper deadline (the frames before the common start
+  // are collapsed in the one which ends on it)
+  double start = sync_start_time_.toSec();
+  double frames = std::max(std::floor((getTime().toSec() - start)/frame_tdma_), -1.0);
+  slot.fromSec(start + frames*frame_tdma_ + deadline);
 
-  std::stringstream s;
-  s << "Wait for TDMA slot (" << slot << ").";
-  console(__func__, s, INFO);
+  CONSOLE_STREAM(INFO, "Wait for TDMA slot (" << slot << ").");
 
   ros::Time::sleepUntil(slot);
 }
@@ -0,0 +1,297 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+#include "agent_core.h"
+#include "moments_accumulator.h"
+#include "spatial_grid.h"
+#include "swarm_state.h"
+
+// number of neighbors (or agents) of each benchmark: from a small swarm to the largest expected one
+#define BENCHMARK_RANGE_MIN 5
+#define BENCHMARK_RANGE_MAX 10000
+#define BENCHMARK_RANGE_MULTIPLIER 10
+#define BENCHMARK_SEED 0
+#define BENCHMARK_WORLD_LIMIT 1.0  // in meters, considering a "square world" (like DEFAULT_WORLD_LIMIT)
+#define BENCHMARK_NUMBER_OF_NEIGHBORS 2  // k of the k-nearest-neighbor queries
+
+/*  Returns the params of a headless agent with a reproducible initial pose (see SimulationCore), whose sample time
+ *  guarantees the consensus convergence with the given number of agents (otherwise each step logs an error).
+ *
+ *  Parameters:
+ *    + agent_id: id of the agent;
+ *    + number_of_agents: number of agents of the swarm (it sizes the mailbox of the agent);
+ *    + swarm_size: number of agents of the consensus (it bounds the sample time);
+ *    + generator: random generator of the initial pose passed by reference.
+ *  Return value:
+ *    + params of the agent.
+ */
+AgentParameters makeAgentParameters(const int &agent_id, const int &number_of_agents, const int &swarm_size,
+                                    std::mt19937 &generator) {
+  std::uniform_real_distribution<> distrib_position(-BENCHMARK_WORLD_LIMIT, BENCHMARK_WORLD_LIMIT);
+  std::uniform_real_distribution<> distrib_orientation(-M_PI, M_PI);
+  AgentParameters parameters;
+  parameters["agent_id"] = agent_id;
+  parameters["number_of_agents"] = number_of_agents;
+  parameters["sample_time"] = std::min((double)DEFAULT_SAMPLE_TIME, 0.5/swarm_size);
+  parameters["x"] = distrib_position(generator);
+  parameters["y"] = distrib_position(generator);
+  parameters["theta"] = distrib_orientation(generator);
+  // the statistics received once are reused in every step, as for neighbors which never stop sending
+  parameters["stale_statistics_max_age"] = std::numeric_limits<double>::max();
+  return parameters;
+}
+
+/*  Returns the given number of random statistics messages of different agents (from id 2 onwards), as received from
+ *  the shared statistics topic.
+ *
+ *  Parameters:
+ *    + n: number of messages;
+ *    + generator: random generator of the statistics passed by reference.
+ *  Return value:
+ *    + statistics messages.
+ */
+std::vector<formation_control::FormationStatisticsStamped> makeStatistics(const int &n, std::mt19937 &generator) {
+  std::uniform_real_distribution<> distrib_position(-BENCHMARK_WORLD_LIMIT, BENCHMARK_WORLD_LIMIT);
+  std::vector<formation_control::FormationStatisticsStamped> messages(n);
+  for (int i = 0; i < n; i++) {
+    double x = distrib_position(generator);
+    double y = distrib_position(generator);
+    messages.at(i).header.stamp = ros::Time(1, 0);
+    messages.at(i).agent_id = i + 2;
+    messages.at(i).stats.m_x = x;
+    messages.at(i).stats.m_y = y;
+    messages.at(i).stats.m_xx = x*x;
+    messages.at(i).stats.m_xy = x*y;
+    messages.at(i).stats.m_yy = y*y;
+  }
+  return messages;
+}
+
+/*  Benchmarks the whole algorithm step of a headless agent (consensus on the statistics of the given number of
+ *  neighbors, control, guidance and dynamics), as executed every sample time by each agent.
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of neighbors).
+ */
+void agentStep(benchmark::State &state) {
+  int number_of_neighbors = state.range(0);
+  std::mt19937 generator(BENCHMARK_SEED);
+  AgentParameters parameters = makeAgentParameters(1, number_of_neighbors + 1, number_of_neighbors + 1, generator);
+  AgentCore *agent = new AgentCore(parameters, std::set<int>({1}));
+  for (auto const &msg : makeStatistics(number_of_neighbors, generator)) {
+    agent->receivedStatsCallback(msg);
+  }
+  double sample_time = agent->getGains().sample_time;
+
+  ros::Time time(1, 0);
+  for (auto _ : state) {
+    agent->algorithmStep();
+    time += ros::Duration(sample_time);
+    agent->setTime(time);
+  }
+  delete agent;
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(number_of_neighbors);
+}
+
+/*  Benchmarks the reception of the statistics of the given number of neighbors by a headless agent (i.e. the
+ *  callbacks of the shared statistics topic during a sample time).
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of neighbors).
+ */
+void agentReceive(benchmark::State &state) {
+  int number_of_neighbors = state.range(0);
+  std::mt19937 generator(BENCHMARK_SEED);
+  AgentParameters parameters = makeAgentParameters(1, number_of_neighbors + 1, number_of_neighbors + 1, generator);
+  AgentCore *agent = new AgentCore(parameters, std::set<int>({1}));
+  std::vector<formation_control::FormationStatisticsStamped> messages = makeStatistics(number_of_neighbors, generator);
+
+  for (auto _ : state) {
+    for (auto const &msg : messages) {
+      agent->receivedStatsCallback(msg);
+    }
+  }
+  delete agent;
+  state.SetItemsProcessed(state.iterations()*number_of_neighbors);
+  state.SetComplexityN(number_of_neighbors);
+}
+
+/*  Benchmarks the batched algorithm step of the given number of agents (see SwarmState), as executed every sample
+ *  time by the headless simulation.
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of agents).
+ */
+void swarmStateStep(benchmark::State &state) {
+  int number_of_agents = state.range(0);
+  std::mt19937 generator(BENCHMARK_SEED);
+  SwarmState *swarm_state = nullptr;
+  for (int id = 1; id <= number_of_agents; id++) {
+    // the id only sizes the mailbox of the agent, which is not copied
+    AgentCore *agent = new AgentCore(makeAgentParameters(1, 1, number_of_agents, generator), std::set<int>({1}));
+    if (!swarm_state) {
+      swarm_state = new SwarmState(agent->getGains(), DEFAULT_VERBOSITY_LEVEL);
+    }
+    swarm_state->addAgent(*agent);
+    delete agent;
+  }
+
+  for (auto _ : state) {
+    swarm_state->algorithmStep();
+  }
+  delete swarm_state;
+  state.SetItemsProcessed(state.iterations()*number_of_agents);
+  state.SetComplexityN(number_of_agents);
+}
+
+/*  Benchmarks the update of the effective statistics of the swarm when all the given agents move (i.e. the ingest of
+ *  the agent poses in the visualization, see MomentsAccumulator).
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of agents).
+ */
+void momentsUpdate(benchmark::State &state) {
+  int number_of_agents = state.range(0);
+  std::mt19937 generator(BENCHMARK_SEED);
+  std::uniform_real_distribution<> distrib_position(-BENCHMARK_WORLD_LIMIT, BENCHMARK_WORLD_LIMIT);
+  std::vector<double> x(number_of_agents), y(number_of_agents);
+  MomentsAccumulator moments;
+  for (int i = 0; i < number_of_agents; i++) {
+    x.at(i) = distrib_position(generator);
+    y.at(i) = distrib_position(generator);
+    moments.add(x.at(i), y.at(i));
+  }
+
+  double delta = 1e-3;  // back and forth, thus the poses never drift
+  for (auto _ : state) {
+    for (int i = 0; i < number_of_agents; i++) {
+      moments.update(x.at(i), y.at(i), x.at(i) + delta, y.at(i) - delta);
+      x.at(i) += delta;
+      y.at(i) -= delta;
+    }
+    delta = -delta;
+    benchmark::DoNotOptimize(moments.getStatistics());
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_agents);
+  state.SetComplexityN(number_of_agents);
+}
+
+/*  Benchmarks the conversion of the given number of statistics to ellipses (i.e. the estimates of all the agents
+ *  displayed in the visualization), both one by one with the orientation correction and in a single batch.
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of statistics, range(1) whether the batch conversion is used).
+ */
+void statsToEllipses(benchmark::State &state) {
+  int n = state.range(0);
+  bool batch = state.range(1);
+  std::mt19937 generator(BENCHMARK_SEED);
+  std::vector<formation_control::FormationStatisticsStamped> messages = makeStatistics(n, generator);
+  std::vector<std::vector<double>> stats(StatsGeometry::NUMBER_OF_STATS, std::vector<double>(n));
+  std::vector<std::vector<double>> ellipses(StatsGeometry::NUMBER_OF_STATS, std::vector<double>(n));
+  const double *stats_arrays[StatsGeometry::NUMBER_OF_STATS];
+  double *ellipses_arrays[StatsGeometry::NUMBER_OF_STATS];
+  for (int s = 0; s < StatsGeometry::NUMBER_OF_STATS; s++) {
+    stats_arrays[s] = stats.at(s).data();
+    ellipses_arrays[s] = ellipses.at(s).data();
+  }
+  for (int i = 0; i < n; i++) {
+    // the same variances of the agent poses, thus each ellipse is a proper one
+    messages.at(i).stats.m_xx += 0.5;
+    messages.at(i).stats.m_yy += 0.25;
+    double values[StatsGeometry::NUMBER_OF_STATS];
+    StatsGeometry::toArray(messages.at(i).stats, values);
+    for (int s = 0; s < StatsGeometry::NUMBER_OF_STATS; s++) {
+      stats.at(s).at(i) = values[s];
+    }
+  }
+
+  std::vector<double> theta_old(n, 0);
+  for (auto _ : state) {
+    if (batch) {
+      StatsGeometry::statsToEllipses(n, stats_arrays, ellipses_arrays);
+      benchmark::ClobberMemory();
+      continue;
+    }
+    for (int i = 0; i < n; i++) {
+      StatsEllipse ellipse = StatsGeometry::statsToEllipse(messages.at(i).stats, theta_old.at(i));
+      benchmark::DoNotOptimize(ellipse);
+    }
+  }
+  state.SetItemsProcessed(state.iterations()*n);
+  state.SetComplexityN(n);
+}
+
+/*  Benchmarks the assignment of the k-nearest neighbors of the given number of agents (see SpatialGrid), as executed
+ *  every sample time by the visualization with the "knn" communication topology.
+ *
+ *  Parameters:
+ *    + state: benchmark state (range(0) is the number of agents).
+ */
+void spatialGridKnn(benchmark::State &state) {
+  int number_of_agents = state.range(0);
+  std::mt19937 generator(BENCHMARK_SEED);
+  std::uniform_real_distribution<> distrib_position(-BENCHMARK_WORLD_LIMIT, BENCHMARK_WORLD_LIMIT);
+  std::vector<int> ids(number_of_agents);
+  std::vector<double> x(number_of_agents), y(number_of_agents);
+  for (int i = 0; i < number_of_agents; i++) {
+    ids.at(i) = i + 1;
+    x.at(i) = distrib_position(generator);
+    y.at(i) = distrib_position(generator);
+  }
+
+  SpatialGrid grid;
+  std::vector<std::pair<double, int>> result;
+  for (auto _ : state) {
+    grid.build(number_of_agents, ids.data(), x.data(), y.data(), 0);
+    for (int i = 0; i < number_of_agents; i++) {
+      grid.knn(x.at(i), y.at(i), BENCHMARK_NUMBER_OF_NEIGHBORS, ids.at(i), result);
+    }
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_agents);
+  state.SetComplexityN(number_of_agents);
+}
+
+BENCHMARK(agentStep)->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)->Range(BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX)
+                    ->Complexity();
+BENCHMARK(agentReceive)->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)->Range(BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX)
+                       ->Complexity();
+BENCHMARK(swarmStateStep)->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)->Range(BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX)
+                         ->Complexity();
+BENCHMARK(momentsUpdate)->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)->Range(BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX)
+                        ->Complexity();
+BENCHMARK(statsToEllipses)->ArgNames({"n", "batch"})->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)
+                          ->Ranges({{BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX}, {0, 1}});
+BENCHMARK(spatialGridKnn)->RangeMultiplier(BENCHMARK_RANGE_MULTIPLIER)->Range(BENCHMARK_RANGE_MIN, BENCHMARK_RANGE_MAX)
+                         ->Complexity();
+
+int main(int argc, char **argv) {
+  // no ros::init: there is no ROS master, the benchmarked agents are headless
+  ros::Time::init();
+
+  // the periodic info messages of the agents would dominate the timings
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  // e.g. --benchmark_format=json or --benchmark_out=results.json for the machine-readable results
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_core.h"
+
+ReplayCore::ReplayCore(const std::string &path, const int &verbosity_level) {
+  verbosity_level_ = verbosity_level;
+  if (!recording_.load(path)) {
+    CONSOLE_STREAM(ERROR, "Can't load the recording " << path << " (missing or recorded by a different build).");
+    return;
+  }
+
+  // the same gains and initial pose of the recorded agent (the guidance steps are always in the algorithm step)
+  const LoopRecordHeader &header = recording_.getHeader();
+  const AgentGains &gains = header.gains;
+  XmlRpc::XmlRpcValue gamma, lambda, b;
+  for (int i = 0; i < DEFAULT_NUMBER_OF_STATS; i++) {
+    gamma[i] = gains.gamma[i];
+    lambda[i] = gains.lambda[i];
+  }
+  for (int i = 0; i < DEFAULT_NUMBER_OF_VELOCITIES; i++) {
+    b[i] = gains.b[i];
+  }
+  agent_parameters_["agent_id"] = header.agent_id;
+  agent_parameters_["number_of_agents"] = header.number_of_agents;
+  agent_parameters_["verbosity_level"] = verbosity_level_;
+  agent_parameters_["x"] = header.x;
+  agent_parameters_["y"] = header.y;
+  agent_parameters_["theta"] = header.theta;
+  agent_parameters_["sample_time"] = gains.sample_time;
+  agent_parameters_["guidance_sample_time"] = gains.sample_time/gains.guidance_steps;
+  agent_parameters_["velocity_virtual_threshold"] = gains.velocity_virtual_threshold;
+  agent_parameters_["speed_min"] = gains.speed_min;
+  agent_parameters_["speed_max"] = gains.speed_max;
+  agent_parameters_["steer_min"] = gains.steer_min;
+  agent_parameters_["steer_max"] = gains.steer_max;
+  agent_parameters_["k_p_speed"] = gains.k_p_speed;
+  agent_parameters_["k_p_steer"] = gains.k_p_steer;
+  agent_parameters_["vehicle_length"] = gains.vehicle_length;
+  agent_parameters_["diag_elements_gamma"] = gamma;
+  agent_parameters_["diag_elements_lambda"] = lambda;
+  agent_parameters_["diag_elements_b"] = b;
+
+  CONSOLE_STREAM(DEBUG, "Loaded " << recording_.getNumberOfRecords() << " steps of agent " << header.agent_id << ".");
+}
+
+double ReplayCore::computeError(const LoopRecord &recorded, const LoopRecord &replayed) const {
+  double error = 0;
+  for (int i = 0; i < DEFAULT_NUMBER_OF_STATS; i++) {
+    error = std::max(error, std::abs(recorded.estimate[i] - replayed.estimate[i]));
+  }
+  for (int i = 0; i < DEFAULT_NUMBER_OF_VELOCITIES; i++) {
+    error = std::max(error, std::abs(recorded.twist_virtual[i] - replayed.twist_virtual[i]));
+  }
+  error = std::max(error, std::abs(recorded.speed_command - replayed.speed_command));
+  error = std::max(error, std::abs(recorded.steer_command - replayed.steer_command));
+  for (int i = 0; i < 2; i++) {
+    error = std::max(error, std::abs(recorded.pose[i] - replayed.pose[i]));
+    error = std::max(error, std::abs(recorded.pose_virtual[i] - replayed.pose_virtual[i]));
+  }
+  double theta_error = angles::shortest_angular_distance(recorded.pose[2], replayed.pose[2]);
+  double theta_virtual_error = angles::shortest_angular_distance(recorded.pose_virtual[2], replayed.pose_virtual[2]);
+  error = std::max(error, std::max(std::abs(theta_error), std::abs(theta_virtual_error)));
+  return error;
+}
+
+std::string ReplayCore::consolePrefix(const std::string &caller_name) const {
+  return "[ReplayCore::" + caller_name + "]  ";
+}
+
+bool ReplayCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+bool ReplayCore::isLoaded() const {
+  return recording_.isOpen();
+}
+
+ReplayResults ReplayCore::run(const int &repetitions, const double &tolerance) {
+  ReplayResults results;
+  results.agent_id = isLoaded() ? recording_.getHeader().agent_id : -1;
+  results.steps = recording_.getNumberOfRecords();
+  results.first_divergence = -1;
+  results.max_error = 0;
+  results.steps_per_second = 0;
+  if (!isLoaded()) {
+    return results;
+  }
+
+  std::chrono::duration<double> elapsed(0);
+  for (int r = 0; r < repetitions; r++) {
+    AgentCore *agent = new AgentCore(agent_parameters_, std::set<int>({results.agent_id}));
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < results.steps; k++) {
+      LoopRecord replayed = agent->replayStep(recording_.getRecord(k));
+      if (r > 0) {
+        continue;
+      }
+      double error = computeError(recording_.getRecord(k), replayed);
+      results.max_error = std::max(results.max_error, error);
+      if (!(error <= tolerance) && results.first_divergence < 0) {
+        results.first_divergence = k;
+        CONSOLE_STREAM(WARN, "The replay diverges at step " << k << " (error " << error << ").");
+      }
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+    delete agent;
+  }
+  results.steps_per_second = (elapsed.count() > 0) ? repetitions*results.steps / elapsed.count() : 0;
+  return results;
+}
@@ -0,0 +1,85 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_core.h"
+
+#define REPLAY_USAGE "Usage: replay [--repeat 1] [--tolerance 1e-9] [--verbosity_level 1] recording.rec [...]\n"
+
+int main(int argc, char **argv) {
+  // no ros::init: there is no ROS master, the replayed agents are headless
+  ros::Time::init();
+
+  int repetitions = DEFAULT_REPLAY_REPETITIONS;
+  double tolerance = DEFAULT_REPLAY_TOLERANCE;
+  int verbosity_level = DEFAULT_VERBOSITY_LEVEL;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--help") {
+      std::cout << REPLAY_USAGE;
+      return 0;
+    }
+    if (option.compare(0, 2, "--") != 0) {
+      paths.push_back(option);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cout << REPLAY_USAGE;
+      return 1;
+    }
+    std::string value = argv[++i];
+
+    if (option == "--repeat") {
+      repetitions = std::stoi(value);
+    }
+    else if (option == "--tolerance") {
+      tolerance = std::stod(value);
+    }
+    else if (option == "--verbosity_level") {
+      verbosity_level = std::stoi(value);
+    }
+    else {
+      std::cout << "Unknown option " << option << "\n" << REPLAY_USAGE;
+      return 1;
+    }
+  }
+  if (paths.empty()) {
+    std::cout << REPLAY_USAGE;
+    return 1;
+  }
+
+  // the periodic info messages of the agents would dominate the replay time
+  if (verbosity_level <= DEFAULT_VERBOSITY_LEVEL
+      && ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  int diverged = 0;
+  std::cout << "recording,agent,steps,first_divergence,max_error,steps_per_second" << std::endl;
+  for (auto const &path : paths) {
+    ReplayCore *replay = new ReplayCore(path, verbosity_level);
+    if (!replay->isLoaded()) {
+      delete replay;
+      return 1;
+    }
+    ReplayResults results = replay->run(repetitions, tolerance);
+    delete replay;
+
+    diverged += (results.first_divergence >= 0);
+    std::cout << path << "," << results.agent_id << "," << results.steps << "," << results.first_divergence << ","
+              << results.max_error << "," << results.steps_per_second << std::endl;
+  }
+
+  return (diverged > 0) ? 2 : 0;
+}
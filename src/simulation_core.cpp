@@ -0,0 +1,180 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulation_core.h"
+
+SimulationCore::SimulationCore(const SimulationSettings &settings, const AgentParameters &agent_parameters) {
+  settings_ = settings;
+  verbosity_level_ = settings_.verbosity_level;
+
+  // simulated time of this run only, provided to each agent (it starts from 1 like that of the headless agents)
+  time_ = ros::Time(1, 0);
+
+  // the initial poses are reproducible (the agents would otherwise use a random device)
+  std::mt19937 generator(settings_.seed);
+  std::uniform_real_distribution<> distrib_position(-settings_.world_limit, settings_.world_limit);
+  std::uniform_real_distribution<> distrib_orientation(-M_PI, M_PI);
+
+  for (int id = 1; id <= settings_.number_of_agents; id++) {
+    hosted_agent_ids_.insert(id);
+  }
+  for (auto const &id : hosted_agent_ids_) {
+    AgentParameters parameters = agent_parameters;
+    parameters["sample_time"] = XmlRpc::XmlRpcValue(settings_.sample_time);
+    parameters["number_of_agents"] = XmlRpc::XmlRpcValue(settings_.number_of_agents);
+    parameters["verbosity_level"] = XmlRpc::XmlRpcValue(settings_.verbosity_level);
+    parameters["agent_id"] = XmlRpc::XmlRpcValue(id);
+    parameters["x"] = XmlRpc::XmlRpcValue(distrib_position(generator));
+    parameters["y"] = XmlRpc::XmlRpcValue(distrib_position(generator));
+    parameters["theta"] = XmlRpc::XmlRpcValue(distrib_orientation(generator));
+    agents_.push_back(new AgentCore(parameters, hosted_agent_ids_));
+    agents_.back()->setTime(time_);
+  }
+
+  if (settings_.target_statistics.size() != DEFAULT_NUMBER_OF_STATS) {
+    CONSOLE_STREAM(ERROR, "Wrong target statistics size (" << settings_.target_statistics.size() << "), zeros are used.");
+    settings_.target_statistics.assign(DEFAULT_NUMBER_OF_STATS, 0);
+  }
+  target_statistics_.m_x = settings_.target_statistics.at(0);
+  target_statistics_.m_y = settings_.target_statistics.at(1);
+  target_statistics_.m_xx = settings_.target_statistics.at(2);
+  target_statistics_.m_xy = settings_.target_statistics.at(3);
+  target_statistics_.m_yy = settings_.target_statistics.at(4);
+
+  formation_control::FormationStatisticsStamped target;
+  target.header.stamp = time_;
+  target.stats = target_statistics_;
+  for (auto const &agent : agents_) {
+    agent->targetStatsCallback(target);
+  }
+
+  swarm_state_ = nullptr;
+  XmlRpc::XmlRpcValue topology(DEFAULT_COMMUNICATION_TOPOLOGY);
+  if (agent_parameters.count("communication_topology")) {
+    topology = agent_parameters.at("communication_topology");
+  }
+  if (settings_.batched && (topology.getType() != XmlRpc::XmlRpcValue::TypeString
+                            || static_cast<std::string>(topology) != "all")) {
+    CONSOLE_STREAM(WARN, "Batched mode supports only the \"all\" communication topology (disabled).");
+    settings_.batched = false;
+  }
+  if (settings_.batched && agent_parameters.count("event_threshold")
+      && static_cast<double>(XmlRpc::XmlRpcValue(agent_parameters.at("event_threshold"))) > 0) {
+    CONSOLE_STREAM(WARN, "Batched mode does not support the event triggered broadcast (disabled).");
+    settings_.batched = false;
+  }
+  if (settings_.batched && !agents_.empty()) {
+    swarm_state_ = new SwarmState(agents_.front()->getGains(), settings_.verbosity_level);
+    for (auto const &agent : agents_) {
+      swarm_state_->addAgent(*agent);
+    }
+  }
+
+  CONSOLE_STREAM(DEBUG, "Simulating " << agents_.size() << " agents.");
+}
+
+SimulationCore::~SimulationCore() {
+  delete swarm_state_;
+  for (auto const &agent : agents_) {
+    delete agent;
+  }
+}
+
+double SimulationCore::computeError() const {
+  MomentsAccumulator moments;
+  if (swarm_state_) {
+    const std::vector<double> &x = swarm_state_->getX();
+    const std::vector<double> &y = swarm_state_->getY();
+    for (int i = 0; i < (int)x.size(); i++) {
+      moments.add(x.at(i), y.at(i));
+    }
+  }
+  else {
+    for (auto const &agent : agents_) {
+      geometry_msgs::Pose pose = agent->getPose();
+      moments.add(pose.position.x, pose.position.y);
+    }
+  }
+  formation_control::FormationStatistics effective = moments.getStatistics();
+
+  return std::sqrt(std::pow(effective.m_x - target_statistics_.m_x, 2) + std::pow(effective.m_y - target_statistics_.m_y, 2)
+                   + std::pow(effective.m_xx - target_statistics_.m_xx, 2) + std::pow(effective.m_xy - target_statistics_.m_xy, 2)
+                   + std::pow(effective.m_yy - target_statistics_.m_yy, 2));
+}
+
+std::string SimulationCore::consolePrefix(const std::string &caller_name) const {
+  return "[SimulationCore::" + caller_name + "]  ";
+}
+
+bool SimulationCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+SimulationResults SimulationCore::run() {
+  SimulationResults results;
+  results.number_of_agents = agents_.size();
+  results.steps = std::round(settings_.duration / settings_.sample_time);
+  results.convergence_time = -1;
+  results.final_error = computeError();
+
+  long sent = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 1; k <= results.steps; k++) {
+    sent += step();
+
+    results.final_error = computeError();
+    if (!(results.final_error <= settings_.tolerance)) {
+      results.convergence_time = -1;  // the error has to stay below the tolerance (nan if diverged)
+    }
+    else if (results.convergence_time < 0) {
+      results.convergence_time = k*settings_.sample_time;
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  results.steps_per_second = (elapsed.count() > 0) ? results.steps / elapsed.count() : 0;
+  results.sent_ratio = (results.steps*results.number_of_agents > 0) ? (double)sent/(results.steps*results.number_of_agents) : 0;
+
+  CONSOLE_STREAM(DEBUG, "Simulated " << results.steps << " steps in " << elapsed.count() << "s.");
+  return results;
+}
+
+int SimulationCore::step() {
+  if (swarm_state_) {
+    swarm_state_->algorithmStep();
+    time_ += ros::Duration(settings_.sample_time);
+    return swarm_state_->getNumberOfAgents();
+  }
+
+  // all the agents compute their step on the statistics shared during the previous sample time
+  for (auto const &agent : agents_) {
+    agent->algorithmStep();
+  }
+
+  int sent = 0;
+  for (auto const &agent : agents_) {
+    formation_control::FormationStatisticsPredicted msg = agent->getSharedStatistics();
+    if (!agent->triggerBroadcast(msg)) {
+      continue;
+    }
+    sent++;
+    for (auto const &receiver : agents_) {
+      receiver->receivedStatsPredictedCallback(msg);  // messages sent by the receiver itself are discarded
+    }
+  }
+
+  time_ += ros::Duration(settings_.sample_time);
+  for (auto const &agent : agents_) {
+    agent->setTime(time_);
+  }
+  return sent;
+}
@@ -0,0 +1,152 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulation_core.h"
+
+#define SIMULATION_USAGE "Usage: simulation [--agents 5,9,100,1000] [--duration 60] [--sample_time 0.1] "\
+                         "[--tolerance 0.05] [--seed 0] [--world_limit 1] [--target 0,0,1,0,1] "\
+                         "[--gamma 100,100,5,10,5] [--lambda 0,0,0,0,0] [--b 100,100] "\
+                         "[--communication_topology all] [--number_of_neighbors 2] [--verbosity_level 1] "\
+                         "[--batched 0] [--event_threshold 0] [--event_max_silence 1] [--guidance_sample_time 0.1] "\
+                         "[--random_seed -1] [--record_prefix path/prefix_] [--predict_statistics 0] "\
+                         "[--prediction_max_horizon 0.2]\n"
+
+/*  Splits the given comma separated list of numbers.
+ *
+ *  Parameters:
+ *    + list: comma separated list (e.g. "1,2,3").
+ *  Return value:
+ *    + vector of the numbers in the list.
+ */
+std::vector<double> parseList(const std::string &list) {
+  std::vector<double> values;
+  std::stringstream s(list);
+  std::string value;
+  while (std::getline(s, value, ',')) {
+    values.push_back(std::stod(value));
+  }
+  return values;
+}
+
+/*  Converts the given vector of numbers to an XmlRpc array (as it would be retrieved from a ROS param).
+ *
+ *  Parameters:
+ *    + values: vector of numbers.
+ *  Return value:
+ *    + XmlRpc array of doubles.
+ */
+XmlRpc::XmlRpcValue toXmlRpc(const std::vector<double> &values) {
+  XmlRpc::XmlRpcValue array;
+  for (int i = 0; i < (int)values.size(); i++) {
+    array[i] = values.at(i);
+  }
+  return array;
+}
+
+int main(int argc, char **argv) {
+  // no ros::init: there is no ROS master, only the simulated ROS time is used
+  ros::Time::init();
+
+  std::vector<double> numbers_of_agents = {5, 9, 100, 1000};
+  SimulationSettings settings;
+  settings.sample_time = DEFAULT_SAMPLE_TIME;
+  settings.duration = DEFAULT_SIMULATION_DURATION;
+  settings.tolerance = DEFAULT_SIMULATION_TOLERANCE;
+  settings.seed = DEFAULT_SIMULATION_SEED;
+  settings.world_limit = 1.0;
+  settings.target_statistics = {0, 0, 1, 0, 1};
+  settings.verbosity_level = DEFAULT_VERBOSITY_LEVEL;
+  settings.batched = false;
+  AgentParameters agent_parameters;
+
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--help" || i + 1 >= argc) {
+      std::cout << SIMULATION_USAGE;
+      return (option == "--help") ? 0 : 1;
+    }
+    std::string value = argv[++i];
+
+    if (option == "--agents") {
+      numbers_of_agents = parseList(value);
+    }
+    else if (option == "--duration") {
+      settings.duration = std::stod(value);
+    }
+    else if (option == "--sample_time") {
+      settings.sample_time = std::stod(value);
+    }
+    else if (option == "--tolerance") {
+      settings.tolerance = std::stod(value);
+    }
+    else if (option == "--seed") {
+      settings.seed = std::stoul(value);
+    }
+    else if (option == "--world_limit") {
+      settings.world_limit = std::stod(value);
+    }
+    else if (option == "--target") {
+      settings.target_statistics = parseList(value);
+    }
+    else if (option == "--gamma" || option == "--lambda" || option == "--b") {
+      agent_parameters["diag_elements_" + option.substr(2)] = toXmlRpc(parseList(value));
+    }
+    else if (option == "--communication_topology") {
+      agent_parameters["communication_topology"] = value;
+    }
+    else if (option == "--event_threshold" || option == "--event_max_silence" || option == "--guidance_sample_time") {
+      agent_parameters[option.substr(2)] = std::stod(value);
+    }
+    else if (option == "--number_of_neighbors" || option == "--random_seed") {
+      agent_parameters[option.substr(2)] = std::stoi(value);
+    }
+    else if (option == "--prediction_max_horizon") {
+      agent_parameters["prediction_max_horizon"] = std::stod(value);
+    }
+    else if (option == "--predict_statistics") {
+      agent_parameters["predict_statistics"] = std::stoi(value) != 0;
+    }
+    else if (option == "--record_prefix") {
+      agent_parameters["record_prefix"] = value;
+    }
+    else if (option == "--verbosity_level") {
+      settings.verbosity_level = std::stoi(value);
+    }
+    else if (option == "--batched") {
+      settings.batched = std::stoi(value) != 0;
+    }
+    else {
+      std::cout << "Unknown option " << option << "\n" << SIMULATION_USAGE;
+      return 1;
+    }
+  }
+
+  // the periodic info messages of the agents would dominate the simulation time
+  if (settings.verbosity_level <= DEFAULT_VERBOSITY_LEVEL
+      && ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  std::cout << "agents,steps,convergence_time,final_error,steps_per_second,sent_ratio" << std::endl;
+  for (auto const &number_of_agents : numbers_of_agents) {
+    settings.number_of_agents = number_of_agents;
+    SimulationCore *simulation = new SimulationCore(settings, agent_parameters);
+    SimulationResults results = simulation->run();
+    delete simulation;
+
+    std::cout << results.number_of_agents << "," << results.steps << "," << results.convergence_time << ","
+              << results.final_error << "," << results.steps_per_second << "," << results.sent_ratio << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public 
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any 
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied 
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more 
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "swarm_core.h"
+
+SwarmCore::SwarmCore() {
+  // handles server private parameters (private names are protected from accidental name collisions)
+  private_node_handle_ = new ros::NodeHandle("~");
+
+  private_node_handle_->param("sample_time", sample_time_, (double)DEFAULT_SAMPLE_TIME);
+  private_node_handle_->param("number_of_agents", number_of_agents_, DEFAULT_NUMBER_OF_AGENTS);
+  private_node_handle_->param("verbosity_level", verbosity_level_, DEFAULT_VERBOSITY_LEVEL);
+  private_node_handle_->param("topic_queue_length", topic_queue_length_, DEFAULT_TOPIC_QUEUE_LENGTH);
+  private_node_handle_->param("shared_stats_topic", shared_stats_topic_name_, std::string(DEFAULT_SHARED_STATS_TOPIC));
+  private_node_handle_->param("shared_stats_array_topic", shared_stats_array_topic_name_, std::string(DEFAULT_SHARED_STATS_ARRAY_TOPIC));
+  private_node_handle_->param("shared_stats_compact_topic", shared_stats_compact_topic_name_, std::string(DEFAULT_SHARED_STATS_COMPACT_TOPIC));
+  private_node_handle_->param("shared_stats_predicted_topic", shared_stats_predicted_topic_name_,
+                              std::string(DEFAULT_SHARED_STATS_PREDICTED_TOPIC));
+  private_node_handle_->param("compact_statistics", compact_statistics_, false);
+  private_node_handle_->param("predict_statistics", predict_statistics_, false);
+  predict_statistics_ = predict_statistics_ && !compact_statistics_;  // the same of the hosted agents
+  double compact_resolution;
+  private_node_handle_->param("compact_resolution", compact_resolution, (double)DEFAULT_COMPACT_RESOLUTION);
+  private_node_handle_->param("frame_agent_prefix", frame_agent_prefix_, std::string(DEFAULT_FRAME_AGENT_PREFIX));
+  private_node_handle_->param("communication_topology", communication_topology_, std::string(DEFAULT_COMMUNICATION_TOPOLOGY));
+  private_node_handle_->param("frame_virtual_suffix", frame_virtual_suffix_, std::string(DEFAULT_FRAME_VIRTUAL_SUFFIX));
+  compact_codec_.setup(compact_resolution, frame_agent_prefix_, frame_virtual_suffix_);
+  private_node_handle_->param("aggregate_statistics", aggregate_statistics_, false);
+  private_node_handle_->param("tf_rate", tf_rate_, (double)DEFAULT_TF_RATE);
+  private_node_handle_->param("frame_tdma", frame_tdma_, sample_time_);
+  frame_tdma_ = TdmaSchedule::getFrame(sample_time_, frame_tdma_);  // the same of the hosted agents (see AgentCore)
+  if (aggregate_statistics_ && communication_topology_ != "all") {
+    CONSOLE_STREAM(WARN, "Statistics can be aggregated only with \"all\" topology (aggregation disabled).");
+    aggregate_statistics_ = false;
+  }
+
+  std::vector<int> default_agent_ids;
+  for (int id = 1; id <= number_of_agents_; id++) {
+    default_agent_ids.push_back(id);
+  }
+  std::vector<int> agent_ids;
+  private_node_handle_->param("agent_ids", agent_ids, default_agent_ids);
+
+  for (auto const &id : agent_ids) {
+    if (!hosted_agent_ids_.insert(id).second) {
+      CONSOLE_STREAM(WARN, "Agent " << id << " is listed more than once (duplicate ignored).");
+    }
+  }
+  int max_agent_id = number_of_agents_;
+  if (!hosted_agent_ids_.empty()) {
+    max_agent_id = std::max(max_agent_id, *hosted_agent_ids_.rbegin());
+  }
+  if (compact_statistics_ && !CompactCodec::isValidAgentId(max_agent_id)) {
+    CONSOLE_STREAM(FATAL, "The agent ids up to " << max_agent_id << " can't be encoded in the compact statistics "
+                          << "(shutting down).");
+    ros::shutdown();
+    return;
+  }
+  for (auto const &id : hosted_agent_ids_) {
+    // each agent has its own private namespace (e.g. ~agent_1) for the agent-specific params (e.g. initial pose)
+    ros::NodeHandle agent_node_handle(*private_node_handle_, frame_agent_prefix_ + std::to_string(id));
+    agent_node_handle.setParam("agent_id", id);
+    agents_.push_back(new AgentCore(agent_node_handle, hosted_agent_ids_));
+  }
+
+  // with the other topologies each hosted agent subscribes only to the topics of its external neighbors
+  if (communication_topology_ == "all") {
+    // the queue must hold a whole TDMA frame of messages (both hosted and external agents speak on the shared topic)
+    if (compact_statistics_) {
+      stats_subscriber_ = node_handle_.subscribe(shared_stats_compact_topic_name_, topic_queue_length_*number_of_agents_,
+                                                 &SwarmCore::receivedStatsCompactCallback, this);
+    }
+    else if (predict_statistics_) {
+      stats_subscriber_ = node_handle_.subscribe(shared_stats_predicted_topic_name_, topic_queue_length_*number_of_agents_,
+                                                 &SwarmCore::receivedStatsPredictedCallback, this);
+    }
+    else {
+      stats_subscriber_ = node_handle_.subscribe(shared_stats_topic_name_, topic_queue_length_*number_of_agents_,
+                                                 &SwarmCore::receivedStatsCallback, this);
+    }
+    stats_array_subscriber_ = node_handle_.subscribe(shared_stats_array_topic_name_, topic_queue_length_*number_of_agents_,
+                                                     &SwarmCore::receivedStatsArrayCallback, this);
+  }
+  if (aggregate_statistics_) {
+    stats_array_publisher_ = node_handle_.advertise<formation_control::FormationStatisticsArray>(shared_stats_array_topic_name_,
+                                                                                                 topic_queue_length_);
+  }
+  transmit_statistics_.resize(agents_.size());
+  for (std::size_t i = 0; i < agents_.size(); i++) {
+    transmit_timers_.push_back(private_node_handle_->createTimer(ros::Duration(agents_[i]->getTransmitOffset()),
+                                                                 std::bind(&SwarmCore::transmitCallback, this,
+                                                                           std::placeholders::_1, i),
+                                                                 true, false));
+  }
+
+  // the hosted agents speak in their own TDMA slots, thus the shared timer starts with a TDMA frame (see AgentCore)
+  ros::Time frame;
+  frame.fromSec(std::ceil(ros::Time::now().toSec()/frame_tdma_)*frame_tdma_);
+  ros::Time::sleepUntil(frame);
+  algorithm_timer_ = private_node_handle_->createTimer(ros::Duration(sample_time_), &SwarmCore::algorithmCallback, this);
+
+  CONSOLE_STREAM(INFO, "Hosting " << agents_.size() << " agents.");
+}
+
+SwarmCore::~SwarmCore() {
+  for (auto const &agent : agents_) {
+    delete agent;
+  }
+  delete private_node_handle_;
+}
+
+void SwarmCore::algorithmCallback(const ros::TimerEvent &timer_event) {
+  // all the agents compute their step on the statistics shared during the previous sample time
+  for (auto const &agent : agents_) {
+    agent->algorithmStep();
+  }
+
+  formation_control::FormationStatisticsArray msg_array;
+  msg_array.header.stamp = ros::Time::now();
+  for (std::size_t i = 0; i < agents_.size(); i++) {
+    AgentCore *agent = agents_[i];
+    formation_control::FormationStatisticsPredicted msg = agent->getSharedStatistics();
+    ros::Time slot = timer_event.current_expected + ros::Duration(agent->getTransmitOffset());
+    if (!aggregate_statistics_ && slot > msg.estimate.header.stamp) {
+      msg.estimate.header.stamp = slot;  // the same stamp for the hosted agents and for the external ones
+    }
+    if (!agent->triggerBroadcast(msg)) {
+      continue;  // the hosted agents must see the same estimates of the external ones (event triggered consensus)
+    }
+    for (auto const &receiver : agents_) {
+      receiver->receivedStatsPredictedCallback(msg);  // messages sent by the receiver itself are discarded
+    }
+    if (aggregate_statistics_) {
+      msg_array.agent_ids.push_back(msg.estimate.agent_id);
+      msg_array.stats.push_back(msg.estimate.stats);
+    }
+    else {
+      // scheduled in the TDMA slot of the agent, the same of a standalone agent (see AgentCore::algorithmCallback)
+      transmit_statistics_mutex_.lock();
+      transmit_statistics_[i] = msg;
+      transmit_statistics_mutex_.unlock();
+      ros::Duration delay = slot - ros::Time::now();
+      if (delay <= ros::Duration(0)) {
+        CONSOLE_STREAM(WARN, "Computation exceeded the TDMA transmission slot of agent " << agent->getAgentId() << " ("
+                             << -delay.toSec() << "s late).");
+        transmitCallback(timer_event, i);
+        continue;
+      }
+      transmit_timers_[i].stop();
+      transmit_timers_[i].setPeriod(delay);
+      transmit_timers_[i].start();
+    }
+  }
+  if (aggregate_statistics_ && !msg_array.agent_ids.empty()) {
+    stats_array_publisher_.publish(msg_array);  // a single message for all the hosted agents
+  }
+  broadcastPoses();
+
+  CONSOLE_STREAM(DEBUG, "Statistics handed over among " << agents_.size() << " hosted agents.");
+}
+
+void SwarmCore::broadcastPoses() {
+  ros::Time now = ros::Time::now();
+  if (tf_rate_ > 0 && now - last_tf_broadcast_ < ros::Duration(1.0 / tf_rate_)) {
+    return;
+  }
+
+  std::vector<tf::StampedTransform> transforms;
+  transforms.reserve(2*agents_.size());
+  for (auto const &agent : agents_) {
+    std::vector<tf::StampedTransform> agent_transforms = agent->getPoseTransforms();
+    transforms.insert(transforms.end(), agent_transforms.begin(), agent_transforms.end());
+  }
+  tf_broadcaster_.sendTransform(transforms);  // a single message for all the hosted agents
+  last_tf_broadcast_ = now;
+}
+
+std::string SwarmCore::consolePrefix(const std::string &caller_name) const {
+  return "[SwarmCore::" + caller_name + "]  ";
+}
+
+bool SwarmCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+void SwarmCore::receivedStatsArrayCallback(const formation_control::FormationStatisticsArray &received) {
+  // the statistics of the hosted agents are discarded
+  if (!StatsGeometry::unpackArray(received, frame_agent_prefix_, frame_virtual_suffix_,
+                                  [this](const std::size_t &i, const formation_control::FormationStatisticsStamped &msg) {
+                                    receivedStatsCallback(msg);
+                                  })) {
+    CONSOLE_STREAM(ERROR, "Wrong statistics array sizes (" << received.agent_ids.size() << ", " << received.stats.size() << ").");
+  }
+}
+
+void SwarmCore::receivedStatsCallback(const formation_control::FormationStatisticsStamped &received) {
+  if (hosted_agent_ids_.count(received.agent_id)) {
+    return;  // already handed over in memory
+  }
+
+  for (auto const &agent : agents_) {
+    agent->receivedStatsCallback(received);
+  }
+
+  CONSOLE_STREAM(DEBUG_VV, "Forwarded statistics from " << received.header.frame_id << " to the hosted agents.");
+}
+
+void SwarmCore::receivedStatsCompactCallback(const formation_control::FormationStatisticsCompact &received) {
+  receivedStatsCallback(compact_codec_.decode(received, ros::Time::now()));
+}
+
+void SwarmCore::receivedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &received) {
+  if (hosted_agent_ids_.count(received.estimate.agent_id)) {
+    return;  // already handed over in memory
+  }
+
+  for (auto const &agent : agents_) {
+    agent->receivedStatsPredictedCallback(received);
+  }
+
+  CONSOLE_STREAM(DEBUG_VV, "Forwarded statistics from " << received.estimate.header.frame_id << " to the hosted agents.");
+}
+
+void SwarmCore::transmitCallback(const ros::TimerEvent &timer_event, const std::size_t &index) {
+  transmit_statistics_mutex_.lock();
+  formation_control::FormationStatisticsPredicted msg = transmit_statistics_[index];
+  transmit_statistics_mutex_.unlock();
+
+  agents_[index]->publishStatistics(msg);
+}
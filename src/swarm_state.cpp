@@ -0,0 +1,234 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "swarm_state.h"
+
+SwarmState::SwarmState(const AgentGains &gains, const int &verbosity_level) {
+  gains_ = gains;
+  verbosity_level_ = verbosity_level;
+  number_of_agents_ = 0;
+  shared_ = false;
+}
+
+void SwarmState::addAgent(const AgentCore &agent) {
+  geometry_msgs::Pose pose = agent.getPose();
+  geometry_msgs::Pose pose_virtual = agent.getVirtualPose();
+  geometry_msgs::Twist twist = agent.getTwist();
+  geometry_msgs::Twist twist_virtual = agent.getVirtualTwist();
+  formation_control::FormationStatistics estimated = agent.getEstimatedStatistics().stats;
+  formation_control::FormationStatistics target = agent.getTargetStatistics();
+
+  x_.push_back(pose.position.x);
+  y_.push_back(pose.position.y);
+  theta_.push_back(tf::getYaw(pose.orientation));
+  x_dot_.push_back(twist.linear.x);
+  y_dot_.push_back(twist.linear.y);
+  theta_dot_.push_back(twist.angular.z);
+  x_virtual_.push_back(pose_virtual.position.x);
+  y_virtual_.push_back(pose_virtual.position.y);
+  x_dot_virtual_.push_back(twist_virtual.linear.x);
+  y_dot_virtual_.push_back(twist_virtual.linear.y);
+
+  const double estimated_values[DEFAULT_NUMBER_OF_STATS] = {estimated.m_x, estimated.m_y, estimated.m_xx,
+                                                            estimated.m_xy, estimated.m_yy};
+  const double target_values[DEFAULT_NUMBER_OF_STATS] = {target.m_x, target.m_y, target.m_xx, target.m_xy, target.m_yy};
+  for (int s = 0; s < DEFAULT_NUMBER_OF_STATS; s++) {
+    estimated_statistics_[s].push_back(estimated_values[s]);
+    target_statistics_[s].push_back(target_values[s]);
+  }
+
+  speed_command_sat_.push_back(0);
+  steer_command_sat_.push_back(0);
+  number_of_agents_++;
+}
+
+void SwarmState::algorithmStep() {
+  consensus();
+  control();
+  for (int step = 0; step < gains_.guidance_steps; step++) {
+    guidance();
+    dynamics();
+  }
+  shared_ = true;  // the new estimates are available to all the agents in the following step
+}
+
+void SwarmState::consensus() {
+  const int n = number_of_agents_;
+  const double ts = gains_.sample_time;
+  const int degree = shared_ ? n - 1 : 0;
+  const double received = shared_ ? 1 : 0;
+
+  if (ts >= 1.0/(degree + 1)) {
+    CONSOLE_STREAM(ERROR, "The current sample time (" << ts << ") does not guarantee the consensus convergence "
+                          << "(upper bound: " << 1.0/(degree + 1) << ").");
+  }
+
+  double *x[DEFAULT_NUMBER_OF_STATS];
+  double sum[DEFAULT_NUMBER_OF_STATS];
+  for (int s = 0; s < DEFAULT_NUMBER_OF_STATS; s++) {
+    x[s] = estimated_statistics_[s].data();
+    sum[s] = 0;
+    for (int i = 0; i < n; i++) {
+      sum[s] += x[s][i];
+    }
+  }
+
+  const double *px = x_virtual_.data();
+  const double *py = y_virtual_.data();
+  const double *vx = x_dot_virtual_.data();
+  const double *vy = y_dot_virtual_.data();
+  for (int i = 0; i < n; i++) {
+    // time derivative of phi(p) = [px, py, pxx, pxy, pyy] (with the twist of the previous step)
+    const double phi_dot[DEFAULT_NUMBER_OF_STATS] = {vx[i], vy[i], 2*px[i]*vx[i], py[i]*vx[i] + px[i]*vy[i], 2*py[i]*vy[i]};
+
+    // x_k+1 = phi_k*Ts + x_k + Ts*sum_j(x_j_k - x_k), where sum_j(x_j_k) is the sum of all the other estimates
+    for (int s = 0; s < DEFAULT_NUMBER_OF_STATS; s++) {
+      x[s][i] += phi_dot[s]*ts + (received*(sum[s] - x[s][i]) - degree*x[s][i])*ts;
+    }
+  }
+}
+
+std::string SwarmState::consolePrefix(const std::string &caller_name) const {
+  return "[SwarmState::" + caller_name + "]  ";
+}
+
+void SwarmState::control() {
+  const int n = number_of_agents_;
+  const double ts = gains_.sample_time;
+  const double *g = gains_.gamma;
+  const double *l = gains_.lambda;
+  const double *b = gains_.b;
+  const double threshold = gains_.velocity_virtual_threshold;
+
+  double *px = x_virtual_.data();
+  double *py = y_virtual_.data();
+  double *vx = x_dot_virtual_.data();
+  double *vy = y_dot_virtual_.data();
+  const double *e[DEFAULT_NUMBER_OF_STATS];
+  const double *t[DEFAULT_NUMBER_OF_STATS];
+  for (int s = 0; s < DEFAULT_NUMBER_OF_STATS; s++) {
+    e[s] = estimated_statistics_[s].data();
+    t[s] = target_statistics_[s].data();
+  }
+
+  int singular = 0;
+  for (int i = 0; i < n; i++) {
+    const double x = px[i];
+    const double y = py[i];
+    const double e0 = t[0][i] - e[0][i];
+    const double e1 = t[1][i] - e[1][i];
+    const double e2 = t[2][i] - e[2][i];
+    const double e3 = t[3][i] - e[3][i];
+    const double e4 = t[4][i] - e[4][i];
+
+    // (B + Jphi'*lambda*Jphi) * twist_virtual = Jphi'*gamma*stats_error, with Jphi = [1 0; 0 1; 2x 0; y x; 0 2y]
+    const double a00 = b[0] + l[0] + 4*x*x*l[2] + y*y*l[3];
+    const double a01 = x*y*l[3];
+    const double a11 = b[1] + l[1] + x*x*l[3] + 4*y*y*l[4];
+    const double r0 = g[0]*e0 + 2*x*g[2]*e2 + y*g[3]*e3;
+    const double r1 = g[1]*e1 + x*g[3]*e3 + 2*y*g[4]*e4;
+    const double determinant = a00*a11 - a01*a01;
+    singular += (determinant == 0);
+    const double inverse = (determinant != 0) ? 1/determinant : 0;  // null control commands if singular
+    double u0 = (a11*r0 - a01*r1)*inverse;
+    double u1 = (a00*r1 - a01*r0)*inverse;
+
+    // control command saturation
+    const double velocity = std::sqrt(u0*u0 + u1*u1);
+    const double scale = (velocity > threshold) ? threshold/velocity : 1;
+    u0 *= scale;
+    u1 *= scale;
+
+    px[i] += ts*(vx[i] + u0)/2;
+    py[i] += ts*(vy[i] + u1)/2;
+    vx[i] = u0;
+    vy[i] = u1;
+  }
+
+  if (singular > 0) {
+    CONSOLE_STREAM(ERROR, "Singular control law matrix for " << singular << " agents (null control commands).");
+  }
+}
+
+void SwarmState::dynamics() {
+  const int n = number_of_agents_;
+  const double ts = gains_.sample_time/gains_.guidance_steps;
+  const double vehicle_length = gains_.vehicle_length;
+
+  double *x = x_.data();
+  double *y = y_.data();
+  double *theta = theta_.data();
+  double *x_dot = x_dot_.data();
+  double *y_dot = y_dot_.data();
+  double *theta_dot = theta_dot_.data();
+  const double *speed = speed_command_sat_.data();
+  const double *steer = steer_command_sat_.data();
+
+  for (int i = 0; i < n; i++) {
+    const double x_dot_new = speed[i]*std::cos(theta[i]);
+    const double y_dot_new = speed[i]*std::sin(theta[i]);
+    const double theta_dot_new = speed[i]/vehicle_length*std::tan(steer[i]);
+
+    x[i] += ts*(x_dot[i] + x_dot_new)/2;
+    y[i] += ts*(y_dot[i] + y_dot_new)/2;
+    // the heading changes by far less than pi in a sample time, thus a single wrap keeps it in [-pi, pi]
+    double theta_new = theta[i] + ts*(theta_dot[i] + theta_dot_new)/2;
+    theta_new -= (theta_new > M_PI) ? 2*M_PI : 0;
+    theta_new += (theta_new < -M_PI) ? 2*M_PI : 0;
+    theta[i] = theta_new;
+    x_dot[i] = x_dot_new;
+    y_dot[i] = y_dot_new;
+    theta_dot[i] = theta_dot_new;
+  }
+}
+
+int SwarmState::getNumberOfAgents() const {
+  return number_of_agents_;
+}
+
+const std::vector<double> &SwarmState::getX() const {
+  return x_;
+}
+
+const std::vector<double> &SwarmState::getY() const {
+  return y_;
+}
+
+void SwarmState::guidance() {
+  const int n = number_of_agents_;
+  const double *x = x_.data();
+  const double *y = y_.data();
+  const double *theta = theta_.data();
+  const double *px = x_virtual_.data();
+  const double *py = y_virtual_.data();
+  double *speed = speed_command_sat_.data();
+  double *steer = steer_command_sat_.data();
+
+  for (int i = 0; i < n; i++) {
+    const double dx = px[i] - x[i];
+    const double dy = py[i] - y[i];
+    // there is no need to get sub-centimeter accuracy
+    speed[i] = std::floor(10*std::min(std::max(gains_.k_p_speed*std::sqrt(dx*dx + dy*dy), gains_.speed_min), gains_.speed_max))/10;
+    // std::atan2 automatically handle the los_distance == 0 case >> los_angle = 0
+    // both the angles are in [-pi, pi], thus a single wrap gives the shortest angular distance
+    double los_error = std::atan2(dy, dx) - theta[i];
+    los_error -= (los_error > M_PI) ? 2*M_PI : 0;
+    los_error += (los_error < -M_PI) ? 2*M_PI : 0;
+    const double steer_command = gains_.k_p_steer*los_error;
+    steer[i] = std::min(std::max(steer_command, gains_.steer_min), gains_.steer_max);
+  }
+}
+
+bool SwarmState::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
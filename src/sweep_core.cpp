@@ -0,0 +1,154 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sweep_core.h"
+
+SweepCore::SweepCore(const SweepSettings &sweep_settings, const SimulationSettings &simulation_settings,
+                     const AgentParameters &agent_parameters, const std::vector<SweepParameter> &parameters) {
+  sweep_settings_ = sweep_settings;
+  agent_parameters_ = agent_parameters;
+  verbosity_level_ = simulation_settings.verbosity_level;
+
+  for (auto const &parameter : parameters) {
+    if (parameter.values.empty()) {
+      CONSOLE_STREAM(WARN, "No values for the swept param " << parameter.name << " (discarded).");
+      continue;
+    }
+    parameters_.push_back(parameter);
+  }
+
+  std::vector<std::vector<double>> values(parameters_.size());
+  if (sweep_settings_.random) {
+    // the random combinations are reproducible (the formations have their own seeds)
+    std::mt19937 generator(sweep_settings_.seed);
+    for (int sample = 0; sample < sweep_settings_.samples; sample++) {
+      for (int p = 0; p < (int)parameters_.size(); p++) {
+        const std::vector<std::vector<double>> &candidates = parameters_.at(p).values;
+        bool scalar = std::all_of(candidates.begin(), candidates.end(),
+                                  [](const std::vector<double> &v){ return v.size() == 1; });
+        if (scalar) {
+          auto bounds = std::minmax_element(candidates.begin(), candidates.end());
+          std::uniform_real_distribution<> distrib(bounds.first->front(), bounds.second->front());
+          values.at(p).assign(1, distrib(generator));
+        }
+        else {
+          std::uniform_int_distribution<> distrib(0, candidates.size() - 1);
+          values.at(p) = candidates.at(distrib(generator));
+        }
+      }
+      addRuns(simulation_settings, values);
+    }
+  }
+  else {
+    // all the combinations, the last param changes first (mixed radix counter)
+    std::vector<int> indices(parameters_.size(), 0);
+    bool done = false;
+    while (!done) {
+      for (int p = 0; p < (int)parameters_.size(); p++) {
+        values.at(p) = parameters_.at(p).values.at(indices.at(p));
+      }
+      addRuns(simulation_settings, values);
+
+      done = true;
+      for (int p = parameters_.size() - 1; p >= 0 && done; p--) {
+        done = ++indices.at(p) == (int)parameters_.at(p).values.size();
+        if (done) {
+          indices.at(p) = 0;
+        }
+      }
+    }
+  }
+
+  CONSOLE_STREAM(DEBUG, "Generated " << runs_.size() << " runs.");
+}
+
+void SweepCore::addRuns(const SimulationSettings &simulation_settings, const std::vector<std::vector<double>> &values) {
+  for (auto const &number_of_agents : sweep_settings_.numbers_of_agents) {
+    for (int formation = 0; formation < sweep_settings_.formations; formation++) {
+      SweepRun run;
+      run.settings = simulation_settings;
+      run.settings.number_of_agents = number_of_agents;
+      run.settings.seed = sweep_settings_.seed + formation;
+      run.values = values;
+      run.results = SimulationResults();
+      runs_.push_back(run);
+    }
+  }
+}
+
+std::string SweepCore::consolePrefix(const std::string &caller_name) const {
+  return "[SweepCore::" + caller_name + "]  ";
+}
+
+AgentParameters SweepCore::getAgentParameters(const SweepRun &run) const {
+  AgentParameters parameters = agent_parameters_;
+  for (int p = 0; p < (int)parameters_.size(); p++) {
+    const std::vector<double> &value = run.values.at(p);
+    XmlRpc::XmlRpcValue param;
+    if (value.size() == 1) {
+      param = value.front();
+    }
+    else {
+      for (int i = 0; i < (int)value.size(); i++) {
+        param[i] = value.at(i);
+      }
+    }
+    parameters[parameters_.at(p).name] = param;
+  }
+  return parameters;
+}
+
+const std::vector<SweepParameter>& SweepCore::getParameters() const {
+  return parameters_;
+}
+
+const std::vector<SweepRun>& SweepCore::getRuns() const {
+  return runs_;
+}
+
+bool SweepCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+void SweepCore::run() {
+  TaskPool pool(sweep_settings_.threads);
+  CONSOLE_STREAM(DEBUG, "Executing " << runs_.size() << " runs on " << pool.getNumberOfThreads() << " threads.");
+
+  std::vector<std::exception_ptr> errors = pool.run(runs_.size(), [this](const int &index) {
+    SweepRun &run = runs_.at(index);
+    // each run has its own agents and simulated time (nothing is shared among the threads)
+    SimulationCore simulation(run.settings, getAgentParameters(run));
+    run.results = simulation.run();
+  });
+
+  int failed = 0;
+  for (int i = 0; i < (int)errors.size(); i++) {
+    if (!errors.at(i)) {
+      continue;
+    }
+    // the other runs are still valid, the failed one is reported in the results
+    try {
+      std::rethrow_exception(errors.at(i));
+    }
+    catch (const std::exception &e) {
+      runs_.at(i).error = e.what();
+    }
+    catch (...) {
+      runs_.at(i).error = "unknown exception";
+    }
+    CONSOLE_STREAM(ERROR, "Run " << i << " has failed (" << runs_.at(i).error << ").");
+    failed++;
+  }
+
+  CONSOLE_STREAM(DEBUG, "Executed " << runs_.size() << " runs (" << failed << " failed).");
+}
@@ -0,0 +1,190 @@
+/*  Copyright (C) 2015 Alessandro Tondo
+ *  email: tondo.codes+ros <at> gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any
+ *  later version.
+ *  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ *  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details.
+ *  You should have received a copy of the GNU General Public License along with this program.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sweep_core.h"
+
+#define SWEEP_USAGE "Usage: sweep [--agents 5,9] [--formations 1] [--seed 0] [--random 0] [--samples 100] "\
+                    "[--threads 0] [--duration 60] [--sample_time 0.1] [--tolerance 0.05] [--world_limit 1] "\
+                    "[--target 0,0,1,0,1] [--gamma 100,100,5,10,5/50,50,5,10,5] [--lambda 0,0,0,0,0] "\
+                    "[--b 100,100/50,50] [--k_p_speed 0.5,1] [--k_p_steer 2] [--velocity_virtual_threshold 4] "\
+                    "[--communication_topology all] [--number_of_neighbors 2] [--verbosity_level 1] [--batched 0]\n"\
+                    "Scalar params take a comma separated list of candidates, vector params a '/' separated list.\n"
+
+/*  Splits the given list of numbers.
+ *
+ *  Parameters:
+ *    + list: list of numbers (e.g. "1,2,3");
+ *    + separator: separator of the numbers in the list.
+ *  Return value:
+ *    + vector of the numbers in the list.
+ */
+std::vector<double> parseList(const std::string &list, const char &separator) {
+  std::vector<double> values;
+  std::stringstream s(list);
+  std::string value;
+  while (std::getline(s, value, separator)) {
+    values.push_back(std::stod(value));
+  }
+  return values;
+}
+
+/*  Joins the given vector of numbers in a single CSV field (space separated, to avoid quoting).
+ *
+ *  Parameters:
+ *    + values: vector of numbers.
+ *  Return value:
+ *    + joined numbers.
+ */
+std::string joinValues(const std::vector<double> &values) {
+  std::stringstream s;
+  for (int i = 0; i < (int)values.size(); i++) {
+    s << (i ? " " : "") << values.at(i);
+  }
+  return s.str();
+}
+
+int main(int argc, char **argv) {
+  // no ros::init: there is no ROS master, each run has its own simulated time
+  ros::Time::init();
+
+  SweepSettings sweep_settings;
+  sweep_settings.numbers_of_agents = {5, 9};
+  sweep_settings.formations = DEFAULT_SWEEP_FORMATIONS;
+  sweep_settings.random = false;
+  sweep_settings.samples = DEFAULT_SWEEP_SAMPLES;
+  sweep_settings.seed = DEFAULT_SIMULATION_SEED;
+  sweep_settings.threads = DEFAULT_SWEEP_THREADS;
+
+  SimulationSettings settings;
+  settings.sample_time = DEFAULT_SAMPLE_TIME;
+  settings.duration = DEFAULT_SIMULATION_DURATION;
+  settings.tolerance = DEFAULT_SIMULATION_TOLERANCE;
+  settings.world_limit = 1.0;
+  settings.target_statistics = {0, 0, 1, 0, 1};
+  settings.verbosity_level = DEFAULT_VERBOSITY_LEVEL;
+  settings.batched = false;
+  AgentParameters agent_parameters;
+  std::vector<SweepParameter> parameters;
+
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--help" || i + 1 >= argc) {
+      std::cout << SWEEP_USAGE;
+      return (option == "--help") ? 0 : 1;
+    }
+    std::string value = argv[++i];
+
+    if (option == "--agents") {
+      std::vector<double> numbers_of_agents = parseList(value, ',');
+      sweep_settings.numbers_of_agents.assign(numbers_of_agents.begin(), numbers_of_agents.end());
+    }
+    else if (option == "--formations") {
+      sweep_settings.formations = std::stoi(value);
+    }
+    else if (option == "--seed") {
+      sweep_settings.seed = std::stoul(value);
+    }
+    else if (option == "--random") {
+      sweep_settings.random = std::stoi(value) != 0;
+    }
+    else if (option == "--samples") {
+      sweep_settings.samples = std::stoi(value);
+    }
+    else if (option == "--threads") {
+      sweep_settings.threads = std::stoi(value);
+    }
+    else if (option == "--duration") {
+      settings.duration = std::stod(value);
+    }
+    else if (option == "--sample_time") {
+      settings.sample_time = std::stod(value);
+    }
+    else if (option == "--tolerance") {
+      settings.tolerance = std::stod(value);
+    }
+    else if (option == "--world_limit") {
+      settings.world_limit = std::stod(value);
+    }
+    else if (option == "--target") {
+      settings.target_statistics = parseList(value, ',');
+    }
+    else if (option == "--gamma" || option == "--lambda" || option == "--b") {
+      SweepParameter parameter;
+      parameter.name = "diag_elements_" + option.substr(2);
+      std::stringstream s(value);
+      std::string candidate;
+      while (std::getline(s, candidate, '/')) {
+        parameter.values.push_back(parseList(candidate, ','));
+      }
+      parameters.push_back(parameter);
+    }
+    else if (option == "--k_p_speed" || option == "--k_p_steer" || option == "--velocity_virtual_threshold") {
+      SweepParameter parameter;
+      parameter.name = option.substr(2);
+      for (auto const &candidate : parseList(value, ',')) {
+        parameter.values.push_back(std::vector<double>(1, candidate));
+      }
+      parameters.push_back(parameter);
+    }
+    else if (option == "--communication_topology") {
+      agent_parameters["communication_topology"] = value;
+    }
+    else if (option == "--number_of_neighbors") {
+      agent_parameters["number_of_neighbors"] = std::stoi(value);
+    }
+    else if (option == "--verbosity_level") {
+      settings.verbosity_level = std::stoi(value);
+    }
+    else if (option == "--batched") {
+      settings.batched = std::stoi(value) != 0;
+    }
+    else {
+      std::cout << "Unknown option " << option << "\n" << SWEEP_USAGE;
+      return 1;
+    }
+  }
+
+  // the periodic info messages of the agents would dominate the simulation time
+  if (settings.verbosity_level <= DEFAULT_VERBOSITY_LEVEL
+      && ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  SweepCore *sweep = new SweepCore(sweep_settings, settings, agent_parameters, parameters);
+  auto start = std::chrono::steady_clock::now();
+  sweep->run();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << "run,agents,seed";
+  for (auto const &parameter : sweep->getParameters()) {
+    std::cout << "," << parameter.name;
+  }
+  std::cout << ",steps,convergence_time,final_error,steps_per_second,sent_ratio" << std::endl;
+  for (int r = 0; r < (int)sweep->getRuns().size(); r++) {
+    const SweepRun &run = sweep->getRuns().at(r);
+    std::cout << r << "," << run.settings.number_of_agents << "," << run.settings.seed;
+    for (auto const &value : run.values) {
+      std::cout << "," << joinValues(value);
+    }
+    if (!run.error.empty()) {
+      std::cout << ",,,,," << std::endl;  // failed run (see the error message), no results
+      continue;
+    }
+    std::cout << "," << run.results.steps << "," << run.results.convergence_time << "," << run.results.final_error
+              << "," << run.results.steps_per_second << "," << run.results.sent_ratio << std::endl;
+  }
+  std::cerr << sweep->getRuns().size() << " runs in " << elapsed.count() << "s." << std::endl;
+
+  delete sweep;
+  return 0;
+}
@@ -13,18 +13,48 @@
 
 #include "visualization_core.h"
 
+const int VisualizationCore::MAX_TABLE_AGENT_ID;
+
 VisualizationCore::VisualizationCore() {
   // handles server private parameters (private names are protected from accidental name collisions)
   private_node_handle_ = new ros::NodeHandle("~");
+  // not created at all if the node refuses to start (see below)
+  interactive_marker_server_ = nullptr;
+  ingest_spinner_ = nullptr;
+  algorithm_spinner_ = nullptr;
 
   private_node_handle_->param("sample_time", sample_time_, (double)DEFAULT_SAMPLE_TIME);
   private_node_handle_->param("number_of_agents", number_of_agents_, DEFAULT_NUMBER_OF_AGENTS);
   private_node_handle_->param("verbosity_level", verbosity_level_, DEFAULT_VERBOSITY_LEVEL);
+  private_node_handle_->param("communication_topology", communication_topology_, std::string(DEFAULT_COMMUNICATION_TOPOLOGY));
+  private_node_handle_->param("number_of_neighbors", number_of_neighbors_, DEFAULT_NUMBER_OF_NEIGHBORS);
   private_node_handle_->param("topic_queue_length", topic_queue_length_, DEFAULT_TOPIC_QUEUE_LENGTH);
   private_node_handle_->param("shared_stats_topic", shared_stats_topic_name_, std::string(DEFAULT_SHARED_STATS_TOPIC));
+  private_node_handle_->param("shared_stats_array_topic", shared_stats_array_topic_name_, std::string(DEFAULT_SHARED_STATS_ARRAY_TOPIC));
+  private_node_handle_->param("shared_stats_compact_topic", shared_stats_compact_topic_name_, std::string(DEFAULT_SHARED_STATS_COMPACT_TOPIC));
+  private_node_handle_->param("shared_stats_predicted_topic", shared_stats_predicted_topic_name_,
+                              std::string(DEFAULT_SHARED_STATS_PREDICTED_TOPIC));
+  private_node_handle_->param("compact_statistics", compact_statistics_, false);
+  private_node_handle_->param("predict_statistics", predict_statistics_, false);
+  predict_statistics_ = predict_statistics_ && !compact_statistics_;  // the same of the agents
+  double compact_resolution;
+  private_node_handle_->param("compact_resolution", compact_resolution, (double)DEFAULT_COMPACT_RESOLUTION);
   private_node_handle_->param("target_stats_topic", target_stats_topic_name_, std::string(DEFAULT_TARGET_STATS_TOPIC));
   private_node_handle_->param("agent_poses_topic", agent_poses_topic_name_, std::string(DEFAULT_AGENT_POSES_TOPIC));
+  private_node_handle_->param("tf_topic", tf_topic_name_, std::string(DEFAULT_TF_TOPIC));
+  private_node_handle_->param("tf_rate", tf_rate_, (double)DEFAULT_TF_RATE);
+  private_node_handle_->param("frame_tdma", frame_tdma_, sample_time_);
+  frame_tdma_ = TdmaSchedule::getFrame(sample_time_, frame_tdma_);  // the same of the agents (see AgentCore)
+  private_node_handle_->param("slot_tdma", slot_tdma_, frame_tdma_/(number_of_agents_ + 1));
+  private_node_handle_->param("diagnostics_topic", diagnostics_topic_name_, std::string(DEFAULT_DIAGNOSTICS_TOPIC));
+  private_node_handle_->param("diagnostics_rate", diagnostics_rate_, (double)DEFAULT_DIAGNOSTICS_RATE);
+  private_node_handle_->param("neighbors_topic", neighbors_topic_name_, std::string(DEFAULT_NEIGHBORS_TOPIC));
   private_node_handle_->param("marker_topic", marker_topic_name_, std::string(DEFAULT_MARKER_TOPIC));
+  private_node_handle_->param("sync_service", sync_service_name_, std::string(DEFAULT_SYNC_SERVICE));
+  private_node_handle_->param("sync_delay", sync_delay_, (double)DEFAULT_SYNC_DELAY);
+  for (int id = 1; id <= number_of_agents_; id++) {
+    sync_available_ids_.insert(sync_available_ids_.end(), id);
+  }
 
   private_node_handle_->param("frame_map", frame_map_, std::string(DEFAULT_FRAME_MAP));
   private_node_handle_->param("frame_agent_prefix", frame_agent_prefix_, std::string(DEFAULT_FRAME_AGENT_PREFIX));
@@ -32,12 +62,38 @@ VisualizationCore::VisualizationCore() {
   private_node_handle_->param("frame_ellipse_suffix", frame_ellipse_suffix_, std::string(DEFAULT_FRAME_ELLIPSE_SUFFIX));
   private_node_handle_->param("frame_virtual_suffix", frame_virtual_suffix_, std::string(DEFAULT_FRAME_VIRTUAL_SUFFIX));
   private_node_handle_->param("frame_ground_station", frame_ground_station_, std::string(DEFAULT_FRAME_GROUND_STATION));
+  compact_codec_.setup(compact_resolution, frame_agent_prefix_, frame_virtual_suffix_);
+  // the statistics of the ids which can't be encoded would be dropped by the agents, thus the node must not even start
+  if (compact_statistics_ && !CompactCodec::isValidAgentId(number_of_agents_)) {
+    CONSOLE_STREAM(FATAL, "The agent ids up to " << number_of_agents_ << " can't be encoded in the compact statistics "
+                          << "(shutting down).");
+    ros::shutdown();
+    return;
+  }
   private_node_handle_->param("frame_target_ellipse", frame_target_ellipse_, target_stats_topic_name_ + frame_ellipse_suffix_);
 
   private_node_handle_->param("marker_dist_min", marker_dist_min_, (double)DEFAULT_MARKER_DIST_MIN);
   private_node_handle_->param("marker_dist_max", marker_dist_max_, (double)DEFAULT_MARKER_DIST_MAX);
   private_node_handle_->param("marker_steer_min", marker_steer_min_, (double)DEFAULT_MARKER_STEER_MIN);
   private_node_handle_->param("marker_steer_max", marker_steer_max_, (double)DEFAULT_MARKER_STEER_MAX);
+  private_node_handle_->param("ellipse_position_tolerance", ellipse_position_tolerance_, (double)DEFAULT_ELLIPSE_POSITION_TOLERANCE);
+  private_node_handle_->param("ellipse_angle_tolerance", ellipse_angle_tolerance_, (double)DEFAULT_ELLIPSE_ANGLE_TOLERANCE);
+  private_node_handle_->param("ellipse_diameter_tolerance", ellipse_diameter_tolerance_, (double)DEFAULT_ELLIPSE_DIAMETER_TOLERANCE);
+  private_node_handle_->param("ellipse_refresh_period", ellipse_refresh_period_, (double)DEFAULT_ELLIPSE_REFRESH_PERIOD);
+  private_node_handle_->param("target_rate", target_rate_, (double)DEFAULT_TARGET_RATE);
+  target_pending_ = false;
+  private_node_handle_->param("grid_cell_size", grid_cell_size_, (double)DEFAULT_GRID_CELL_SIZE);
+  private_node_handle_->param("proximity_distance", proximity_distance_, (double)DEFAULT_PROXIMITY_DISTANCE);
+  proximity_pairs_ = 0;
+  proximity_min_distance_ = std::numeric_limits<double>::infinity();
+  private_node_handle_->param("agent_timeout", agent_timeout_, (double)DEFAULT_AGENT_TIMEOUT);
+  connected_agents_.reserve(number_of_agents_ + 1, MAX_TABLE_AGENT_ID);
+  evicted_agents_ = 0;
+  private_node_handle_->param("ingest_threads", ingest_threads_, DEFAULT_INGEST_THREADS);
+  if (ingest_threads_ < 1) {
+    CONSOLE_STREAM(WARN, "Wrong number of ingest threads (default value is used).");
+    ingest_threads_ = DEFAULT_INGEST_THREADS;
+  }
 
   std::vector<double> target_values;
   const std::vector<double> DEFAULT_TARGET_STATS = {0, 0, 1, 0, 1};
@@ -55,18 +111,61 @@ VisualizationCore::VisualizationCore() {
   }
 
   marker_publisher_ = node_handle_.advertise<visualization_msgs::Marker>(marker_topic_name_, topic_queue_length_);
-  target_stats_publisher_ = node_handle_.advertise<formation_control::FormationStatisticsStamped>(target_stats_topic_name_, topic_queue_length_);
-  stats_subscriber_ = node_handle_.subscribe(shared_stats_topic_name_, number_of_agents_, &VisualizationCore::sharedStatsCallback, this);
-  agent_poses_subscriber_ = node_handle_.subscribe(agent_poses_topic_name_, 2, &VisualizationCore::agentPosesCallback, this);
-  interactive_marker_server_ = new interactive_markers::InteractiveMarkerServer("interactive_markers");
-
-  algorithm_timer_ = private_node_handle_->createTimer(ros::Duration(sample_time_), &VisualizationCore::algorithmCallback, this);
+  // latched: an agent restarted before its eviction does not rejoin, but it still gets the last target change (newer
+  // than the one latched on its own target topic at its first join, see AgentCore::targetStatsCallback)
+  target_stats_publisher_ = node_handle_.advertise<formation_control::FormationStatisticsStamped>(target_stats_topic_name_, topic_queue_length_, true);
+  diagnostics_publisher_ = node_handle_.advertise<diagnostic_msgs::DiagnosticArray>(diagnostics_topic_name_, topic_queue_length_);
+  link_monitor_.reserve(number_of_agents_ + 1, sample_time_, frame_tdma_, slot_tdma_);
+  ingest_node_handle_ = node_handle_;
+  ingest_node_handle_.setCallbackQueue(&ingest_queue_);
+  algorithm_node_handle_ = *private_node_handle_;
+  algorithm_node_handle_.setCallbackQueue(&algorithm_queue_);
+  std::string stats_topic_name = compact_statistics_ ? shared_stats_compact_topic_name_ : shared_stats_topic_name_;
+  if (predict_statistics_) {
+    stats_topic_name = shared_stats_predicted_topic_name_;
+  }
+  if (communication_topology_ == "all") {
+    stats_subscriber_ = subscribeStatistics(stats_topic_name, number_of_agents_);
+    stats_array_subscriber_ = ingest_node_handle_.subscribe(shared_stats_array_topic_name_, topic_queue_length_,
+                                                            &VisualizationCore::sharedStatsArrayCallback, this);
+  }
+  else {
+    for (int id = 1; id <= number_of_agents_; id++) {
+      agent_stats_subscribers_.push_back(subscribeStatistics(getAgentTopic(stats_topic_name, id), topic_queue_length_));
+    }
+  }
+  agent_poses_subscriber_ = ingest_node_handle_.subscribe(agent_poses_topic_name_, 2, &VisualizationCore::agentPosesCallback, this);
+  // the agent poses are stored on receipt (this is the only subscriber of the tf topic, there is no tf listener)
+  tf_subscriber_ = ingest_node_handle_.subscribe(tf_topic_name_, topic_queue_length_*number_of_agents_, &VisualizationCore::tfCallback, this);
+  // the server spins its own thread, thus the operator is never delayed by the ingest nor by the algorithm
+  interactive_marker_server_ = new interactive_markers::InteractiveMarkerServer("interactive_markers", "", true);
+  sync_server_ = node_handle_.advertiseService(sync_service_name_, &VisualizationCore::syncAgentCallback, this);
+
+  algorithm_timer_ = algorithm_node_handle_.createTimer(ros::Duration(sample_time_), &VisualizationCore::algorithmCallback, this);
+  tf_timer_ = private_node_handle_->createTimer(ros::Duration(tf_rate_ > 0 ? 1.0/tf_rate_ : sample_time_),
+                                                &VisualizationCore::tfTimerCallback, this);
+  if (diagnostics_rate_ > 0) {
+    diagnostics_timer_ = private_node_handle_->createTimer(ros::Duration(1.0/diagnostics_rate_),
+                                                           &VisualizationCore::diagnosticsCallback, this);
+  }
 
   updateTarget(target_statistics);
   interactiveMarkerInitialization();
+
+  ingest_spinner_ = new ros::AsyncSpinner(ingest_threads_, &ingest_queue_);
+  algorithm_spinner_ = new ros::AsyncSpinner(1, &algorithm_queue_);
+  ingest_spinner_->start();
+  algorithm_spinner_->start();
 }
 
 VisualizationCore::~VisualizationCore() {
+  // no callback runs on the queues once the spinners are stopped
+  if (ingest_spinner_) {
+    ingest_spinner_->stop();
+    algorithm_spinner_->stop();
+  }
+  delete ingest_spinner_;
+  delete algorithm_spinner_;
   delete interactive_marker_server_;
   delete private_node_handle_;
 }
@@ -74,76 +173,168 @@ VisualizationCore::~VisualizationCore() {
 void VisualizationCore::agentPosesCallback(const geometry_msgs::PoseStamped &pose_msg) {
   tf::Pose pose_tf;
   tf::poseMsgToTF(pose_msg.pose, pose_tf);
-  tf_broadcaster_.sendTransform(tf::StampedTransform(pose_tf, pose_msg.header.stamp, frame_map_, pose_msg.header.frame_id));
+  queueTransform(tf::StampedTransform(pose_tf, pose_msg.header.stamp, frame_map_, pose_msg.header.frame_id));
+
+  int id;
+  bool is_virtual;
+  if (parseAgentFrame(pose_msg.header.frame_id, id, is_virtual)) {
+    storeAgentPose(id, is_virtual, pose_msg.pose, pose_msg.header.stamp);
+  }
 }
 
 void VisualizationCore::algorithmCallback(const ros::TimerEvent &timer_event) {
+  evictAgents();
   computeEffectiveEllipse("");
   computeEffectiveEllipse(frame_virtual_suffix_);
-}
+  publishTargetStats(false);  // the last target changed through the interactive markers (if coalesced)
 
-double VisualizationCore::computeA(const double &diameter) const {
-  return std::pow(diameter, 2) / (4*number_of_agents_);
+  if (communication_topology_ == "knn" || proximity_distance_ > 0) {
+    updateAgentGrid();
+  }
+  if (communication_topology_ == "knn") {
+    assignNeighbors();
+  }
+  if (proximity_distance_ > 0) {
+    monitorProximity();
+  }
 }
 
-double VisualizationCore::computeDiameter(const double &a) const {
-  return 2*std::sqrt(number_of_agents_*std::abs(a));
-}
+void VisualizationCore::assignNeighbors() {
+  std::map<int, std::set<int>> neighbors;
+  std::vector<std::pair<double, int>> nearest;
+  for (std::size_t i = 0; i < agent_grid_ids_.size(); i++) {
+    int id = agent_grid_ids_.at(i);
+    agent_grid_.knn(agent_grid_x_.at(i), agent_grid_y_.at(i), number_of_neighbors_, id, nearest);
+    neighbors[id];  // also the isolated agents have to be notified
+    for (auto const &other : nearest) {
+      // undirected graph (the symmetry of the Laplacian matrix preserves the average consensus)
+      neighbors[id].insert(other.second);
+      neighbors[other.second].insert(id);
+    }
+  }
 
-void VisualizationCore::computeEffectiveEllipse(const std::string &frame_suffix) {
-  std::vector<geometry_msgs::Pose> agent_poses;
-  for (auto const &id : connected_agents_) {
-    std::string frame = frame_agent_prefix_ + std::to_string(id) + frame_suffix;
-    if (tf_listener_.canTransform(frame_map_, frame, ros::Time(0))) {
-      tf::StampedTransform pose_tf;
-      geometry_msgs::Pose pose_msg;
-      tf_listener_.lookupTransform(frame_map_, frame, ros::Time(0), pose_tf);
-      tf::poseTFToMsg(pose_tf, pose_msg);
-      agent_poses.push_back(pose_msg);
+  for (auto const &agent : neighbors) {
+    if (neighbors_.count(agent.first) && neighbors_.at(agent.first) == agent.second) {
+      continue;  // only the changes are notified
     }
+    if (!neighbors_publishers_.count(agent.first)) {
+      // latched: the agent receives its neighbors even if it subscribes later
+      neighbors_publishers_[agent.first] = node_handle_.advertise<formation_control::AgentNeighbors>(getAgentTopic(neighbors_topic_name_, agent.first), 1, true);
+    }
+    formation_control::AgentNeighbors msg;
+    msg.header.frame_id = frame_ground_station_;
+    msg.header.stamp = ros::Time::now();
+    msg.agent_id = agent.first;
+    msg.neighbors.assign(agent.second.begin(), agent.second.end());
+    neighbors_publishers_.at(agent.first).publish(msg);
+    neighbors_[agent.first] = agent.second;
+
+    CONSOLE_STREAM(DEBUG_V, "Agent " << agent.first << " has " << agent.second.size() << " neighbors.");
   }
-  
+}
+
+void VisualizationCore::computeEffectiveEllipse(const std::string &frame_suffix) {
+  agent_poses_mutex_.lock();
+  MomentsAccumulator moments = frame_suffix.empty() ? agent_moments_ : agent_virtual_moments_;
+  agent_poses_mutex_.unlock();
+
   formation_control::FormationStatisticsStamped effective_statistics;
   effective_statistics.header.frame_id = frame_effective_prefix_ + frame_suffix;
   effective_statistics.header.stamp = ros::Time::now();
-  effective_statistics.stats = computeStatsFromPoses(agent_poses);
+  effective_statistics.stats = moments.getStatistics();
   updateSpanningEllipse(effective_statistics);
 }
 
-formation_control::FormationStatistics VisualizationCore::computeStatsFromPoses(const std::vector<geometry_msgs::Pose> &poses) const {
-  formation_control::FormationStatistics stats;
+std::string VisualizationCore::consolePrefix(const std::string &caller_name) const {
+  return "[VisualizationCore::" + caller_name + "]  ";
+}
 
-  for (auto const &pose : poses) {
-    stats.m_x += pose.position.x / poses.size();
-    stats.m_y += pose.position.y / poses.size();
-    stats.m_xx += std::pow(pose.position.x, 2) / poses.size();
-    stats.m_xy += pose.position.x * pose.position.y / poses.size();
-    stats.m_yy += std::pow(pose.position.y, 2) / poses.size();
+void VisualizationCore::diagnosticsCallback(const ros::TimerEvent &timer_event) {
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  msg.status.push_back(link_monitor_.getStatus("formation_control/" + frame_ground_station_ + "/latency",
+                                               frame_ground_station_, frame_agent_prefix_));
+
+  connected_agents_mutex_.lock();
+  int connected = connected_agents_.getNumberOfAgents();
+  unsigned long evicted = evicted_agents_;
+  connected_agents_mutex_.unlock();
+  diagnostic_msgs::DiagnosticStatus agents_status;
+  agents_status.name = "formation_control/" + frame_ground_station_ + "/agents";
+  agents_status.hardware_id = frame_ground_station_;
+  agents_status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  agents_status.message = std::to_string(connected) + " connected agents";
+  diagnostic_msgs::KeyValue agents_value;
+  agents_value.key = "connected";
+  agents_value.value = std::to_string(connected);
+  agents_status.values.push_back(agents_value);
+  agents_value.key = "evicted";
+  agents_value.value = std::to_string(evicted);
+  agents_status.values.push_back(agents_value);
+  msg.status.push_back(agents_status);
+
+  if (proximity_distance_ > 0) {
+    proximity_mutex_.lock();
+    int pairs = proximity_pairs_;
+    double min_distance = proximity_min_distance_;
+    proximity_mutex_.unlock();
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "formation_control/" + frame_ground_station_ + "/proximity";
+    status.hardware_id = frame_ground_station_;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK + (pairs > 0);  // WARN if some agents are too close
+    status.message = std::to_string(pairs) + " pairs of agents closer than " + std::to_string(proximity_distance_) + " m";
+    diagnostic_msgs::KeyValue value;
+    value.key = "close_pairs";
+    value.value = std::to_string(pairs);
+    status.values.push_back(value);
+    value.key = "min_distance";
+    value.value = std::to_string(min_distance);
+    status.values.push_back(value);
+    msg.status.push_back(status);
   }
-
-  return stats;
+  diagnostics_publisher_.publish(msg);
 }
 
-void VisualizationCore::console(const std::string &caller_name, std::stringstream &message, const int &log_level) const {
-  std::stringstream s;
-  s << "[VisualizationCore::" << caller_name << "]  " << message.str();
-
-  if (log_level < WARN) {  // error messages
-    ROS_ERROR_STREAM(s.str());
-  }
-  else if (log_level == WARN) {  // warn messages
-    ROS_WARN_STREAM(s.str());
+void VisualizationCore::evictAgents() {
+  std::vector<int> evicted;
+  connected_agents_mutex_.lock();
+  connected_agents_.evict(ros::Time::now().toSec(), agent_timeout_, evicted);
+  evicted_agents_ += evicted.size();
+  connected_agents_mutex_.unlock();
+  if (evicted.empty()) {
+    return;
   }
-  else if (log_level == INFO) {  // info messages
-    ROS_INFO_STREAM(s.str());
+
+  agent_poses_mutex_.lock();
+  for (auto const &id : evicted) {
+    for (int is_virtual = 0; is_virtual < 2; is_virtual++) {
+      std::vector<AgentPose> &table = is_virtual ? agent_virtual_poses_ : agent_poses_;
+      MomentsAccumulator &moments = is_virtual ? agent_virtual_moments_ : agent_moments_;
+      if (id < (int)table.size() && table.at(id).valid) {
+        moments.remove(table.at(id).pose.position.x, table.at(id).pose.position.y);
+        table.at(id).valid = false;
+      }
+    }
   }
-  else if (log_level > INFO && log_level <= verbosity_level_) {  // debug messages
-    ROS_DEBUG_STREAM(s.str());
+  agent_poses_mutex_.unlock();
+
+  for (auto const &id : evicted) {
+    std::string frame = frame_agent_prefix_ + std::to_string(id) + frame_virtual_suffix_ + frame_ellipse_suffix_;
+    ellipses_mutex_.lock();
+    ellipses_.erase(frame);
+    ellipses_mutex_.unlock();
+
+    visualization_msgs::Marker marker = makeEllipse(0, 0, frame, id);
+    marker.action = visualization_msgs::Marker::DELETE;
+    marker_publisher_.publish(marker);
+
+    CONSOLE_STREAM(WARN, "Agent " << id << " evicted (silent for more than " << agent_timeout_ << "s).");
   }
+}
 
-  // clears the stringstream passed to this method
-  message.clear();
-  message.str(std::string());
+std::string VisualizationCore::getAgentTopic(const std::string &topic, const int &id) const {
+  return topic + "/" + frame_agent_prefix_ + std::to_string(id);
 }
 
 void VisualizationCore::interactiveMarkerCallback(const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback) {
@@ -154,19 +345,22 @@ void VisualizationCore::interactiveMarkerCallback(const visualization_msgs::Inte
     interactive_marker_server_->setPose(feedback->marker_name, target_pose_, feedback->header);
   }
   else if (feedback->marker_name == "stats_modifier_axis_x") {
-    target_a_x_ = computeA(2*feedback->pose.position.x);
+    target_a_x_ = StatsGeometry::computeA(2*feedback->pose.position.x, number_of_agents_);
   }
   else if (feedback->marker_name == "stats_modifier_axis_y") {
-    target_a_y_ = computeA(2*feedback->pose.position.y);
+    target_a_y_ = StatsGeometry::computeA(2*feedback->pose.position.y, number_of_agents_);
   }
   else {
-    std::stringstream s;
-    s << "Wrong marker name ("<< feedback->marker_name << ").";
-    console(__func__, s, ERROR);
+    CONSOLE_STREAM(ERROR, "Wrong marker name ("<< feedback->marker_name << ").");
     return;
   }
 
-  updateTarget(physicsToStats(target_pose_, target_a_x_, target_a_y_));
+  StatsEllipse target_ellipse = {target_pose_.position.x, target_pose_.position.y, tf::getYaw(target_pose_.orientation),
+                                 target_a_x_, target_a_y_};
+  updateTarget(StatsGeometry::ellipseToStats(target_ellipse));
+  if (feedback->event_type == visualization_msgs::InteractiveMarkerFeedback::MOUSE_UP) {
+    publishTargetStats(true);  // the end of a drag is always notified to the agents
+  }
   interactive_marker_server_->applyChanges();
 }
 
@@ -192,32 +386,65 @@ void VisualizationCore::interactiveMarkerGuidance(const geometry_msgs::Pose &tar
 
   tf::poseTFToMsg(current_pose, current);
 
-  std::stringstream s;
-  s << "Distance and its satured value (" << distance << ", " << distance_sat << ").";
-  console(__func__, s, DEBUG_VVVV);
-  s << "Angle and its saturated value (" << angle << ", " << angle_sat << ").";
-  console(__func__, s, DEBUG_VVVV);
+  CONSOLE_STREAM(DEBUG_VVVV, "Distance and its satured value (" << distance << ", " << distance_sat << ").");
+  CONSOLE_STREAM(DEBUG_VVVV, "Angle and its saturated value (" << angle << ", " << angle_sat << ").");
 }
 
 void VisualizationCore::interactiveMarkerInitialization() {
-  // also initializes target_a_x_ and target_a_y_
-  tf::Pose target_pose = statsToPhysics(target_statistics_.stats, target_a_x_, target_a_y_);
-  tf::poseTFToMsg(target_pose, target_pose_);
+  // also initializes target_pose_, target_a_x_ and target_a_y_
+  StatsEllipse target_ellipse = StatsGeometry::statsToEllipse(target_statistics_.stats);
+  target_a_x_ = target_ellipse.a_x;
+  target_a_y_ = target_ellipse.a_y;
+  target_pose_ = geometry_msgs::Pose();
+  target_pose_.position.x = target_ellipse.x;
+  target_pose_.position.y = target_ellipse.y;
+  target_pose_.orientation = tf::createQuaternionMsgFromYaw(target_ellipse.theta);
   makeInteractiveMarkerPose(target_pose_);
 
   geometry_msgs::Pose pose;
   tf::Transform translate;
   translate.setIdentity();  // null pose (it is centered in the 'frame_target_ellipse_' frame)
 
-  translate.setOrigin(tf::Vector3(computeDiameter(target_a_x_)/2, 0, 0));
+  translate.setOrigin(tf::Vector3(StatsGeometry::computeDiameter(target_a_x_, number_of_agents_)/2, 0, 0));
   tf::poseTFToMsg(translate, pose);
   makeInteractiveMarkerAxis(pose, "x");
 
-  translate.setOrigin(tf::Vector3(0, computeDiameter(target_a_y_)/2, 0));
+  translate.setOrigin(tf::Vector3(0, StatsGeometry::computeDiameter(target_a_y_, number_of_agents_)/2, 0));
   tf::poseTFToMsg(translate, pose);
   makeInteractiveMarkerAxis(pose, "y");
 }
 
+bool VisualizationCore::isEllipseChanged(const EllipseState &old, const EllipseState &current, const ros::Time &now) const {
+  if (ellipse_refresh_period_ > 0 && now - old.last_publish >= ros::Duration(ellipse_refresh_period_)) {
+    return true;  // unchanged ellipses are refreshed anyway (e.g. for a late rviz)
+  }
+  return std::hypot(current.x - old.x, current.y - old.y) > ellipse_position_tolerance_
+         || std::abs(angles::shortest_angular_distance(old.theta, current.theta)) > ellipse_angle_tolerance_
+         || std::abs(current.diameter_x - old.diameter_x) > ellipse_diameter_tolerance_
+         || std::abs(current.diameter_y - old.diameter_y) > ellipse_diameter_tolerance_;
+}
+
+bool VisualizationCore::isConsoleEnabled(const int &log_level) const {
+  return log_level <= INFO || log_level <= verbosity_level_;
+}
+
+std::map<int, geometry_msgs::Pose> VisualizationCore::lookupAgentPoses(const std::string &frame_suffix) {
+  std::map<int, geometry_msgs::Pose> agent_poses;
+  connected_agents_mutex_.lock();
+  std::vector<int> connected_agents = connected_agents_.getIds();
+  connected_agents_mutex_.unlock();
+
+  agent_poses_mutex_.lock();
+  const std::vector<AgentPose> &table = frame_suffix.empty() ? agent_poses_ : agent_virtual_poses_;
+  for (auto const &id : connected_agents) {
+    if (id >= 0 && id < (int)table.size() && table.at(id).valid) {
+      agent_poses[id] = table.at(id).pose;
+    }
+  }
+  agent_poses_mutex_.unlock();
+  return agent_poses;
+}
+
 visualization_msgs::Marker VisualizationCore::makeBox(const double &scale) const {
   visualization_msgs::Marker marker;
 
@@ -289,9 +516,7 @@ visualization_msgs::Marker VisualizationCore::makeEllipse(const double &diameter
 
 void VisualizationCore::makeInteractiveMarkerAxis(const geometry_msgs::Pose &pose, const std::string &axis) {
   if (axis != "x" && axis != "y") {
-    std::stringstream s;
-    s << "Wrong axis string (" << axis << ").";
-    console(__func__, s, ERROR);
+    CONSOLE_STREAM(ERROR, "Wrong axis string (" << axis << ").");
     return;
   }
 
@@ -351,151 +576,359 @@ void VisualizationCore::makeInteractiveMarkerPose(const geometry_msgs::Pose &pos
   interactive_marker_server_->applyChanges();
 }
 
-formation_control::FormationStatistics VisualizationCore::physicsToStats(const geometry_msgs::Pose &pose, const double &a_x,
-                                                                  const double &a_y) const {
-  double roll, pitch, yaw;
-  tf::Quaternion q;
-  tf::quaternionMsgToTF(pose.orientation, q);
-  tf::Matrix3x3(q).getRPY(roll, pitch, yaw);
+void VisualizationCore::monitorProximity() {
+  int pairs = 0;
+  double min_distance = std::numeric_limits<double>::infinity();
+  std::vector<std::pair<double, int>> found;
+  for (std::size_t i = 0; i < agent_grid_ids_.size(); i++) {
+    int id = agent_grid_ids_.at(i);
+    if (agent_grid_.knn(agent_grid_x_.at(i), agent_grid_y_.at(i), 1, id, found) > 0) {
+      min_distance = std::min(min_distance, found.front().first);
+    }
+    agent_grid_.radius(agent_grid_x_.at(i), agent_grid_y_.at(i), proximity_distance_, id, found);
+    for (auto const &other : found) {
+      pairs += (other.second > id);  // each pair is counted once
+    }
+  }
 
-  formation_control::FormationStatistics stats;
-  stats.m_x = pose.position.x;
-  stats.m_y = pose.position.y;
-  stats.m_xx = a_x*std::pow(std::cos(yaw), 2) + a_y*std::pow(std::sin(yaw), 2) + std::pow(stats.m_x, 2);
-  stats.m_xy = (a_x - a_y)*std::sin(yaw)*std::cos(yaw) + stats.m_x*stats.m_y;
-  stats.m_yy = a_x*std::pow(std::sin(yaw), 2) + a_y*std::pow(std::cos(yaw), 2) + std::pow(stats.m_y, 2);
+  proximity_mutex_.lock();
+  if (pairs > proximity_pairs_) {
+    CONSOLE_STREAM(WARN, pairs << " pairs of agents closer than " << proximity_distance_ << " m (minimum distance "
+                   << min_distance << " m).");
+  }
+  proximity_pairs_ = pairs;
+  proximity_min_distance_ = min_distance;
+  proximity_mutex_.unlock();
+}
 
-  std::stringstream s;
-  s << "RPY angles (" << roll << ", " << pitch << ", " << yaw << ").";
-  console(__func__, s, DEBUG_VVVV);
-  s << "Converted statistics (" << stats.m_x << ", " << stats.m_y << ", " << stats.m_xx << ", " << stats.m_xy << ", "
-    << stats.m_yy << ").";
-  console(__func__, s, DEBUG_VVV);
+bool VisualizationCore::parseAgentFrame(const std::string &frame, int &id, bool &is_virtual) const {
+  std::size_t begin = (!frame.empty() && frame.front() == '/') ? 1 : 0;
+  if (frame.compare(begin, frame_agent_prefix_.size(), frame_agent_prefix_) != 0) {
+    return false;
+  }
+  begin += frame_agent_prefix_.size();
+
+  std::size_t end = begin;
+  while (end < frame.size() && std::isdigit(static_cast<unsigned char>(frame.at(end)))) {
+    end++;
+  }
+  if (end == begin || end - begin > 9) {  // no id or out of range
+    return false;
+  }
 
-  return stats;
+  std::string suffix = frame.substr(end);
+  if (!suffix.empty() && suffix != frame_virtual_suffix_) {
+    return false;  // e.g. the agent ellipse frame
+  }
+  id = std::stoi(frame.substr(begin, end - begin));
+  is_virtual = !suffix.empty();
+  return true;
 }
 
-double VisualizationCore::saturation(const double &value, const double &min, const double &max) const {
-  return std::min(std::max(value, min), max);
+void VisualizationCore::processSharedStats(const formation_control::FormationStatisticsStamped &shared, const bool &slot_check,
+                                           const StatsEllipse &ellipse) {
+  link_monitor_.add(shared.agent_id, shared.agent_id, shared.header.stamp.toSec(), ros::Time::now().toSec(), slot_check);
+
+  connected_agents_mutex_.lock();
+  bool joined = connected_agents_.update(shared.agent_id, ros::Time::now().toSec());
+  connected_agents_mutex_.unlock();
+  if (joined) {
+    CONSOLE_STREAM(INFO, "Agent " << shared.agent_id << " connected.");
+    publishAgentTarget(shared.agent_id);  // the new agent does not know the current target statistics yet
+  }
+
+  publishSpanningEllipse(shared.header.frame_id + frame_ellipse_suffix_, shared.agent_id, ellipse);
+
+  CONSOLE_STREAM(DEBUG_VVVV, "Update spanning ellipse for " << shared.header.frame_id);
 }
 
-void VisualizationCore::sharedStatsCallback(const formation_control::FormationStatisticsStamped &shared) {
-  if (std::find(std::begin(connected_agents_), std::end(connected_agents_), shared.agent_id) == std::end(connected_agents_)) {
-    connected_agents_.push_back(shared.agent_id);  // msg from a new agent
-    updateTarget(target_statistics_.stats);  // notify the current target statistics (actually, to all the agents)
+void VisualizationCore::publishAgentTarget(const int &id) {
+  std::lock_guard<std::mutex> lock(target_mutex_);
+  if (!agent_target_publishers_.count(id)) {
+    // latched: the agent receives the target even if it subscribes later
+    agent_target_publishers_[id] = node_handle_.advertise<formation_control::FormationStatisticsStamped>(getAgentTopic(target_stats_topic_name_, id), 1, true);
+  }
+  formation_control::FormationStatisticsStamped msg = target_statistics_;
+  msg.header.stamp = ros::Time::now();  // newer than the previous publications (see AgentCore::targetStatsCallback)
+  agent_target_publishers_.at(id).publish(msg);
+}
+
+void VisualizationCore::publishSpanningEllipse(const std::string &frame, const int &id, const StatsEllipse &ellipse) {
+  ros::Time now = ros::Time::now();
+  EllipseState state;
+  state.x = ellipse.x;
+  state.y = ellipse.y;
+  state.theta = ellipse.theta;
+  state.diameter_x = StatsGeometry::computeDiameter(ellipse.a_x, number_of_agents_);
+  state.diameter_y = StatsGeometry::computeDiameter(ellipse.a_y, number_of_agents_);
+  state.last_publish = now;
+
+  ellipses_mutex_.lock();
+  auto old = ellipses_.find(frame);
+  if (old != ellipses_.end() && !isEllipseChanged(old->second, state, now)) {
+    ellipses_mutex_.unlock();
+    return;
   }
+  ellipses_[frame] = state;
+  ellipses_mutex_.unlock();
 
-  updateSpanningEllipse(shared);
+  tf::Pose pose(tf::createQuaternionFromYaw(ellipse.theta), tf::Vector3(ellipse.x, ellipse.y, 0));
+  queueTransform(tf::StampedTransform(pose, now, frame_map_, frame));
+  marker_publisher_.publish(makeEllipse(state.diameter_x, state.diameter_y, frame, id));
+}
 
-  std::stringstream s;
-  s << "Update spanning ellipse for " << shared.header.frame_id;
-  console(__func__, s, DEBUG_VVVV);
+void VisualizationCore::publishTargetStats(const bool &force) {
+  target_mutex_.lock();
+  ros::Time now = ros::Time::now();
+  bool rate_elapsed = force || target_rate_ <= 0 || now - last_target_publish_ >= ros::Duration(1.0 / target_rate_);
+  if (target_pending_ && rate_elapsed) {
+    target_statistics_.header.stamp = now;
+    target_stats_publisher_.publish(target_statistics_);
+    last_target_publish_ = now;
+    target_pending_ = false;
+  }
+  target_mutex_.unlock();
 }
 
-tf::Pose VisualizationCore::statsToPhysics(const formation_control::FormationStatistics &stats, double &a_x, double &a_y) {
-  return statsToPhysics(stats, a_x, a_y, std::nan(""));
+void VisualizationCore::queueTransform(const tf::StampedTransform &transform) {
+  queued_transforms_mutex_.lock();
+  queued_transforms_[transform.child_frame_id_] = transform;
+  queued_transforms_mutex_.unlock();
 }
 
-tf::Pose VisualizationCore::statsToPhysics(const formation_control::FormationStatistics &stats, double &a_x, double &a_y,
-                                           const double &theta_old) {
-  double m_xy = 2*(stats.m_xy - stats.m_x*stats.m_y);
-  double m_xx = stats.m_xx - std::pow(stats.m_x, 2);
-  double m_yy = stats.m_yy - std::pow(stats.m_y, 2);
+double VisualizationCore::saturation(const double &value, const double &min, const double &max) const {
+  return std::min(std::max(value, min), max);
+}
 
-  double theta = std::atan2(m_xy, (m_xx - m_yy))/2;
-  std::stringstream s;
-  s << "Theta value (" << theta << ").";
-  console(__func__, s, DEBUG_VVVV);
-  if (!std::isnan(theta_old)) {  // interactive markers must have a coherent pose (theta != theta + PI)
-    thetaCorrection(theta, theta_old);
+void VisualizationCore::sharedStatsArrayCallback(const formation_control::FormationStatisticsArray &shared) {
+  if (shared.agent_ids.size() != shared.stats.size()) {
+    CONSOLE_STREAM(ERROR, "Wrong statistics array sizes (" << shared.agent_ids.size() << ", " << shared.stats.size() << ").");
+    return;
   }
 
-  a_x = m_xx*std::pow(std::cos(theta), 2) + m_yy*std::pow(std::sin(theta), 2) + m_xy*std::sin(theta)*std::cos(theta);
-  a_y = m_yy*std::pow(std::cos(theta), 2) + m_xx*std::pow(std::sin(theta), 2) - m_xy*std::sin(theta)*std::cos(theta);
+  // all the ellipses are computed in a single pass over the components of the statistics
+  const int n = shared.stats.size();
+  stats_array_buffer_.resize(2*StatsGeometry::NUMBER_OF_STATS*n);
+  double *stats[StatsGeometry::NUMBER_OF_STATS];
+  double *ellipses[StatsGeometry::NUMBER_OF_STATS];
+  for (int s = 0; s < StatsGeometry::NUMBER_OF_STATS; s++) {
+    stats[s] = stats_array_buffer_.data() + s*n;
+    ellipses[s] = stats_array_buffer_.data() + (StatsGeometry::NUMBER_OF_STATS + s)*n;
+  }
+  for (int i = 0; i < n; i++) {
+    double values[StatsGeometry::NUMBER_OF_STATS];
+    StatsGeometry::toArray(shared.stats.at(i), values);
+    for (int s = 0; s < StatsGeometry::NUMBER_OF_STATS; s++) {
+      stats[s][i] = values[s];
+    }
+  }
+  StatsGeometry::statsToEllipses(n, stats, ellipses);
+
+  // the array is sent in the TDMA slot of the aggregating node
+  StatsGeometry::unpackArray(shared, frame_agent_prefix_, frame_virtual_suffix_,
+                             [&](const std::size_t &i, const formation_control::FormationStatisticsStamped &msg) {
+                               StatsEllipse ellipse = {ellipses[0][i], ellipses[1][i], ellipses[2][i], ellipses[3][i],
+                                                       ellipses[4][i]};
+                               processSharedStats(msg, false, ellipse);
+                             });
+}
 
-  tf::Pose pose;
-  pose.setOrigin(tf::Vector3(stats.m_x, stats.m_y, 0));
-  pose.setRotation(tf::createQuaternionFromRPY(0, 0, theta));
+void VisualizationCore::sharedStatsCallback(const formation_control::FormationStatisticsStamped &shared) {
+  processSharedStats(shared, true, StatsGeometry::statsToEllipse(shared.stats));
+}
 
-  s << "a_x and a_y values (" << a_x << ", " << a_y << ").";
-  console(__func__, s, DEBUG_VVVV);
+void VisualizationCore::sharedStatsCompactCallback(const formation_control::FormationStatisticsCompact &shared) {
+  formation_control::FormationStatisticsStamped msg = compact_codec_.decode(shared, ros::Time::now());
+  processSharedStats(msg, true, StatsGeometry::statsToEllipse(msg.stats));
+}
 
-  return pose;
+void VisualizationCore::sharedStatsPredictedCallback(const formation_control::FormationStatisticsPredicted &shared) {
+  processSharedStats(shared.estimate, true, StatsGeometry::statsToEllipse(shared.estimate.stats));
 }
 
 formation_control::FormationStatistics VisualizationCore::statsVectorPhysicsToMsg(const std::vector<double> &vector) const {
-  geometry_msgs::Pose pose_msg;
-  tf::Pose pose_tf;
-  pose_tf.setOrigin(tf::Vector3(vector.at(0), vector.at(1), 0));
-  pose_tf.setRotation(tf::createQuaternionFromRPY(0, 0, vector.at(2)));
-  poseTFToMsg(pose_tf, pose_msg);
-
-  return physicsToStats(pose_msg, computeA(vector.at(3)), computeA(vector.at(4)));
+  StatsEllipse ellipse = {vector.at(0), vector.at(1), vector.at(2),
+                          StatsGeometry::computeA(vector.at(3), number_of_agents_),
+                          StatsGeometry::computeA(vector.at(4), number_of_agents_)};
+  return StatsGeometry::ellipseToStats(ellipse);
 }
 
 formation_control::FormationStatistics VisualizationCore::statsVectorToMsg(const std::vector<double> &vector) const {
-  formation_control::FormationStatistics msg;
-  if (vector.size() != 5) {
-    std::stringstream s;
-    s << "Wrong statistics vector size (" << vector.size() << ").";
-    console(__func__, s, ERROR);
-    return msg;
+  if (vector.size() != StatsGeometry::NUMBER_OF_STATS) {
+    CONSOLE_STREAM(ERROR, "Wrong statistics vector size (" << vector.size() << ").");
+    return formation_control::FormationStatistics();
+  }
+  return StatsGeometry::fromArray(vector.data());
+}
+
+void VisualizationCore::storeAgentPose(const int &id, const bool &is_virtual, const geometry_msgs::Pose &pose,
+                                       const ros::Time &stamp) {
+  if (id < 0 || id > MAX_TABLE_AGENT_ID) {
+    CONSOLE_STREAM(WARN, "Agent id out of range (" << id << "), pose discarded.");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(agent_poses_mutex_);
+  // checked under the poses lock, thus an agent is either skipped or removed afterwards by evictAgents
+  connected_agents_mutex_.lock();
+  bool connected = connected_agents_.isConnected(id);
+  connected_agents_mutex_.unlock();
+  if (!connected) {
+    return;  // not counted in the effective statistics until its first statistics are received
+  }
+
+  std::vector<AgentPose> &table = is_virtual ? agent_virtual_poses_ : agent_poses_;
+  if (id >= (int)table.size()) {
+    table.resize(id + 1, AgentPose());
+  }
+  AgentPose &entry = table.at(id);
+  if (entry.valid && stamp < entry.stamp) {
+    return;  // out of order
   }
-  msg.m_x = vector.at(0);
-  msg.m_y = vector.at(1);
-  msg.m_xx = vector.at(2);
-  msg.m_xy = vector.at(3);
-  msg.m_yy = vector.at(4);
 
-  return msg;
+  MomentsAccumulator &moments = is_virtual ? agent_virtual_moments_ : agent_moments_;
+  if (entry.valid) {
+    moments.update(entry.pose.position.x, entry.pose.position.y, pose.position.x, pose.position.y);
+  }
+  else {
+    moments.add(pose.position.x, pose.position.y);
+  }
+  entry.pose = pose;
+  entry.stamp = stamp;
+  entry.valid = true;
 }
 
-void VisualizationCore::thetaCorrection(double &theta, const double &theta_old) const {
-  std::vector<double> thetas;
-  std::vector<double> increments = {0, M_PI_2, M_PI, M_PI + M_PI_2};
-  for (auto const i : increments) {
-    thetas.push_back(angles::normalize_angle(theta + i));
+ros::Subscriber VisualizationCore::subscribeStatistics(const std::string &topic, const int &queue_length) {
+  if (compact_statistics_) {
+    return ingest_node_handle_.subscribe(topic, queue_length, &VisualizationCore::sharedStatsCompactCallback, this);
+  }
+  if (predict_statistics_) {
+    return ingest_node_handle_.subscribe(topic, queue_length, &VisualizationCore::sharedStatsPredictedCallback, this);
   }
+  return ingest_node_handle_.subscribe(topic, queue_length, &VisualizationCore::sharedStatsCallback, this);
+}
 
-  auto min_distance_theta = std::min_element(std::begin(thetas), std::end(thetas),
-                                             [&theta_old](const double &t1, const double &t2){
-                                               return std::abs(angles::shortest_angular_distance(t1, theta_old))
-                                                      < std::abs(angles::shortest_angular_distance(t2, theta_old));
-                                             });
+bool VisualizationCore::syncAgentCallback(formation_control::SyncAgent::Request &request,
+                                          formation_control::SyncAgent::Response &response) {
+  sync_mutex_.lock();
+  if (sync_start_time_.isZero()) {
+    // the common start is aligned to the TDMA frames, thus also the agents with an explicit id share them
+    sync_start_time_.fromSec(std::ceil((ros::Time::now().toSec() + sync_delay_)/frame_tdma_)*frame_tdma_);
+  }
 
-  theta = angles::normalize_angle(thetas.at(min_distance_theta - std::begin(thetas)));
+  int id = 0;
+  auto node_id = sync_node_ids_.find(request.node_name);
+  if (node_id != sync_node_ids_.end()) {
+    id = node_id->second;
+  }
+  else if (sync_available_ids_.count(request.agent_id)) {
+    id = request.agent_id;
+  }
+  else if (!sync_available_ids_.empty()) {
+    id = *sync_available_ids_.begin();
+  }
+  if (id > 0) {
+    sync_available_ids_.erase(id);
+    sync_node_ids_[request.node_name] = id;
+  }
+  response.agent_id = id;
+  response.number_of_agents = number_of_agents_;
+  response.start_time = sync_start_time_;
+  sync_mutex_.unlock();
+
+  if (id == 0) {
+    CONSOLE_STREAM(ERROR, "No agent id left for node " << request.node_name << " (number of agents " << number_of_agents_ << ").");
+    return false;
+  }
+  CONSOLE_STREAM(INFO, "Agent id " << id << " assigned to node " << request.node_name << " (common start " << response.start_time << ").");
+  return true;
+}
 
-  std::stringstream s;
-  s << "Theta value after correction (" << theta << ").";
-  console(__func__, s, DEBUG_VVVV);
+void VisualizationCore::tfCallback(const tf2_msgs::TFMessage &msg) {
+  for (auto const &transform : msg.transforms) {
+    int id;
+    bool is_virtual;
+    std::string parent = transform.header.frame_id;
+    if (!parent.empty() && parent.front() == '/') {
+      parent.erase(0, 1);
+    }
+    if (parent != frame_map_ || !parseAgentFrame(transform.child_frame_id, id, is_virtual)) {
+      continue;
+    }
+
+    geometry_msgs::Pose pose;
+    pose.position.x = transform.transform.translation.x;
+    pose.position.y = transform.transform.translation.y;
+    pose.position.z = transform.transform.translation.z;
+    pose.orientation = transform.transform.rotation;
+    storeAgentPose(id, is_virtual, pose, transform.header.stamp);
+  }
+}
+
+void VisualizationCore::tfTimerCallback(const ros::TimerEvent &timer_event) {
+  std::vector<tf::StampedTransform> transforms;
+  queued_transforms_mutex_.lock();
+  transforms.reserve(queued_transforms_.size());
+  for (auto const &transform : queued_transforms_) {
+    transforms.push_back(transform.second);
+  }
+  queued_transforms_.clear();
+  queued_transforms_mutex_.unlock();
+
+  if (!transforms.empty()) {
+    tf_broadcaster_.sendTransform(transforms);  // a single message for all the queued frames
+  }
+
+  CONSOLE_STREAM(DEBUG_VVVV, "Broadcasted " << transforms.size() << " transforms.");
+}
+
+void VisualizationCore::updateAgentGrid() {
+  std::map<int, geometry_msgs::Pose> agent_poses = lookupAgentPoses("");
+
+  agent_grid_ids_.clear();
+  agent_grid_x_.clear();
+  agent_grid_y_.clear();
+  for (auto const &agent : agent_poses) {
+    agent_grid_ids_.push_back(agent.first);
+    agent_grid_x_.push_back(agent.second.position.x);
+    agent_grid_y_.push_back(agent.second.position.y);
+  }
+  agent_grid_.build(agent_grid_ids_.size(), agent_grid_ids_.data(), agent_grid_x_.data(), agent_grid_y_.data(),
+                    grid_cell_size_);
 }
 
 void VisualizationCore::updateSpanningEllipse(const formation_control::FormationStatisticsStamped &msg) {
-  double a_x, a_y;  // will be initialized by statsToPhysics
-  double roll_old, pitch_old, yaw_old = std::nan("");  // only yaw_old is really used (thus initialized)
   std::string frame = msg.header.frame_id + frame_ellipse_suffix_;
 
-  // retrieves the old pose to correct the new one extracted from statistics (theta from [-pi/2,pi/2] to [-pi,pi])
-  if (frame == frame_target_ellipse_ && tf_listener_.canTransform(frame_map_, frame, ros::Time(0))) {
-    tf::StampedTransform pose_old;
-    tf_listener_.lookupTransform(frame_map_, frame, ros::Time(0), pose_old);
-    tf::Matrix3x3(pose_old.getRotation()).getRPY(roll_old, pitch_old, yaw_old);
+  // the last published pose corrects the new one extracted from statistics (theta from [-pi/2,pi/2] to [-pi,pi])
+  double theta_old = std::nan("");
+  if (frame == frame_target_ellipse_) {
+    ellipses_mutex_.lock();
+    auto old = ellipses_.find(frame);
+    if (old != ellipses_.end()) {
+      theta_old = old->second.theta;
+    }
+    ellipses_mutex_.unlock();
   }
 
-  tf::Pose pose = statsToPhysics(msg.stats, a_x, a_y, yaw_old);
-  tf_broadcaster_.sendTransform(tf::StampedTransform(pose, ros::Time::now(), frame_map_, frame));
-  marker_publisher_.publish(makeEllipse(computeDiameter(a_x), computeDiameter(a_y), frame, msg.agent_id));
+  publishSpanningEllipse(frame, msg.agent_id, StatsGeometry::statsToEllipse(msg.stats, theta_old));
 }
 
 void VisualizationCore::updateTarget(const formation_control::FormationStatistics &target) {
   updateTargetStats(target);
-  updateSpanningEllipse(target_statistics_);
+
+  formation_control::FormationStatisticsStamped msg;
+  msg.header.frame_id = target_stats_topic_name_;  // the same of target_statistics_
+  msg.stats = target;
+  updateSpanningEllipse(msg);
 }
 
 void VisualizationCore::updateTargetStats(const formation_control::FormationStatistics &target) {
   // target frame is constant and initialized in the constructor
-  target_statistics_.header.stamp = ros::Time::now();
+  target_mutex_.lock();
   target_statistics_.stats = target;
+  target_pending_ = true;
+  target_mutex_.unlock();
 
-  target_stats_publisher_.publish(target_statistics_);
+  publishTargetStats(false);
 }
@@ -18,8 +18,8 @@ int main(int argc, char **argv) {
 
   ros::init(argc, argv, "visualization");
 
-  // activates the asynchronous multi-thread spinner
-  ros::AsyncSpinner spinner(2);
+  // activates the asynchronous spinner of the global queue (ingest and algorithm have their own, see VisualizationCore)
+  ros::AsyncSpinner spinner(1);
   spinner.start();
 
   VisualizationCore *visualization = new VisualizationCore();